@@ -0,0 +1,256 @@
+#include "int-set.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Abstract data type for set of int's stored as a sorted array.
+ *  Membership is a binary search, addition a memmove() of the larger
+ *  elements and union and intersection are merges, so all of them
+ *  touch contiguous memory.  Sets do not allow duplicates.
+ *
+ *  elements[nElements] always holds SENTINEL.  Since elements[] is
+ *  strictly increasing, the successor of an element is the end of
+ *  the set exactly when it is not greater than the element; that
+ *  lets an iterator be just a pointer into elements[].
+ */
+
+enum {
+  INIT_CAPACITY = 4,
+  SENTINEL = INT_MIN,
+};
+
+typedef struct {
+  int nElements;
+  int capacity;           /** # of elements elements[] has room for,
+                           *  excluding the sentinel */
+  int *elements;          /** sorted ascending, followed by SENTINEL */
+} Header;
+
+/** Return a new empty int-set.  Returns NULL on error with errno set.
+ */
+void *
+newIntSet()
+{
+  Header *header = malloc(sizeof(Header));
+  if (!header) return NULL;
+  header->elements = malloc((INIT_CAPACITY + 1) * sizeof(int));
+  if (!header->elements) { free(header); return NULL; }
+  header->nElements = 0;
+  header->capacity = INIT_CAPACITY;
+  header->elements[0] = SENTINEL;
+  return header;
+}
+
+/** Return # of elements in intSet */
+int
+nElementsIntSet(void *intSet)
+{
+  const Header *header = (Header *)intSet;
+  return header->nElements;
+}
+
+/** Return index of first element of elements[n] which is >= element;
+ *  n if there is none.
+ */
+static int
+lowerBound(const int elements[], int n, int element)
+{
+  int lo = 0, hi = n;
+  while (lo < hi) {
+    int mid = lo + (hi - lo)/2;
+    if (elements[mid] < element) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/** Return non-zero iff intSet contains element. */
+int
+isInIntSet(void *intSet, int element)
+{
+  const Header *header = (Header *)intSet;
+  int i = lowerBound(header->elements, header->nElements, element);
+  return i < header->nElements && header->elements[i] == element;
+}
+
+/** Ensure header has room for at least n elements, growing by
+ *  doubling.  Returns < 0 on error with errno set.
+ */
+static int
+reserve(Header *header, int n)
+{
+  if (n <= header->capacity) return 0;
+  long capacity = header->capacity;
+  while (capacity < n) capacity *= 2;
+  if (capacity >= INT_MAX) capacity = INT_MAX - 1;
+  int *elements = realloc(header->elements, (capacity + 1) * sizeof(int));
+  if (!elements) return -1;
+  header->elements = elements;
+  header->capacity = capacity;
+  return 0;
+}
+
+/** Change intSet by adding element to it.  Returns # of elements
+ *  in intSet after addition.  Returns < 0 on error with errno
+ *  set.
+ */
+int
+addIntSet(void *intSet, int element)
+{
+  Header *header = (Header *)intSet;
+  int n = header->nElements;
+  int i = lowerBound(header->elements, n, element);
+  if (i < n && header->elements[i] == element) return n;
+  if (n == INT_MAX - 1) { errno = ENOMEM; return -1; }
+  if (reserve(header, n + 1) < 0) return -1;
+  int *p = &header->elements[i];
+  memmove(p + 1, p, (n + 1 - i) * sizeof(int)); //including sentinel
+  *p = element;
+  return ++header->nElements;
+}
+
+/** Merge the sorted elements of header with b[nB], which must be
+ *  strictly increasing, into a new array replacing header's.  Returns
+ *  # of elements in the merged set, < 0 on error with errno set.
+ */
+static int
+mergeUnion(Header *header, const int b[], int nB)
+{
+  int nA = header->nElements;
+  if (nB == 0) return nA;
+  if (nA > INT_MAX - 1 - nB) { errno = ENOMEM; return -1; }
+  int *merged = malloc((nA + nB + 1) * sizeof(int));
+  if (!merged) return -1;
+  const int *a = header->elements;
+  int i = 0, j = 0, k = 0;
+  while (i < nA && j < nB) {
+    if (a[i] < b[j]) {
+      merged[k++] = a[i++];
+    }
+    else if (a[i] > b[j]) {
+      merged[k++] = b[j++];
+    }
+    else {
+      merged[k++] = a[i++]; j++;
+    }
+  }
+  memcpy(&merged[k], &a[i], (nA - i) * sizeof(int));
+  k += nA - i;
+  memcpy(&merged[k], &b[j], (nB - j) * sizeof(int));
+  k += nB - j;
+  merged[k] = SENTINEL;
+  free(header->elements);
+  header->elements = merged;
+  header->capacity = nA + nB;
+  return header->nElements = k;
+}
+
+static int
+compareInts(const void *p1, const void *p2)
+{
+  int i1 = *(const int *)p1, i2 = *(const int *)p2;
+  return (i1 > i2) - (i1 < i2);
+}
+
+/** Change intSet by adding all elements in array elements[nElements] to
+ *  it.  Returns # of elements in intSet after addition.  Returns
+ *  < 0 on error with errno set.
+ */
+int
+addMultipleIntSet(void *intSet, const int elements[], int nElements)
+{
+  Header *header = (Header *)intSet;
+  if (nElements == 0) return header->nElements;
+  if (nElements == 1) return addIntSet(intSet, elements[0]);
+  //sort and merge a copy, rather than memmove() for each element
+  int *sorted = malloc(nElements * sizeof(int));
+  if (!sorted) return -1;
+  memcpy(sorted, elements, nElements * sizeof(int));
+  qsort(sorted, nElements, sizeof(int), compareInts);
+  int nUnique = 1;
+  for (int i = 1; i < nElements; i++) {
+    if (sorted[i] != sorted[nUnique - 1]) sorted[nUnique++] = sorted[i];
+  }
+  int n = mergeUnion(header, sorted, nUnique);
+  free(sorted);
+  return n;
+}
+
+/** Set intSetA to the union of intSetA and intSetB.  Return # of
+ *  elements in the updated intSetA.  Returns < 0 on error.
+ */
+int
+unionIntSet(void *intSetA, void *intSetB)
+{
+  const Header *headerB = (Header *)intSetB;
+  return mergeUnion((Header *)intSetA, headerB->elements, headerB->nElements);
+}
+
+/** Set intSetA to the intersection of intSetA and intSetB.  Return #
+ *  of elements in the updated intSetA.  Returns < 0 on error.
+ */
+int
+intersectionIntSet(void *intSetA, void *intSetB)
+{
+  Header *headerA = (Header *)intSetA;
+  const Header *headerB = (Header *)intSetB;
+  int *a = headerA->elements;
+  const int *b = headerB->elements;
+  int nA = headerA->nElements, nB = headerB->nElements;
+  int i = 0, j = 0, k = 0;
+  while (i < nA && j < nB) {  //k <= i, so the result overwrites a[]
+    if (a[i] < b[j]) {
+      i++;
+    }
+    else if (a[i] > b[j]) {
+      j++;
+    }
+    else {
+      a[k++] = a[i++]; j++;
+    }
+  }
+  a[k] = SENTINEL;
+  return headerA->nElements = k;
+}
+
+/** Free all resources used by previously created intSet. */
+void
+freeIntSet(void *intSet)
+{
+  Header *header = (Header *)intSet;
+  free(header->elements);
+  free(header);
+}
+
+/** Return a new iterator for intSet.  Returns NULL if intSet
+ *  is empty.  The iterator is invalidated by any change to intSet.
+ */
+const void *
+newIntSetIterator(const void *intSet)
+{
+  const Header *header = (Header *)intSet;
+  return header->nElements == 0 ? NULL : header->elements;
+}
+
+/** Return current element for intSetIterator. */
+int
+intSetIteratorElement(const void *intSetIterator)
+{
+  return *(const int *)intSetIterator;
+}
+
+/** Step intSetIterator and return stepped iterator.  Return
+ *  NULL if no more iterations are possible.
+ */
+const void *
+stepIntSetIterator(const void *intSetIterator)
+{
+  const int *p = (const int *)intSetIterator;
+  return p[1] > p[0] ? p + 1 : NULL;
+}
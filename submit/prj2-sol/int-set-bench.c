@@ -0,0 +1,161 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "int-set.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Benchmark of whichever int-set backend this is linked with.  For
+ *  each size n from 10**3 up to MAX_N it builds a set A of the first n
+ *  even ints and a set B of the first n multiples of 3, and prints a
+ *  CSV line of the time per element or operation of:
+ *
+ *    build:     addMultipleIntSet() of all of A, largest first
+ *    add:       addIntSet() of an odd int, not already in A
+ *    isIn:      isInIntSet() of a random int in [0, 2n)
+ *    iterate:   a step of an iterator over A
+ *    union:     unionIntSet(A, B), per element of A and B
+ *    intersect: intersectionIntSet(A, B), per element of A and B
+ *
+ *  The add and isIn operations are repeated up to N_OPS times but
+ *  stop after OP_SECS, so that O(n) operations on large sets finish.
+ *  A size whose build takes more than MAX_BUILD_SECS is the last.
+ */
+
+enum {
+  MIN_N = 1000,
+  DEFAULT_MAX_N = 10000000,
+  N_OPS = 10000,
+};
+
+static const double OP_SECS = 0.2;
+static const double MAX_BUILD_SECS = 5.0;
+
+static void
+usage(const char *progName)
+{
+  fprintf(stderr, "usage: %s [MAX_N]\n", progName);
+  fprintf(stderr, "  benchmarks int-set for sizes 10**3 up to MAX_N "
+          "(default %d)\n", DEFAULT_MAX_N);
+  exit(1);
+}
+
+static void
+check(int n, const char *op)
+{
+  if (n < 0) {
+    fprintf(stderr, "%s failed: %s\n", op, strerror(errno));
+    exit(1);
+  }
+}
+
+static double
+now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+/** A small LCG; good enough to scatter lookups */
+static unsigned
+nextRandom(unsigned long *state)
+{
+  *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+  return *state >> 33;
+}
+
+static void *
+newMultiplesIntSet(int n, int k)
+{
+  int *elements = malloc(n * sizeof(int));
+  if (!elements) check(-1, "malloc");
+  for (int i = 0; i < n; i++) elements[i] = (n - 1 - i)*k;
+  void *set = newIntSet();
+  if (!set) check(-1, "newIntSet");
+  check(addMultipleIntSet(set, elements, n), "addMultipleIntSet");
+  free(elements);
+  return set;
+}
+
+/** Run benchmarks for size n, returning the build time in seconds */
+static double
+bench(int n)
+{
+  double t0 = now();
+  void *a = newMultiplesIntSet(n, 2);
+  double build = now() - t0;
+  void *b = newMultiplesIntSet(n, 3);
+
+  unsigned long state = n;
+  int nAdds = 0;
+  t0 = now();
+  double t1 = t0;
+  while (nAdds < N_OPS && t1 - t0 < OP_SECS) {
+    check(addIntSet(a, 2*(nextRandom(&state) % n) + 1), "addIntSet");
+    if (++nAdds % 16 == 0) t1 = now();
+  }
+  t1 = now();
+  double add = (t1 - t0)/nAdds;
+
+  int nLookups = 0, nFound = 0;
+  t0 = t1;
+  while (nLookups < N_OPS && t1 - t0 < OP_SECS) {
+    nFound += isInIntSet(a, nextRandom(&state) % (2*n));
+    if (++nLookups % 16 == 0) t1 = now();
+  }
+  t1 = now();
+  double isIn = (t1 - t0)/nLookups;
+
+  long sum = 0;
+  int nA = nElementsIntSet(a), nB = nElementsIntSet(b);
+  t0 = now();
+  for (const void *iter = newIntSetIterator(a); iter != NULL;
+       iter = stepIntSetIterator(iter)) {
+    sum += intSetIteratorElement(iter);
+  }
+  double iterate = (now() - t0)/nA;
+
+  t0 = now();
+  int nUnion = unionIntSet(a, b);
+  check(nUnion, "unionIntSet");
+  double unionTime = (now() - t0)/(nA + nB);
+
+  t0 = now();
+  int nIntersect = intersectionIntSet(a, b);
+  check(nIntersect, "intersectionIntSet");
+  double intersect = (now() - t0)/(nUnion + nB);
+
+  if (nIntersect != nB || sum == 0 || nFound > nLookups) {
+    fprintf(stderr, "inconsistent results for n = %d\n", n);
+    exit(1);
+  }
+  printf("%d,%.1f,%.1f,%.1f,%.2f,%.2f,%.2f\n", n, build/n*1e9, add*1e9,
+         isIn*1e9, iterate*1e9, unionTime*1e9, intersect*1e9);
+  fflush(stdout);
+  freeIntSet(a);
+  freeIntSet(b);
+  return build;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  long maxN = DEFAULT_MAX_N;
+  if (argc > 2) usage(argv[0]);
+  if (argc == 2) {
+    char *p;
+    maxN = strtol(argv[1], &p, 10);
+    if (*p != '\0' || maxN < MIN_N || maxN > DEFAULT_MAX_N*10L) {
+      usage(argv[0]);
+    }
+  }
+  printf("n,build_ns,add_ns,isIn_ns,iterate_ns,union_ns,intersect_ns\n");
+  for (long n = MIN_N; n <= maxN; n *= 10) {
+    if (bench(n) > MAX_BUILD_SECS) break;
+  }
+  return 0;
+}
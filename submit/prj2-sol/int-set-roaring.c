@@ -0,0 +1,917 @@
+#include "int-set.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Abstract data type for set of int's stored Roaring-style, after
+ *  Lemire et al., "Roaring Bitmaps: Implementation of an Optimized
+ *  Software Library".  Sets do not allow duplicates.
+ *
+ *  Elements are biased by flipping their sign bit, so that their
+ *  unsigned order is their int order.  The high 16 bits of a biased
+ *  element are the key of the chunk containing it and the low 16 bits
+ *  its value within the chunk.  Each non-empty chunk has a Container
+ *  holding its values in whichever of three forms is smallest:
+ *
+ *    ARRAY:  sorted uint16_t values; at most ARRAY_MAX of them.
+ *    BITMAP: 2**16 bits, 8 KiB whatever the # of values.
+ *    RUN:    sorted runs [start, last] of consecutive values.
+ *
+ *  Unions and intersections go chunk by chunk, ORing and ANDing the
+ *  words of bitmaps and merging arrays and runs.
+ *
+ *  Iterators are pointers into a sorted int[] snapshot of the set
+ *  followed by SENTINEL, as in int-set-array.c, so that they are plain
+ *  values and a step is O(1).  The snapshot is built by the first
+ *  newIntSetIterator() after a change and reused until the next.
+ */
+
+enum {
+  CHUNK_BITS = 16,
+  CHUNK_SIZE = 1 << CHUNK_BITS,     /** # of values in a chunk */
+  CHUNK_MASK = CHUNK_SIZE - 1,
+  N_WORDS = CHUNK_SIZE/64,          /** # of 64-bit words in a bitmap */
+  ARRAY_MAX = 4096,                 /** an array this full is a bitmap's size */
+  RUN_MAX = 2048,                   /** so are this many runs */
+  INIT_CAPACITY = 4,
+  SENTINEL = INT_MIN,               /** ends the snapshot */
+};
+
+typedef enum {
+  ARRAY_CONTAINER,
+  BITMAP_CONTAINER,
+  RUN_CONTAINER,
+  END_CONTAINER,                    /** follows the last container */
+} ContainerType;
+
+typedef struct {
+  uint16_t start, last;             /** inclusive */
+} Run;
+
+typedef struct {
+  uint16_t key;                     /** high 16 bits of biased elements */
+  uint8_t type;                     /** a ContainerType */
+  int n;                            /** # of values, > 0 */
+  int nRuns;                        /** RUN only */
+  int capacity;                     /** # of values or runs allocated */
+  union {
+    uint16_t *values;
+    uint64_t *words;
+    Run *runs;
+  };
+} Container;
+
+typedef struct {
+  long nElements;
+  int nContainers;
+  int capacity;                     /** excluding the END_CONTAINER */
+  Container *containers;            /** by increasing key */
+  int *snapshot;                    /** elements, then SENTINEL; or NULL */
+  bool isSnapshotStale;             /** set by every change */
+} Header;
+
+static inline uint32_t
+toBiased(int element)
+{
+  return (uint32_t)element ^ 0x80000000u;
+}
+
+static inline int
+fromBiased(uint32_t biased)
+{
+  return (int32_t)(biased ^ 0x80000000u);
+}
+
+/** Return index of first of values[n] which is >= value; n if none. */
+static int
+lowerBound16(const uint16_t values[], int n, unsigned value)
+{
+  int lo = 0, hi = n;
+  while (lo < hi) {
+    int mid = lo + (hi - lo)/2;
+    if (values[mid] < value) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/** Return index of last of runs[n] which starts <= value; -1 if none. */
+static int
+findRun(const Run runs[], int n, unsigned value)
+{
+  int lo = 0, hi = n;
+  while (lo < hi) {
+    int mid = lo + (hi - lo)/2;
+    if (runs[mid].start <= value) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo - 1;
+}
+
+/** Return first bit >= pos of words[] which is set (if flip is 0) or
+ *  clear (if flip is all 1's); CHUNK_SIZE if none.
+ */
+static unsigned
+nextBit(const uint64_t words[], unsigned pos, uint64_t flip)
+{
+  if (pos >= CHUNK_SIZE) return CHUNK_SIZE;
+  unsigned i = pos/64;
+  uint64_t w = (words[i] ^ flip) & (~0ULL << pos%64);
+  while (w == 0) {
+    if (++i == N_WORDS) return CHUNK_SIZE;
+    w = words[i] ^ flip;
+  }
+  return i*64 + __builtin_ctzll(w);
+}
+
+/** Set bits [lo, hi] of words[] */
+static void
+setRange(uint64_t words[], unsigned lo, unsigned hi)
+{
+  unsigned i = lo/64, iLast = hi/64;
+  uint64_t loMask = ~0ULL << lo%64, hiMask = ~0ULL >> (63 - hi%64);
+  if (i == iLast) {
+    words[i] |= loMask & hiMask;
+    return;
+  }
+  words[i++] |= loMask;
+  while (i < iLast) words[i++] = ~0ULL;
+  words[iLast] |= hiMask;
+}
+
+static int
+bitmapCount(const uint64_t words[])
+{
+  int n = 0;
+  for (int i = 0; i < N_WORDS; i++) n += __builtin_popcountll(words[i]);
+  return n;
+}
+
+/** Return # of runs of consecutive values in c */
+static int
+countRuns(const Container *c)
+{
+  int nRuns = 0;
+  switch (c->type) {
+  case ARRAY_CONTAINER:
+    nRuns = 1;
+    for (int i = 1; i < c->n; i++) {
+      nRuns += c->values[i] != c->values[i - 1] + 1;
+    }
+    break;
+  case BITMAP_CONTAINER: {
+    uint64_t carry = 0;   //last bit of previous word
+    for (int i = 0; i < N_WORDS; i++) {
+      uint64_t w = c->words[i];
+      nRuns += __builtin_popcountll(w & ~(w << 1 | carry));  //run starts
+      carry = w >> 63;
+    }
+    break;
+  }
+  case RUN_CONTAINER:
+    nRuns = c->nRuns;
+    break;
+  }
+  return nRuns;
+}
+
+/** Ensure the values or runs (of size elementSize) of c have room for
+ *  n <= max, growing by doubling up to max.  Returns < 0 on error with
+ *  errno set.
+ */
+static int
+reserve(Container *c, int n, size_t elementSize, int max)
+{
+  if (n <= c->capacity) return 0;
+  int capacity = c->capacity;
+  while (capacity < n) capacity *= 2;
+  if (capacity > max) capacity = max;
+  void *p = realloc(c->values, capacity * elementSize);
+  if (!p) return -1;
+  c->values = p;
+  c->capacity = capacity;
+  return 0;
+}
+
+/** The conversions between container types below return < 0 on
+ *  error with errno set, leaving c unchanged.
+ */
+
+static int
+toBitmap(Container *c)
+{
+  uint64_t *words = calloc(N_WORDS, sizeof(uint64_t));
+  if (!words) return -1;
+  if (c->type == ARRAY_CONTAINER) {
+    for (int i = 0; i < c->n; i++) {
+      words[c->values[i]/64] |= 1ULL << c->values[i]%64;
+    }
+  }
+  else {
+    for (int i = 0; i < c->nRuns; i++) {
+      setRange(words, c->runs[i].start, c->runs[i].last);
+    }
+  }
+  free(c->values);
+  c->words = words;
+  c->type = BITMAP_CONTAINER;
+  c->capacity = N_WORDS;
+  return 0;
+}
+
+/** c must have at most ARRAY_MAX values */
+static int
+toArray(Container *c)
+{
+  int capacity = c->n < INIT_CAPACITY ? INIT_CAPACITY : c->n;
+  uint16_t *values = malloc(capacity * sizeof(uint16_t));
+  if (!values) return -1;
+  int k = 0;
+  if (c->type == BITMAP_CONTAINER) {
+    for (int i = 0; i < N_WORDS; i++) {
+      for (uint64_t w = c->words[i]; w != 0; w &= w - 1) {
+        values[k++] = i*64 + __builtin_ctzll(w);
+      }
+    }
+  }
+  else {
+    for (int i = 0; i < c->nRuns; i++) {
+      for (unsigned v = c->runs[i].start; v <= c->runs[i].last; v++) {
+        values[k++] = v;
+      }
+    }
+  }
+  free(c->values);
+  c->values = values;
+  c->type = ARRAY_CONTAINER;
+  c->capacity = capacity;
+  return 0;
+}
+
+/** c must have nRuns runs */
+static int
+toRuns(Container *c, int nRuns)
+{
+  Run *runs = malloc(nRuns * sizeof(Run));
+  if (!runs) return -1;
+  int k = 0;
+  if (c->type == ARRAY_CONTAINER) {
+    for (int i = 0; i < c->n; i++) {
+      if (k > 0 && c->values[i] == runs[k - 1].last + 1) {
+        runs[k - 1].last = c->values[i];
+      }
+      else {
+        runs[k++] = (Run){ c->values[i], c->values[i] };
+      }
+    }
+  }
+  else {
+    for (unsigned pos = nextBit(c->words, 0, 0); pos < CHUNK_SIZE;
+         pos = nextBit(c->words, pos, 0)) {
+      unsigned end = nextBit(c->words, pos, ~0ULL);
+      runs[k++] = (Run){ pos, end - 1 };
+      pos = end;
+    }
+  }
+  assert(k == nRuns);
+  free(c->values);
+  c->runs = runs;
+  c->type = RUN_CONTAINER;
+  c->nRuns = c->capacity = nRuns;
+  return 0;
+}
+
+/** Convert non-empty c to whichever type is smallest for its values.
+ *  This only saves space, so callers may ignore an error, which leaves
+ *  c unchanged.
+ */
+static int
+optimize(Container *c)
+{
+  int nRuns = countRuns(c);
+  long runBytes = nRuns * sizeof(Run);
+  long arrayBytes = (c->n <= ARRAY_MAX) ? c->n * sizeof(uint16_t) : LONG_MAX;
+  long bitmapBytes = N_WORDS * sizeof(uint64_t);
+  if (runBytes < arrayBytes && runBytes < bitmapBytes) {
+    return (c->type == RUN_CONTAINER) ? 0 : toRuns(c, nRuns);
+  }
+  else if (arrayBytes <= bitmapBytes) {
+    return (c->type == ARRAY_CONTAINER) ? 0 : toArray(c);
+  }
+  else {
+    return (c->type == BITMAP_CONTAINER) ? 0 : toBitmap(c);
+  }
+}
+
+static int
+containerContains(const Container *c, unsigned value)
+{
+  switch (c->type) {
+  case ARRAY_CONTAINER: {
+    int i = lowerBound16(c->values, c->n, value);
+    return i < c->n && c->values[i] == value;
+  }
+  case BITMAP_CONTAINER:
+    return (c->words[value/64] >> value%64) & 1;
+  case RUN_CONTAINER: {
+    int i = findRun(c->runs, c->nRuns, value);
+    return i >= 0 && value <= c->runs[i].last;
+  }
+  }
+  return 0;
+}
+
+/** Add value to c.  Return 1 if added, 0 if already present, < 0 on
+ *  error with errno set.  Arrays and runs are optimized each time they
+ *  must grow, which is amortized O(1) per value; bitmaps when they
+ *  first become one and when full.
+ */
+static int
+containerAdd(Container *c, unsigned value)
+{
+  switch (c->type) {
+  case ARRAY_CONTAINER: {
+    int i = lowerBound16(c->values, c->n, value);
+    if (i < c->n && c->values[i] == value) return 0;
+    if (c->n == ARRAY_MAX) {
+      if (toBitmap(c) < 0) return -1;
+      return containerAdd(c, value);
+    }
+    if (c->n == c->capacity) {
+      optimize(c);
+      if (c->type != ARRAY_CONTAINER) return containerAdd(c, value);
+    }
+    if (reserve(c, c->n + 1, sizeof(uint16_t), ARRAY_MAX) < 0) return -1;
+    uint16_t *p = &c->values[i];
+    memmove(p + 1, p, (c->n - i) * sizeof(uint16_t));
+    *p = value;
+    break;
+  }
+  case BITMAP_CONTAINER: {
+    uint64_t *w = &c->words[value/64];
+    uint64_t bit = 1ULL << value%64;
+    if (*w & bit) return 0;
+    *w |= bit;
+    if (++c->n == ARRAY_MAX + 1 || c->n == CHUNK_SIZE) optimize(c);
+    return 1;
+  }
+  case RUN_CONTAINER: {
+    int i = findRun(c->runs, c->nRuns, value);
+    if (i >= 0 && value <= c->runs[i].last) return 0;
+    int isAfterPrev = i >= 0 && c->runs[i].last + 1 == value;
+    int isBeforeNext = i + 1 < c->nRuns && c->runs[i + 1].start == value + 1;
+    if (isAfterPrev && isBeforeNext) {
+      c->runs[i].last = c->runs[i + 1].last;
+      memmove(&c->runs[i + 1], &c->runs[i + 2],
+              (c->nRuns - i - 2) * sizeof(Run));
+      c->nRuns--;
+    }
+    else if (isAfterPrev) {
+      c->runs[i].last = value;
+    }
+    else if (isBeforeNext) {
+      c->runs[i + 1].start = value;
+    }
+    else {
+      if (c->nRuns == RUN_MAX) {
+        int status = (c->n <= ARRAY_MAX) ? toArray(c) : toBitmap(c);
+        if (status < 0) return -1;
+        return containerAdd(c, value);
+      }
+      if (c->nRuns == c->capacity) {
+        optimize(c);
+        if (c->type != RUN_CONTAINER) return containerAdd(c, value);
+      }
+      if (reserve(c, c->nRuns + 1, sizeof(Run), RUN_MAX) < 0) return -1;
+      Run *p = &c->runs[i + 1];
+      memmove(p + 1, p, (c->nRuns - i - 1) * sizeof(Run));
+      *p = (Run){ value, value };
+      c->nRuns++;
+    }
+    break;
+  }
+  }
+  c->n++;
+  return 1;
+}
+
+/** Set *copy to a new copy of c.  Returns < 0 on error with errno
+ *  set.
+ */
+static int
+copyContainer(Container *copy, const Container *c)
+{
+  size_t size = (c->type == ARRAY_CONTAINER) ? c->n * sizeof(uint16_t)
+    : (c->type == BITMAP_CONTAINER) ? N_WORDS * sizeof(uint64_t)
+    : c->nRuns * sizeof(Run);
+  *copy = *c;
+  if (!(copy->values = malloc(size))) return -1;
+  memcpy(copy->values, c->values, size);
+  copy->capacity = (c->type == ARRAY_CONTAINER) ? c->n
+    : (c->type == BITMAP_CONTAINER) ? N_WORDS
+    : c->nRuns;
+  return 0;
+}
+
+/** OR the values of c into words[] */
+static void
+orInto(uint64_t words[], const Container *c)
+{
+  switch (c->type) {
+  case ARRAY_CONTAINER:
+    for (int i = 0; i < c->n; i++) {
+      words[c->values[i]/64] |= 1ULL << c->values[i]%64;
+    }
+    break;
+  case BITMAP_CONTAINER:
+    for (int i = 0; i < N_WORDS; i++) words[i] |= c->words[i];
+    break;
+  case RUN_CONTAINER:
+    for (int i = 0; i < c->nRuns; i++) {
+      setRange(words, c->runs[i].start, c->runs[i].last);
+    }
+    break;
+  }
+}
+
+/** Return # of values in the runs[n] */
+static int
+runsCount(const Run runs[], int n)
+{
+  int count = 0;
+  for (int i = 0; i < n; i++) count += runs[i].last - runs[i].start + 1;
+  return count;
+}
+
+/** Set c to the union of c and d.  Returns < 0 on error with errno
+ *  set, leaving c unchanged.
+ */
+static int
+containerUnion(Container *c, const Container *d)
+{
+  if (c->type == ARRAY_CONTAINER && d->type == ARRAY_CONTAINER &&
+      c->n + d->n <= ARRAY_MAX) {
+    uint16_t *values = malloc((c->n + d->n) * sizeof(uint16_t));
+    if (!values) return -1;
+    const uint16_t *a = c->values, *b = d->values;
+    int i = 0, j = 0, k = 0;
+    while (i < c->n && j < d->n) {
+      if (a[i] < b[j]) {
+        values[k++] = a[i++];
+      }
+      else if (a[i] > b[j]) {
+        values[k++] = b[j++];
+      }
+      else {
+        values[k++] = a[i++]; j++;
+      }
+    }
+    while (i < c->n) values[k++] = a[i++];
+    while (j < d->n) values[k++] = b[j++];
+    free(c->values);
+    c->values = values;
+    c->capacity = c->n + d->n;
+    c->n = k;
+    optimize(c);
+  }
+  else if (c->type == RUN_CONTAINER && d->type == RUN_CONTAINER) {
+    Run *runs = malloc((c->nRuns + d->nRuns) * sizeof(Run));
+    if (!runs) return -1;
+    const Run *a = c->runs, *b = d->runs;
+    int i = 0, j = 0, k = 0;
+    while (i < c->nRuns || j < d->nRuns) {
+      Run r = (j == d->nRuns || (i < c->nRuns && a[i].start < b[j].start))
+        ? a[i++] : b[j++];
+      if (k > 0 && r.start <= runs[k - 1].last + 1) {
+        if (r.last > runs[k - 1].last) runs[k - 1].last = r.last;
+      }
+      else {
+        runs[k++] = r;
+      }
+    }
+    free(c->runs);
+    c->runs = runs;
+    c->capacity = c->nRuns + d->nRuns;
+    c->nRuns = k;
+    c->n = runsCount(runs, k);
+    optimize(c);
+  }
+  else {
+    if (c->type != BITMAP_CONTAINER && toBitmap(c) < 0) return -1;
+    orInto(c->words, d);
+    c->n = bitmapCount(c->words);
+    optimize(c);
+  }
+  return 0;
+}
+
+/** Set c to the intersection of c and d, possibly leaving it with no
+ *  values.  Returns < 0 on error with errno set, leaving c unchanged.
+ */
+static int
+containerIntersection(Container *c, const Container *d)
+{
+  if (c->type == ARRAY_CONTAINER) {
+    int k = 0;
+    if (d->type == ARRAY_CONTAINER) {
+      const uint16_t *b = d->values;
+      for (int i = 0, j = 0; i < c->n && j < d->n; ) {
+        if (c->values[i] < b[j]) {
+          i++;
+        }
+        else if (c->values[i] > b[j]) {
+          j++;
+        }
+        else {
+          c->values[k++] = c->values[i++]; j++;
+        }
+      }
+    }
+    else {
+      for (int i = 0; i < c->n; i++) {
+        if (containerContains(d, c->values[i])) {
+          c->values[k++] = c->values[i];
+        }
+      }
+    }
+    if ((c->n = k) > 0) optimize(c);
+  }
+  else if (d->type == ARRAY_CONTAINER) {
+    int capacity = d->n < INIT_CAPACITY ? INIT_CAPACITY : d->n;
+    uint16_t *values = malloc(capacity * sizeof(uint16_t));
+    if (!values) return -1;
+    int k = 0;
+    for (int j = 0; j < d->n; j++) {
+      if (containerContains(c, d->values[j])) values[k++] = d->values[j];
+    }
+    free(c->values);
+    c->values = values;
+    c->type = ARRAY_CONTAINER;
+    c->capacity = capacity;
+    if ((c->n = k) > 0) optimize(c);
+  }
+  else if (c->type == RUN_CONTAINER && d->type == RUN_CONTAINER) {
+    Run *runs = malloc((c->nRuns + d->nRuns) * sizeof(Run));
+    if (!runs) return -1;
+    const Run *a = c->runs, *b = d->runs;
+    int i = 0, j = 0, k = 0;
+    while (i < c->nRuns && j < d->nRuns) {
+      uint16_t start = a[i].start > b[j].start ? a[i].start : b[j].start;
+      uint16_t last = a[i].last < b[j].last ? a[i].last : b[j].last;
+      if (start <= last) runs[k++] = (Run){ start, last };
+      if (a[i].last < b[j].last) {
+        i++;
+      }
+      else {
+        j++;
+      }
+    }
+    free(c->runs);
+    c->runs = runs;
+    c->capacity = c->nRuns + d->nRuns;
+    c->nRuns = k;
+    c->n = runsCount(runs, k);
+    if (c->n > 0) optimize(c);
+  }
+  else {
+    if (c->type != BITMAP_CONTAINER && toBitmap(c) < 0) return -1;
+    if (d->type == BITMAP_CONTAINER) {
+      for (int i = 0; i < N_WORDS; i++) c->words[i] &= d->words[i];
+    }
+    else {
+      uint64_t words[N_WORDS] = { 0 };
+      orInto(words, d);
+      for (int i = 0; i < N_WORDS; i++) c->words[i] &= words[i];
+    }
+    c->n = bitmapCount(c->words);
+    if (c->n > 0) optimize(c);
+  }
+  return 0;
+}
+
+static void
+setEnd(Header *header)
+{
+  header->containers[header->nContainers].type = END_CONTAINER;
+}
+
+/** Return a new empty int-set.  Returns NULL on error with errno set.
+ */
+void *
+newIntSet()
+{
+  Header *header = malloc(sizeof(Header));
+  if (!header) return NULL;
+  header->containers = malloc((INIT_CAPACITY + 1) * sizeof(Container));
+  if (!header->containers) { free(header); return NULL; }
+  header->nElements = 0;
+  header->nContainers = 0;
+  header->capacity = INIT_CAPACITY;
+  header->snapshot = NULL;
+  header->isSnapshotStale = true;
+  setEnd(header);
+  return header;
+}
+
+/** Return # of elements in intSet */
+int
+nElementsIntSet(void *intSet)
+{
+  const Header *header = (Header *)intSet;
+  return header->nElements;
+}
+
+/** Return index of first container of header with key >= key;
+ *  header->nContainers if none.
+ */
+static int
+findContainer(const Header *header, unsigned key)
+{
+  int lo = 0, hi = header->nContainers;
+  while (lo < hi) {
+    int mid = lo + (hi - lo)/2;
+    if (header->containers[mid].key < key) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/** Return non-zero iff intSet contains element. */
+int
+isInIntSet(void *intSet, int element)
+{
+  const Header *header = (Header *)intSet;
+  uint32_t biased = toBiased(element);
+  int i = findContainer(header, biased >> CHUNK_BITS);
+  return i < header->nContainers &&
+    header->containers[i].key == biased >> CHUNK_BITS &&
+    containerContains(&header->containers[i], biased & CHUNK_MASK);
+}
+
+/** Return header->nElements after checking that it fits in an int.
+ *  Returns < 0 with errno set if it does not.
+ */
+static int
+nElementsResult(const Header *header)
+{
+  if (header->nElements > INT_MAX) { errno = EOVERFLOW; return -1; }
+  return header->nElements;
+}
+
+/** Change intSet by adding element to it.  Returns # of elements
+ *  in intSet after addition.  Returns < 0 on error with errno
+ *  set.
+ */
+int
+addIntSet(void *intSet, int element)
+{
+  Header *header = (Header *)intSet;
+  header->isSnapshotStale = true;
+  uint32_t biased = toBiased(element);
+  unsigned key = biased >> CHUNK_BITS;
+  int i = findContainer(header, key);
+  Container *c = &header->containers[i];
+  if (i == header->nContainers || c->key != key) {
+    if (header->nContainers == header->capacity) {
+      int capacity = 2*header->capacity;
+      Container *containers =
+        realloc(header->containers, (capacity + 1) * sizeof(Container));
+      if (!containers) return -1;
+      header->containers = containers;
+      header->capacity = capacity;
+    }
+    uint16_t *values = malloc(INIT_CAPACITY * sizeof(uint16_t));
+    if (!values) return -1;
+    c = &header->containers[i];
+    memmove(c + 1, c, (header->nContainers - i) * sizeof(Container));
+    header->nContainers++;
+    setEnd(header);
+    *c = (Container) {
+      .key = key, .type = ARRAY_CONTAINER, .n = 0,
+      .capacity = INIT_CAPACITY, .values = values,
+    };
+  }
+  int added = containerAdd(c, biased & CHUNK_MASK);
+  if (added < 0) return -1;
+  header->nElements += added;
+  return nElementsResult(header);
+}
+
+/** Change intSet by adding all elements in array elements[nElements] to
+ *  it.  Returns # of elements in intSet after addition.  Returns
+ *  < 0 on error with errno set.
+ */
+int
+addMultipleIntSet(void *intSet, const int elements[], int nElements)
+{
+  int n = nElementsIntSet(intSet);
+  for (int i = 0; i < nElements; i++) {
+    if ((n = addIntSet(intSet, elements[i])) < 0) break;
+  }
+  return n;
+}
+
+/** Set intSetA to the union of intSetA and intSetB.  Return # of
+ *  elements in the updated intSetA.  Returns < 0 on error.
+ */
+int
+unionIntSet(void *intSetA, void *intSetB)
+{
+  Header *headerA = (Header *)intSetA;
+  const Header *headerB = (Header *)intSetB;
+  headerA->isSnapshotStale = true;
+  const Container *a = headerA->containers, *b = headerB->containers;
+  int nA = headerA->nContainers, nB = headerB->nContainers;
+  if (nB == 0) return nElementsResult(headerA);
+
+  //copy containers only in B first, so that failure leaves A unchanged
+  int nOnlyB = 0;
+  for (int i = 0, j = 0; j < nB; j++) {
+    while (i < nA && a[i].key < b[j].key) i++;
+    if (i == nA || a[i].key != b[j].key) nOnlyB++;
+  }
+  Container *merged = malloc((nA + nOnlyB + 1) * sizeof(Container));
+  Container *onlyB = malloc((nOnlyB + 1) * sizeof(Container));
+  int k = 0;
+  if (merged && onlyB) {
+    for (int i = 0, j = 0; j < nB; j++) {
+      while (i < nA && a[i].key < b[j].key) i++;
+      if (i < nA && a[i].key == b[j].key) continue;
+      if (copyContainer(&onlyB[k], &b[j]) < 0) break;
+      k++;
+    }
+  }
+  if (k < nOnlyB || !merged || !onlyB) {
+    for (int i = 0; i < k; i++) free(onlyB[i].values);
+    free(merged);
+    free(onlyB);
+    return -1;
+  }
+
+  int status = 0;
+  int i = 0, j = 0;
+  k = 0;
+  for (int iOnlyB = 0; i < nA || iOnlyB < nOnlyB; ) {
+    if (iOnlyB == nOnlyB || (i < nA && a[i].key < onlyB[iOnlyB].key)) {
+      Container *c = &headerA->containers[i++];
+      while (j < nB && b[j].key < c->key) j++;
+      if (status == 0 && j < nB && b[j].key == c->key) {
+        status = containerUnion(c, &b[j]);
+      }
+      merged[k++] = *c;
+    }
+    else {
+      merged[k++] = onlyB[iOnlyB++];
+    }
+  }
+  free(onlyB);
+  free(headerA->containers);
+  headerA->containers = merged;
+  headerA->nContainers = headerA->capacity = k;
+  setEnd(headerA);
+  headerA->nElements = 0;
+  for (int i = 0; i < k; i++) headerA->nElements += merged[i].n;
+  return (status < 0) ? status : nElementsResult(headerA);
+}
+
+/** Set intSetA to the intersection of intSetA and intSetB.  Return #
+ *  of elements in the updated intSetA.  Returns < 0 on error.
+ */
+int
+intersectionIntSet(void *intSetA, void *intSetB)
+{
+  Header *headerA = (Header *)intSetA;
+  const Header *headerB = (Header *)intSetB;
+  headerA->isSnapshotStale = true;
+  const Container *b = headerB->containers;
+  int nB = headerB->nContainers;
+  int status = 0;
+  int j = 0, k = 0;
+  for (int i = 0; i < headerA->nContainers; i++) {
+    Container *c = &headerA->containers[i];
+    while (j < nB && b[j].key < c->key) j++;
+    if (status == 0) {
+      if (j < nB && b[j].key == c->key) {
+        status = containerIntersection(c, &b[j]);
+      }
+      else {
+        c->n = 0;
+      }
+    }
+    if (c->n > 0) {
+      headerA->containers[k++] = *c;
+    }
+    else {
+      free(c->values);
+    }
+  }
+  headerA->nContainers = k;
+  setEnd(headerA);
+  headerA->nElements = 0;
+  for (int i = 0; i < k; i++) headerA->nElements += headerA->containers[i].n;
+  return (status < 0) ? status : nElementsResult(headerA);
+}
+
+/** Free all resources used by previously created intSet. */
+void
+freeIntSet(void *intSet)
+{
+  Header *header = (Header *)intSet;
+  for (int i = 0; i < header->nContainers; i++) {
+    free(header->containers[i].values);
+  }
+  free(header->containers);
+  free(header->snapshot);
+  free(header);
+}
+
+/** Write the elements of c in increasing order to elements[],
+ *  returning a pointer just past the last one written.
+ */
+static int *
+writeElements(int *elements, const Container *c)
+{
+  uint32_t high = (uint32_t)c->key << CHUNK_BITS;
+  switch (c->type) {
+  case ARRAY_CONTAINER:
+    for (int k = 0; k < c->n; k++) {
+      *elements++ = fromBiased(high | c->values[k]);
+    }
+    break;
+  case BITMAP_CONTAINER:
+    for (unsigned i = 0; i < N_WORDS; i++) {
+      for (uint64_t w = c->words[i]; w != 0; w &= w - 1) {
+        *elements++ = fromBiased(high | (i*64 + __builtin_ctzll(w)));
+      }
+    }
+    break;
+  case RUN_CONTAINER:
+    for (int k = 0; k < c->nRuns; k++) {
+      for (unsigned v = c->runs[k].start; v <= c->runs[k].last; v++) {
+        *elements++ = fromBiased(high | v);
+      }
+    }
+    break;
+  }
+  return elements;
+}
+
+/** Return a new iterator for intSet.  Returns NULL if intSet
+ *  is empty, or on error with errno set.  The iterator is invalidated
+ *  by any change to intSet.
+ */
+const void *
+newIntSetIterator(const void *intSet)
+{
+  //the snapshot is a cache, not part of the set's value
+  Header *header = (Header *)intSet;
+  if (header->nElements == 0) return NULL;
+  if (header->isSnapshotStale) {
+    int *snapshot =
+      realloc(header->snapshot, (header->nElements + 1) * sizeof(int));
+    if (!snapshot) return NULL;
+    int *p = snapshot;
+    for (int i = 0; i < header->nContainers; i++) {
+      p = writeElements(p, &header->containers[i]);
+    }
+    *p = SENTINEL;
+    header->snapshot = snapshot;
+    header->isSnapshotStale = false;
+  }
+  return header->snapshot;
+}
+
+/** Return current element for intSetIterator. */
+int
+intSetIteratorElement(const void *intSetIterator)
+{
+  return *(const int *)intSetIterator;
+}
+
+/** Step intSetIterator and return stepped iterator.  Return
+ *  NULL if no more iterations are possible.
+ */
+const void *
+stepIntSetIterator(const void *intSetIterator)
+{
+  //the snapshot is strictly increasing, so SENTINEL is not greater
+  const int *p = (const int *)intSetIterator;
+  return p[1] > p[0] ? p + 1 : NULL;
+}
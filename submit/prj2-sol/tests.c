@@ -196,6 +196,51 @@ START_TEST(manyElementsIter)
 }
 END_TEST
 
+START_TEST(iteratorValues)
+{
+  void *set = newIntSet();
+  enum { N = 100000 };
+  static int elements[N];
+  for (int i = 0; i < N; i++) elements[i] = 3*(N - 1 - i);
+  ck_assert_int_eq(addMultipleIntSet(set, elements, N), N);
+  //stepping an iterator leaves copies of it unchanged
+  const void *first = newIntSetIterator(set);
+  const void *second = stepIntSetIterator(first);
+  ck_assert_int_eq(intSetIteratorElement(first), 0);
+  ck_assert_int_eq(intSetIteratorElement(second), 3);
+  const void *saved = second;
+  for (int i = 0; i < 10; i++) second = stepIntSetIterator(second);
+  ck_assert_int_eq(intSetIteratorElement(saved), 3);
+  ck_assert_int_eq(intSetIteratorElement(second), 33);
+  //searches which stop early, each starting afresh
+  for (int k = 0; k < N; k++) {
+    int i = 0;
+    for (const void *iter = newIntSetIterator(set); iter != NULL;
+         iter = stepIntSetIterator(iter)) {
+      ck_assert_int_eq(intSetIteratorElement(iter), 3*i);
+      if (++i == 4) break;
+    }
+    ck_assert_int_eq(i, 4);
+  }
+  //an iteration nested in another over the same set
+  int nOuter = 0;
+  for (const void *outer = newIntSetIterator(set); outer != NULL;
+       outer = stepIntSetIterator(outer)) {
+    int v = intSetIteratorElement(outer);
+    ck_assert_int_eq(v, 3*nOuter++);
+    if (v % 30000 != 0) continue;
+    int nInner = 0;
+    for (const void *inner = newIntSetIterator(set); inner != NULL;
+         inner = stepIntSetIterator(inner)) {
+      ck_assert_int_eq(intSetIteratorElement(inner), 3*nInner++);
+    }
+    ck_assert_int_eq(nInner, N);
+  }
+  ck_assert_int_eq(nOuter, N);
+  freeIntSet(set);
+}
+END_TEST
+
 
 static Suite *
 iteratorSuite(void)
@@ -204,6 +249,7 @@ iteratorSuite(void)
   TCase *tests = tcase_create("iterator");
   tcase_add_test(tests, iterator);
   tcase_add_test(tests, manyElementsIter);
+  tcase_add_test(tests, iteratorValues);
   suite_add_tcase(suite, tests);
   return suite;
 }
@@ -594,6 +640,106 @@ intersectionIntSetSuite(void)
   return suite;
 }
 
+/************************** Large Set Tests ****************************/
+
+//large sets over several 2**16 chunks, of the elements in [LARGE_LO,
+//LARGE_HI) satisfying a predicate
+enum { LARGE_LO = -200000, LARGE_HI = 200000 };
+
+typedef int Predicate(int x);
+
+static int isDense(int x) { return -70000 <= x && x < 130000; }
+static int isThird(int x) { return x % 3 == 0; }
+static int isSparse(int x) { return (x % 1000 + 1000) % 1000 == 7; }
+
+static void *
+newPredicateIntSet(Predicate *pred)
+{
+  static int elements[LARGE_HI - LARGE_LO];
+  int n = 0;
+  for (int x = LARGE_HI - 1; x >= LARGE_LO; x--) { //cheap for a list
+    if (pred(x)) elements[n++] = x;
+  }
+  void *set = newIntSet();
+  addMultipleIntSet(set, elements, n);
+  return set;
+}
+
+/** Check that set contains exactly the elements in [LARGE_LO,
+ *  LARGE_HI) satisfying pred1 and (if isUnion, or) pred2.
+ */
+static void
+largeTest(void *set, Predicate *pred1, Predicate *pred2, int isUnion)
+{
+  int nExpected = 0;
+  for (int x = LARGE_LO; x < LARGE_HI; x++) {
+    int isIn = isUnion ? pred1(x) || pred2(x) : pred1(x) && pred2(x);
+    nExpected += isIn;
+    if (x % 4001 == 0) ck_assert_int_eq(!!isInIntSet(set, x), isIn);
+  }
+  ck_assert_int_eq(nElementsIntSet(set), nExpected);
+  int n = 0;
+  int last = LARGE_LO - 1;
+  for (const void *iter = newIntSetIterator(set); iter != NULL;
+       iter = stepIntSetIterator(iter)) {
+    int v = intSetIteratorElement(iter);
+    ck_assert_int_gt(v, last);
+    ck_assert_int_lt(v, LARGE_HI);
+    int isIn = isUnion ? pred1(v) || pred2(v) : pred1(v) && pred2(v);
+    ck_assert_int_eq(isIn, 1);
+    last = v;
+    n++;
+  }
+  ck_assert_int_eq(n, nExpected);
+}
+
+static void
+largeOpTest(Predicate *pred1, Predicate *pred2, int isUnion)
+{
+  void *set1 = newPredicateIntSet(pred1);
+  largeTest(set1, pred1, pred1, isUnion);
+  void *set2 = newPredicateIntSet(pred2);
+  int n = isUnion ? unionIntSet(set1, set2) : intersectionIntSet(set1, set2);
+  ck_assert_int_eq(n, nElementsIntSet(set1));
+  largeTest(set1, pred1, pred2, isUnion);
+  largeTest(set2, pred2, pred2, isUnion);
+  freeIntSet(set1);
+  freeIntSet(set2);
+}
+
+START_TEST(denseThirdsLarge)
+{
+  largeOpTest(isDense, isThird, 1);
+  largeOpTest(isDense, isThird, 0);
+}
+END_TEST
+
+START_TEST(thirdsSparseLarge)
+{
+  largeOpTest(isThird, isSparse, 1);
+  largeOpTest(isThird, isSparse, 0);
+}
+END_TEST
+
+START_TEST(sparseDenseLarge)
+{
+  largeOpTest(isSparse, isDense, 1);
+  largeOpTest(isSparse, isDense, 0);
+}
+END_TEST
+
+static Suite *
+largeIntSetSuite(void)
+{
+  Suite *suite = suite_create("largeIntSet");
+  TCase *largeTests = tcase_create("large");
+  tcase_add_test(largeTests, denseThirdsLarge);
+  tcase_add_test(largeTests, thirdsSparseLarge);
+  tcase_add_test(largeTests, sparseDenseLarge);
+  suite_add_tcase(suite, largeTests);
+  return suite;
+}
+
 /*************************** Main Test Function ************************/
 
 
@@ -609,6 +755,7 @@ static SuiteMaker *makers[] = {
   snprintIntSetSuite,
   unionIntSetSuite,
   intersectionIntSetSuite,
+  largeIntSetSuite,
 };
 
 
@@ -0,0 +1,202 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache-sim.h"
+#include "cache-spec.h"
+#include "next-use.h"
+#include "synth-trace.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Throughput benchmark for the simulator core.  Addresses are
+ *  generated into memory up front so that only cache_sim_stats()
+ *  (or cache_sim_op_stats() for traces which write) is timed, not
+ *  trace parsing or generation.
+ */
+
+enum {
+  DEFAULT_N_ADDRS = 10000000,
+  DEFAULT_FOOTPRINT = 16 << 20,
+  MAX_PATTERNS = 32,
+};
+
+static void
+usage(const char *program)
+{
+  fprintf(stderr, "usage: %s [-n N_ADDRS] [-r " REPLACEMENT_NAMES "] "
+          "[-f FOOTPRINT]\n"
+          "          [-p PATTERN[:ARG]]... [--csv] s-E-b-m...\n"
+          "runs N_ADDRS addresses through each cache spec and reports\n"
+          "addresses/sec and hit rate.  Without -p the addresses are\n"
+          "uniformly random over 4x each cache's size; each -p adds a\n"
+          "synthetic trace (" SYNTH_PATTERN_NAMES ", see trace-gen)\n"
+          "over FOOTPRINT bytes (default 16M) run through every spec.\n"
+          "--csv outputs CSV with a header line instead of text.\n",
+          program);
+  exit(1);
+}
+
+/** xorshift64: fixed sequence so runs are comparable across builds */
+static unsigned long
+next_rand(unsigned long *state)
+{
+  unsigned long x = *state;
+  x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+  return *state = x;
+}
+
+static double
+now_secs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static CacheParams
+get_bench_params(const char *spec, Replacement replacement)
+{
+  CacheParams params = { .replacement = replacement };
+  if (sscanf(spec, "%u-%u-%u-%u", &params.nSetBits, &params.nLinesPerSet,
+             &params.nLineBits, &params.nMemAddrBits) != 4) {
+    fprintf(stderr, "bad cache spec \"%s\"\n", spec);
+    exit(1);
+  }
+  return params;
+}
+
+/** Set addrs[nAddrs] to random lines spread over 4x the size of the
+ *  cache given by params.
+ */
+static void
+cache_relative_trace(const CacheParams *params, MemAddr addrs[],
+                     unsigned long nAddrs)
+{
+  unsigned long nLines =
+    params->nLinesPerSet * (1UL << (params->nSetBits + 2));
+  MemAddr addrMask = (params->nMemAddrBits >= 64)
+    ? ~0UL : (1UL << params->nMemAddrBits) - 1;
+  unsigned long state = 0x9E3779B97F4A7C15UL;
+  for (unsigned long i = 0; i < nAddrs; i++) {
+    addrs[i] = ((next_rand(&state) % nLines) << params->nLineBits) & addrMask;
+  }
+}
+
+/** Run addrs[nAddrs] through the cache given by params, with ops if
+ *  non-NULL, and output the throughput and hit rate.
+ */
+static void
+bench_trace(const char *pattern, const char *spec, const CacheParams *params,
+            const MemAddr addrs[], const AccessOp ops[],
+            unsigned long nAddrs, bool isCsv, FILE *out)
+{
+  //OPT's lookahead is computed outside the timed loop
+  unsigned long *nextUses = (params->replacement == OPT_R)
+    ? next_uses(addrs, nAddrs, params) : NULL;
+  CacheSim *cache = new_cache_sim(params);
+  unsigned long stats[CACHE_N_STATUS] = { 0 };
+  CacheTraffic traffic = { 0 };
+  double t0 = now_secs();
+  if (nextUses) {
+    //with write-allocate, a write hits or misses exactly as a read
+    for (unsigned long i = 0; i < nAddrs; i++) {
+      cache_sim_next_use(cache, nextUses[i]);
+      stats[cache_sim_result(cache, addrs[i]).status]++;
+    }
+  }
+  else if (ops) {
+    cache_sim_op_stats(cache, addrs, ops, nAddrs, stats, &traffic);
+  }
+  else {
+    cache_sim_stats(cache, addrs, nAddrs, stats);
+  }
+  double secs = now_secs() - t0;
+  free_cache_sim(cache);
+  free(nextUses);
+  double hitRate = stats[CACHE_HIT]*100.0/nAddrs;
+  if (isCsv) {
+    fprintf(out, "%s,%s,%s,%lu,%.6f,%.3f,%.4f\n", pattern, spec,
+            replacement_name(params->replacement), nAddrs, secs,
+            nAddrs/secs/1e6, hitRate);
+  }
+  else {
+    fprintf(out, "%-14s %-14s %lu addrs %.3fs %.2f Maddrs/sec "
+            "hit-rate %.2f%%\n",
+            pattern, spec, nAddrs, secs, nAddrs/secs/1e6, hitRate);
+  }
+}
+
+int
+main(int argc, const char *argv[])
+{
+  unsigned long nAddrs = DEFAULT_N_ADDRS;
+  unsigned long footprint = DEFAULT_FOOTPRINT;
+  Replacement replacement = LRU_R;
+  const char *patterns[MAX_PATTERNS];
+  unsigned nPatterns = 0;
+  bool isCsv = false;
+  int i;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i < argc - 1) {
+      nAddrs = strtoul(argv[++i], NULL, 10);
+    }
+    else if (strcmp(argv[i], "-r") == 0 && i < argc - 1) {
+      int r = get_replacement(argv[++i]);
+      if (r < 0) usage(argv[0]);
+      replacement = r;
+    }
+    else if (strcmp(argv[i], "-f") == 0 && i < argc - 1) {
+      if (!get_synth_bytes(argv[++i], &footprint)) usage(argv[0]);
+    }
+    else if (strcmp(argv[i], "-p") == 0 && i < argc - 1) {
+      SynthParams params;
+      if (nPatterns == MAX_PATTERNS || !get_synth_params(argv[++i], &params)) {
+        usage(argv[0]);
+      }
+      patterns[nPatterns++] = argv[i];
+    }
+    else if (strcmp(argv[i], "--csv") == 0) {
+      isCsv = true;
+    }
+    else {
+      usage(argv[0]);
+    }
+  }
+  if (i == argc || nAddrs == 0) usage(argv[0]);
+  MemAddr *addrs = malloc(nAddrs * sizeof(MemAddr));
+  AccessOp *ops = malloc(nAddrs * sizeof(AccessOp));
+  if (!addrs || !ops) {
+    fprintf(stderr, "cannot allocate %lu addresses\n", nAddrs);
+    exit(1);
+  }
+  if (isCsv) {
+    printf("pattern,spec,replacement,addrs,secs,maddrs_per_sec,hit_rate\n");
+  }
+  if (nPatterns == 0) {
+    for (int j = i; j < argc; j++) {
+      CacheParams params = get_bench_params(argv[j], replacement);
+      cache_relative_trace(&params, addrs, nAddrs);
+      bench_trace("uniform-4x", argv[j], &params, addrs, NULL, nAddrs,
+                  isCsv, stdout);
+    }
+  }
+  //generate each pattern once for all the specs
+  for (unsigned p = 0; p < nPatterns; p++) {
+    SynthParams synth = { .footprint = footprint, .seed = 0 };
+    get_synth_params(patterns[p], &synth);
+    synth_trace(&synth, addrs, ops, nAddrs);
+    bool isWrite = synth.pattern == MATMUL_SYNTH ||
+      synth.pattern == TRANSPOSE_MATMUL_SYNTH;
+    for (int j = i; j < argc; j++) {
+      CacheParams params = get_bench_params(argv[j], replacement);
+      bench_trace(patterns[p], argv[j], &params, addrs, isWrite ? ops : NULL,
+                  nAddrs, isCsv, stdout);
+    }
+  }
+  free(ops);
+  free(addrs);
+  return 0;
+}
@@ -0,0 +1,407 @@
+#include "cache-coher.h"
+
+#include "memalloc.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+enum {
+  INIT_LOG2_LINES = 12,   /** initial directory capacity is 2**this */
+  MASK_BITS = 64,         /** a line is divided into this many chunks
+                           *  (bytes for lines of up to 64 bytes) for
+                           *  telling true from false sharing */
+};
+
+/** Directory entry for a line which has been accessed.  The state of
+ *  the line in core c is I if c is not in sharers, else M if isDirty,
+ *  E if isExclusive and S otherwise.
+ */
+typedef struct {
+  MemAddr key;            /** line # + 1, 0 if slot is unused */
+  uint64_t sharers;       /** bit c set if core c holds line */
+  uint64_t invalidated;   /** bit c set if core c's copy was invalidated
+                           *  by another core's write and c has not
+                           *  missed on line since */
+  bool isExclusive;       /** sole sharer holds line E or M */
+  bool isDirty;           /** sole sharer holds line M */
+  uint64_t *changed;      /** changed[c]: chunks written by other cores
+                           *  since core c's copy was invalidated; NULL
+                           *  until line is first invalidated */
+  CoherLineStats stats;
+} LineEntry;
+
+struct CacheCoherImpl {
+  CacheParams coreParams;
+  unsigned seed;
+  unsigned nCores;        /** 1 + greatest core # seen */
+  unsigned nLineBits;
+  unsigned chunkBits;     /** log2 of # of bytes per chunk of a line */
+  MemAddr addrMask;       /** mask for the low nMemAddrBits of addresses */
+  CacheSim *llc;
+  CoherStats stats;
+  CacheSim *cores[MAX_CORES];   /** NULL until core's first access */
+  CoherCoreStats coreStats[MAX_CORES];
+  unsigned log2Lines;     /** directory is an open-addressed hash table */
+  size_t nLines;          /** # of used entries in lines[] */
+  LineEntry *lines;
+};
+
+/** Create and return a system whose cores each have a private cache
+ *  with parameters *coreParams, sharing an LLC with parameters
+ *  *llcParams.  Both must have the same nLineBits and nMemAddrBits,
+ *  and neither may use OPT_R or a prefetcher; dirtiness of private
+ *  lines is tracked by the protocol, so coreParams's write policies
+ *  are ignored.  Core c's replacement generator is seeded with
+ *  seed + c and the LLC's with seed + MAX_CORES.
+ */
+CacheCoher *
+new_cache_coher(const CacheParams *coreParams, const CacheParams *llcParams,
+                unsigned seed)
+{
+  assert(coreParams->nLineBits == llcParams->nLineBits);
+  assert(coreParams->nMemAddrBits == llcParams->nMemAddrBits);
+  assert(coreParams->replacement != OPT_R);
+  assert(llcParams->replacement != OPT_R);
+  assert(coreParams->prefetch == NO_PREFETCH);
+  assert(llcParams->prefetch == NO_PREFETCH);
+  CacheCoher *coher = callocChk(1, sizeof(CacheCoher));
+  coher->coreParams = *coreParams;
+  coher->seed = seed;
+  coher->nLineBits = coreParams->nLineBits;
+  coher->chunkBits = (coher->nLineBits > 6) ? coher->nLineBits - 6 : 0;
+  unsigned m = coreParams->nMemAddrBits;
+  coher->addrMask = (m >= 64) ? ~0UL : (1UL << m) - 1;
+  coher->llc = new_cache_sim(llcParams);
+  cache_sim_seed(coher->llc, seed + MAX_CORES);
+  coher->log2Lines = INIT_LOG2_LINES;
+  coher->lines = callocChk((size_t)1 << coher->log2Lines, sizeof(LineEntry));
+  return coher;
+}
+
+/** Free all resources used by coher, including its CacheSim's */
+void
+free_cache_coher(CacheCoher *coher)
+{
+  for (unsigned c = 0; c < coher->nCores; c++) {
+    if (coher->cores[c]) free_cache_sim(coher->cores[c]);
+  }
+  free_cache_sim(coher->llc);
+  size_t nSlots = (size_t)1 << coher->log2Lines;
+  for (size_t i = 0; i < nSlots; i++) free(coher->lines[i].changed);
+  free(coher->lines);
+  free(coher);
+}
+
+/***************************** Directory *******************************/
+
+static inline MemAddr
+line_key(const CacheCoher *coher, MemAddr addr)
+{
+  return ((addr & coher->addrMask) >> coher->nLineBits) + 1;
+}
+
+static inline MemAddr
+line_addr(const CacheCoher *coher, const LineEntry *entry)
+{
+  return (entry->key - 1) << coher->nLineBits;
+}
+
+/** Return the slot of lines[2**log2Lines] for key: its entry if it is
+ *  there, else the unused slot where it belongs.
+ */
+static LineEntry *
+find_slot(LineEntry lines[], unsigned log2Lines, MemAddr key)
+{
+  size_t mask = ((size_t)1 << log2Lines) - 1;
+  size_t i = (key * 0x9E3779B97F4A7C15UL) >> (64 - log2Lines);
+  while (lines[i].key != 0 && lines[i].key != key) i = (i + 1) & mask;
+  return &lines[i];
+}
+
+/** Double the capacity of the directory of coher */
+static void
+grow_lines(CacheCoher *coher)
+{
+  size_t nSlots = (size_t)1 << coher->log2Lines;
+  unsigned log2Lines = coher->log2Lines + 1;
+  LineEntry *lines = callocChk(nSlots*2, sizeof(LineEntry));
+  for (size_t i = 0; i < nSlots; i++) {
+    const LineEntry *entry = &coher->lines[i];
+    if (entry->key != 0) *find_slot(lines, log2Lines, entry->key) = *entry;
+  }
+  free(coher->lines);
+  coher->lines = lines;
+  coher->log2Lines = log2Lines;
+}
+
+/** Return the entry for the line containing addr, NULL if never
+ *  accessed.
+ */
+static LineEntry *
+find_line(const CacheCoher *coher, MemAddr addr)
+{
+  LineEntry *entry =
+    find_slot(coher->lines, coher->log2Lines, line_key(coher, addr));
+  return (entry->key == 0) ? NULL : entry;
+}
+
+/** Return the entry for the line containing addr, adding it if need
+ *  be.  Adding may move every other entry.
+ */
+static LineEntry *
+get_line(CacheCoher *coher, MemAddr addr)
+{
+  MemAddr key = line_key(coher, addr);
+  LineEntry *entry = find_slot(coher->lines, coher->log2Lines, key);
+  if (entry->key != 0) return entry;
+  if (2*(coher->nLines + 1) > (size_t)1 << coher->log2Lines) {
+    grow_lines(coher);
+    entry = find_slot(coher->lines, coher->log2Lines, key);
+  }
+  coher->nLines++;
+  entry->key = key;
+  entry->stats.addr = line_addr(coher, entry);
+  return entry;
+}
+
+/** Return the chunks of its line covered by size bytes at addr */
+static uint64_t
+chunk_mask(const CacheCoher *coher, MemAddr addr, unsigned size)
+{
+  MemAddr lineBytes = (MemAddr)1 << coher->nLineBits;
+  MemAddr offset = addr & (lineBytes - 1);
+  MemAddr end = offset + ((size == 0) ? 1 : size);
+  if (end > lineBytes) end = lineBytes;
+  unsigned first = offset >> coher->chunkBits;
+  unsigned n = ((end - 1) >> coher->chunkBits) - first + 1;
+  return ((n == MASK_BITS) ? ~0UL : (1UL << n) - 1) << first;
+}
+
+/****************************** Protocol *******************************/
+
+/** Return the private cache of core, creating it on first use */
+static CacheSim *
+get_core_cache(CacheCoher *coher, unsigned core)
+{
+  if (!coher->cores[core]) {
+    coher->cores[core] = new_cache_sim(&coher->coreParams);
+    cache_sim_seed(coher->cores[core], coher->seed + core);
+    if (core >= coher->nCores) coher->nCores = core + 1;
+  }
+  return coher->cores[core];
+}
+
+/** Write the modified line of entry back to the LLC */
+static void
+write_back(CacheCoher *coher, LineEntry *entry)
+{
+  coher->stats.nWriteBacks++;
+  CacheResult result = cache_sim_write(coher->llc, line_addr(coher, entry));
+  if (result.isWriteBack) coher->stats.nMemWriteBacks++;
+  entry->isDirty = false;
+}
+
+/** Core has replaced the line at addr in its private cache */
+static void
+evict_line(CacheCoher *coher, unsigned core, MemAddr addr)
+{
+  LineEntry *entry = find_line(coher, addr);
+  assert(entry && (entry->sharers & (1UL << core)));
+  entry->sharers &= ~(1UL << core);
+  if (entry->isDirty) write_back(coher, entry);
+  // only a sole sharer can be exclusive
+  entry->isExclusive = false;
+}
+
+/** Invalidate the copies of entry's line held by cores other than core */
+static void
+invalidate_others(CacheCoher *coher, LineEntry *entry, unsigned core)
+{
+  uint64_t victims = entry->sharers & ~(1UL << core);
+  if (victims != 0 && !entry->changed) {
+    entry->changed = callocChk(MAX_CORES, sizeof(uint64_t));
+  }
+  MemAddr addr = line_addr(coher, entry);
+  while (victims != 0) {
+    unsigned c = __builtin_ctzl(victims);
+    victims &= victims - 1;
+    bool wasHeld = cache_sim_invalidate(coher->cores[c], addr);
+    assert(wasHeld);
+    (void)wasHeld;
+    entry->invalidated |= 1UL << c;
+    entry->changed[c] = 0;
+    entry->stats.nInvalidations++;
+    coher->stats.nInvalidations++;
+  }
+  entry->sharers &= 1UL << core;
+  // a modified copy moves to core rather than going back to the LLC
+  entry->isDirty = false;
+}
+
+/** Handle a miss by core on entry's line: bring it in from another
+ *  core or the LLC in the state needed for the access.
+ */
+static CoherOutcome
+coher_miss(CacheCoher *coher, LineEntry *entry, unsigned core, MemAddr addr,
+           uint64_t chunks, bool isWrite)
+{
+  uint64_t bit = 1UL << core;
+  CoherCoreStats *coreStats = &coher->coreStats[core];
+  CoherOutcome outcome = COHER_MISS;
+  coreStats->nMisses++;
+  if (entry->invalidated & bit) {
+    entry->invalidated &= ~bit;
+    outcome = COHER_COHERENCE_MISS;
+    coreStats->nCoherenceMisses++;
+    entry->stats.nCoherenceMisses++;
+    if ((entry->changed[core] & chunks) == 0) {
+      coreStats->nFalseSharingMisses++;
+      entry->stats.nFalseSharingMisses++;
+    }
+  }
+  if (entry->sharers != 0) {
+    coher->stats.nTransfers++;
+    if (isWrite) {
+      invalidate_others(coher, entry, core);
+    }
+    else if (entry->isDirty) {
+      write_back(coher, entry);   // M -> S
+    }
+    entry->isExclusive = isWrite;
+  }
+  else {
+    coher->stats.nLlcAccesses++;
+    CacheResult result = cache_sim_result(coher->llc, addr);
+    if (result.status == CACHE_HIT) coher->stats.nLlcHits++;
+    if (result.isWriteBack) coher->stats.nMemWriteBacks++;
+    entry->isExclusive = true;
+  }
+  entry->sharers |= bit;
+  return outcome;
+}
+
+/** Access addr as given by op (from core op->core, which must be less
+ *  than MAX_CORES) and return the outcome in the core's private cache.
+ */
+CoherOutcome
+cache_coher_access(CacheCoher *coher, MemAddr addr, const AccessOp *op)
+{
+  unsigned core = op->core;
+  assert(core < MAX_CORES);
+  bool isWrite = op->kind == WRITE_ACCESS;
+  uint64_t bit = 1UL << core;
+  CoherCoreStats *coreStats = &coher->coreStats[core];
+  CacheResult result = cache_sim_result(get_core_cache(coher, core), addr);
+  if (result.status == CACHE_MISS_WITH_REPLACE) {
+    evict_line(coher, core, result.replaceAddr);
+  }
+  LineEntry *entry = get_line(coher, addr);
+  uint64_t chunks = chunk_mask(coher, addr, op->size);
+  coreStats->nAccesses++;
+  entry->stats.nAccesses++;
+  entry->stats.cores |= bit;
+  CoherOutcome outcome;
+  if (result.status == CACHE_HIT) {
+    assert(entry->sharers & bit);
+    coreStats->nHits++;
+    outcome = COHER_HIT;
+    if (isWrite && !entry->isExclusive) {
+      invalidate_others(coher, entry, core);
+      coreStats->nUpgrades++;
+      outcome = COHER_UPGRADE;
+    }
+  }
+  else {
+    outcome = coher_miss(coher, entry, core, addr, chunks, isWrite);
+  }
+  if (isWrite) {
+    entry->isExclusive = entry->isDirty = true;
+    coreStats->nWrites++;
+    entry->stats.nWrites++;
+    entry->stats.writers |= bit;
+    // remember what the invalidated cores will find changed
+    uint64_t pending = entry->invalidated & ~bit;
+    while (pending != 0) {
+      entry->changed[__builtin_ctzl(pending)] |= chunks;
+      pending &= pending - 1;
+    }
+  }
+  return outcome;
+}
+
+/***************************** Statistics ******************************/
+
+/** Return the MESI state of the line containing addr in core's cache */
+MesiState
+cache_coher_state(const CacheCoher *coher, unsigned core, MemAddr addr)
+{
+  assert(core < MAX_CORES);
+  const LineEntry *entry = find_line(coher, addr);
+  if (!entry || !(entry->sharers & (1UL << core))) return MESI_I;
+  if (entry->isDirty) return MESI_M;
+  return entry->isExclusive ? MESI_E : MESI_S;
+}
+
+/** Return 1 + the greatest core # which has accessed coher, 0 if none */
+unsigned
+cache_coher_n_cores(const CacheCoher *coher)
+{
+  return coher->nCores;
+}
+
+/** Return statistics for core of coher */
+const CoherCoreStats *
+cache_coher_core_stats(const CacheCoher *coher, unsigned core)
+{
+  assert(core < MAX_CORES);
+  return &coher->coreStats[core];
+}
+
+/** Return system-wide statistics for coher */
+const CoherStats *
+cache_coher_stats(const CacheCoher *coher)
+{
+  return &coher->stats;
+}
+
+static unsigned long
+heat(const CoherLineStats *stats)
+{
+  return stats->nCoherenceMisses + stats->nInvalidations;
+}
+
+/** qsort() comparison: hottest first, then by address */
+static int
+cmp_hot_lines(const void *p1, const void *p2)
+{
+  const CoherLineStats *stats1 = p1;
+  const CoherLineStats *stats2 = p2;
+  unsigned long heat1 = heat(stats1), heat2 = heat(stats2);
+  if (heat1 != heat2) return (heat1 > heat2) ? -1 : 1;
+  return (stats1->addr > stats2->addr) - (stats1->addr < stats2->addr);
+}
+
+/** Set *linesP to a new array (to be freed by the caller) of the
+ *  statistics of every line which has had coherence misses or
+ *  invalidations, hottest first, and return its length.
+ */
+size_t
+cache_coher_hot_lines(const CacheCoher *coher, CoherLineStats **linesP)
+{
+  size_t nSlots = (size_t)1 << coher->log2Lines;
+  size_t n = 0;
+  for (size_t i = 0; i < nSlots; i++) {
+    if (coher->lines[i].key != 0 && heat(&coher->lines[i].stats) > 0) n++;
+  }
+  CoherLineStats *lines = mallocChk((n == 0 ? 1 : n) * sizeof(CoherLineStats));
+  size_t k = 0;
+  for (size_t i = 0; i < nSlots; i++) {
+    if (coher->lines[i].key != 0 && heat(&coher->lines[i].stats) > 0) {
+      lines[k++] = coher->lines[i].stats;
+    }
+  }
+  qsort(lines, n, sizeof(CoherLineStats), cmp_hot_lines);
+  *linesP = lines;
+  return n;
+}
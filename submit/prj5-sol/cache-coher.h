@@ -0,0 +1,126 @@
+#ifndef CACHE_COHER_H_
+#define CACHE_COHER_H_
+
+#include "cache-sim.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** A multi-core system with one private CacheSim per core kept
+ *  coherent by the MESI protocol, backed by a shared last-level cache
+ *  (LLC).  A directory tracks which cores hold each line, so snoops
+ *  are free.  A private miss is served by another core holding the
+ *  line if there is one (a cache-to-cache transfer), otherwise by the
+ *  LLC.  The LLC is non-inclusive: its evictions do not affect the
+ *  private caches.
+ *
+ *  Core c's private cache is created on its first access, so the # of
+ *  cores need not be known in advance.
+ */
+
+/** Opaque implementation */
+typedef struct CacheCoherImpl CacheCoher;
+
+/** Max # of cores; core #'s are in [0, MAX_CORES) */
+enum { MAX_CORES = 64 };
+
+/** MESI state of a line in a private cache */
+typedef enum {
+  MESI_I,        /** Invalid: not in the cache */
+  MESI_S,        /** Shared: clean, maybe also in other caches */
+  MESI_E,        /** Exclusive: clean and in no other cache */
+  MESI_M,        /** Modified: dirty and in no other cache */
+  N_MESI_STATES
+} MesiState;
+
+/** Outcome of an access in the private cache of its core */
+typedef enum {
+  COHER_HIT,             /** hit needing no coherence traffic */
+  COHER_UPGRADE,         /** write hit to a shared line: other copies
+                          *  had to be invalidated */
+  COHER_MISS,            /** compulsory, capacity or conflict miss */
+  COHER_COHERENCE_MISS,  /** miss to a line this core held until a
+                          *  write by another core invalidated it */
+  N_COHER_OUTCOMES
+} CoherOutcome;
+
+/** Per-core statistics */
+typedef struct {
+  unsigned long nAccesses;
+  unsigned long nWrites;
+  unsigned long nHits;             /** COHER_HIT or COHER_UPGRADE */
+  unsigned long nUpgrades;
+  unsigned long nMisses;           /** including coherence misses */
+  unsigned long nCoherenceMisses;
+  unsigned long nFalseSharingMisses;/** coherence misses to bytes no other
+                                    *  core had written since the
+                                    *  invalidation */
+} CoherCoreStats;
+
+/** System-wide statistics */
+typedef struct {
+  unsigned long nInvalidations;    /** # of private copies invalidated */
+  unsigned long nTransfers;        /** # of misses served by another core */
+  unsigned long nWriteBacks;       /** # of modified lines written back
+                                    *  from a private cache to the LLC */
+  unsigned long nLlcAccesses;      /** # of misses which went to the LLC */
+  unsigned long nLlcHits;
+  unsigned long nMemWriteBacks;    /** # of dirty lines the LLC evicted */
+} CoherStats;
+
+/** Coherence statistics for one line */
+typedef struct {
+  MemAddr addr;                    /** address of the first byte of line */
+  unsigned long nAccesses;
+  unsigned long nWrites;
+  unsigned long nCoherenceMisses;
+  unsigned long nFalseSharingMisses;
+  unsigned long nInvalidations;    /** # of copies of line invalidated */
+  uint64_t cores;                  /** bit c set if core c accessed line */
+  uint64_t writers;                /** bit c set if core c wrote line */
+} CoherLineStats;
+
+/** Create and return a system whose cores each have a private cache
+ *  with parameters *coreParams, sharing an LLC with parameters
+ *  *llcParams.  Both must have the same nLineBits and nMemAddrBits,
+ *  and neither may use OPT_R or a prefetcher; dirtiness of private
+ *  lines is tracked by the protocol, so coreParams's write policies
+ *  are ignored.  Core c's replacement generator is seeded with
+ *  seed + c and the LLC's with seed + MAX_CORES.
+ */
+CacheCoher *new_cache_coher(const CacheParams *coreParams,
+                            const CacheParams *llcParams, unsigned seed);
+
+/** Free all resources used by coher, including its CacheSim's */
+void free_cache_coher(CacheCoher *coher);
+
+/** Access addr as given by op (from core op->core, which must be less
+ *  than MAX_CORES) and return the outcome in the core's private cache.
+ */
+CoherOutcome cache_coher_access(CacheCoher *coher, MemAddr addr,
+                                const AccessOp *op);
+
+/** Return the MESI state of the line containing addr in core's cache */
+MesiState cache_coher_state(const CacheCoher *coher, unsigned core,
+                            MemAddr addr);
+
+/** Return 1 + the greatest core # which has accessed coher, 0 if none */
+unsigned cache_coher_n_cores(const CacheCoher *coher);
+
+/** Return statistics for core of coher */
+const CoherCoreStats *cache_coher_core_stats(const CacheCoher *coher,
+                                             unsigned core);
+
+/** Return system-wide statistics for coher */
+const CoherStats *cache_coher_stats(const CacheCoher *coher);
+
+/** Set *linesP to a new array (to be freed by the caller) of the
+ *  statistics of every line which has had coherence misses or
+ *  invalidations, hottest (most coherence misses plus invalidations)
+ *  first, and return its length.  Lines written by several cores
+ *  with mostly false-sharing misses are candidates for padding.
+ */
+size_t cache_coher_hot_lines(const CacheCoher *coher,
+                             CoherLineStats **linesP);
+
+#endif //ifndef CACHE_COHER_H_
@@ -0,0 +1,156 @@
+#include "cache-hier.h"
+
+#include "memalloc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+typedef struct {
+  CacheSim *cache;
+  CacheLevelStats stats;
+} Level;
+
+struct CacheHierImpl {
+  Inclusion inclusion;
+  unsigned nLevels;
+  Level levels[];
+};
+
+/** Create and return a hierarchy of nLevels caches where level i has
+ *  parameters params[i].  All levels must have the same nLineBits and
+ *  nMemAddrBits.  Level i's replacement generator is seeded with
+ *  seed + i.
+ */
+CacheHier *
+new_cache_hier(const CacheParams params[], unsigned nLevels,
+               Inclusion inclusion, unsigned seed)
+{
+  assert(nLevels > 0);
+  CacheHier *hier = callocChk(1, sizeof(CacheHier) + nLevels*sizeof(Level));
+  hier->inclusion = inclusion;
+  hier->nLevels = nLevels;
+  for (unsigned i = 0; i < nLevels; i++) {
+    assert(params[i].nLineBits == params[0].nLineBits);
+    assert(params[i].nMemAddrBits == params[0].nMemAddrBits);
+    hier->levels[i].cache = new_cache_sim(&params[i]);
+    cache_sim_seed(hier->levels[i].cache, seed + i);
+  }
+  return hier;
+}
+
+/** Free all resources used by hier, including its CacheSim's */
+void
+free_cache_hier(CacheHier *hier)
+{
+  for (unsigned i = 0; i < hier->nLevels; i++) {
+    free_cache_sim(hier->levels[i].cache);
+  }
+  free(hier);
+}
+
+/** Invalidate line in all levels above level */
+static void
+back_invalidate(CacheHier *hier, unsigned level, MemAddr line)
+{
+  for (unsigned i = 0; i < level; i++) {
+    Level *above = &hier->levels[i];
+    if (cache_sim_invalidate(above->cache, line)) {
+      above->stats.nInvalidations++;
+    }
+  }
+}
+
+/** Inclusive and non-inclusive lookup: fill every level down to the
+ *  one which hits.
+ */
+static unsigned
+inclusive_access(CacheHier *hier, MemAddr addr)
+{
+  unsigned i;
+  for (i = 0; i < hier->nLevels; i++) {
+    Level *level = &hier->levels[i];
+    CacheResult result = cache_sim_result(level->cache, addr);
+    level->stats.nAccesses++;
+    if (result.status == CACHE_HIT) {
+      level->stats.nHits++;
+      break;
+    }
+    if (result.status == CACHE_MISS_WITH_REPLACE) {
+      level->stats.nEvictions++;
+      if (hier->inclusion == INCLUSIVE_H) {
+        back_invalidate(hier, i, result.replaceAddr);
+      }
+    }
+  }
+  return i;
+}
+
+/** Exclusive lookup: only level 0 allocates on a miss.  A line found
+ *  below level 0 is removed from that level, and victims cascade down
+ *  one level at a time, the last level's victims going to memory.
+ */
+static unsigned
+exclusive_access(CacheHier *hier, MemAddr addr)
+{
+  Level *top = &hier->levels[0];
+  CacheResult result = cache_sim_result(top->cache, addr);
+  top->stats.nAccesses++;
+  if (result.status == CACHE_HIT) {
+    top->stats.nHits++;
+    return 0;
+  }
+  unsigned i;
+  for (i = 1; i < hier->nLevels; i++) {
+    Level *level = &hier->levels[i];
+    level->stats.nAccesses++;
+    if (cache_sim_invalidate(level->cache, addr)) {
+      level->stats.nHits++;
+      break;
+    }
+  }
+  for (unsigned j = 0; j < hier->nLevels; j++) {
+    if (result.status != CACHE_MISS_WITH_REPLACE) break;
+    hier->levels[j].stats.nEvictions++;
+    if (j + 1 == hier->nLevels) break;
+    result = cache_sim_result(hier->levels[j + 1].cache, result.replaceAddr);
+  }
+  return i;
+}
+
+/** Look up addr in hier and return the index of the level at which it
+ *  hit, or the # of levels if it had to be fetched from memory.
+ */
+unsigned
+cache_hier_access(CacheHier *hier, MemAddr addr)
+{
+  return (hier->inclusion == EXCLUSIVE_H)
+    ? exclusive_access(hier, addr)
+    : inclusive_access(hier, addr);
+}
+
+/** Return statistics for level of hier */
+const CacheLevelStats *
+cache_hier_stats(const CacheHier *hier, unsigned level)
+{
+  assert(level < hier->nLevels);
+  return &hier->levels[level].stats;
+}
+
+/** Return the average memory access time over all accesses to hier,
+ *  where a lookup at level i costs latencies[i] cycles and a fetch
+ *  from memory costs latencies[nLevels] cycles.
+ */
+double
+cache_hier_amat(const CacheHier *hier, const unsigned latencies[])
+{
+  const Level *levels = hier->levels;
+  unsigned long nTotal = levels[0].stats.nAccesses;
+  if (nTotal == 0) return 0;
+  double cycles = 0;
+  for (unsigned i = 0; i < hier->nLevels; i++) {
+    cycles += (double)levels[i].stats.nAccesses * latencies[i];
+  }
+  const CacheLevelStats *last = &levels[hier->nLevels - 1].stats;
+  cycles += (double)(last->nAccesses - last->nHits) * latencies[hier->nLevels];
+  return cycles/nTotal;
+}
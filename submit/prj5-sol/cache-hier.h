@@ -0,0 +1,64 @@
+#ifndef CACHE_HIER_H_
+#define CACHE_HIER_H_
+
+#include "cache-sim.h"
+
+/** A multi-level cache hierarchy (e.g. L1d, L2, LLC) built from one
+ *  CacheSim per level.  Level 0 is closest to the processor; a miss at
+ *  one level is looked up in the next and a miss at the last level goes
+ *  to primary memory.
+ */
+
+/** Opaque implementation */
+typedef struct CacheHierImpl CacheHier;
+
+/** Relationship between the contents of successive levels */
+typedef enum {
+  INCLUSIVE_H,      /** lines are filled into every level on a miss and
+                     *  a line evicted from a level is invalidated in
+                     *  all levels above it */
+  EXCLUSIVE_H,      /** a line lives in at most one level: misses fill
+                     *  only level 0, a hit below moves the line up to
+                     *  level 0 and each level's victims are inserted
+                     *  into the next level down */
+  NON_INCLUSIVE_H,  /** lines are filled into every level on a miss,
+                     *  evictions do not affect other levels */
+  N_INCLUSIONS
+} Inclusion;
+
+/** Per-level statistics */
+typedef struct {
+  unsigned long nAccesses;     /** # of lookups which reached this level */
+  unsigned long nHits;         /** # of those lookups which hit */
+  unsigned long nEvictions;    /** # of lines this level replaced */
+  unsigned long nInvalidations;/** # of lines invalidated in this level to
+                                *  maintain inclusion/exclusion */
+} CacheLevelStats;
+
+/** Create and return a hierarchy of nLevels caches where level i has
+ *  parameters params[i].  All levels must have the same nLineBits and
+ *  nMemAddrBits.  Level i's replacement generator is seeded with
+ *  seed + i.
+ */
+CacheHier *new_cache_hier(const CacheParams params[], unsigned nLevels,
+                          Inclusion inclusion, unsigned seed);
+
+/** Free all resources used by hier, including its CacheSim's */
+void free_cache_hier(CacheHier *hier);
+
+/** Look up addr in hier and return the index of the level at which it
+ *  hit, or the # of levels if it had to be fetched from memory.
+ */
+unsigned cache_hier_access(CacheHier *hier, MemAddr addr);
+
+/** Return statistics for level of hier */
+const CacheLevelStats *cache_hier_stats(const CacheHier *hier,
+                                        unsigned level);
+
+/** Return the average memory access time over all accesses to hier,
+ *  where a lookup at level i costs latencies[i] cycles and a fetch
+ *  from memory costs latencies[nLevels] cycles.
+ */
+double cache_hier_amat(const CacheHier *hier, const unsigned latencies[]);
+
+#endif //ifndef CACHE_HIER_H_
@@ -1,10 +1,165 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "cache-sim.h"
+#include "prefetch.h"
+#include "repl-policy.h"
+#include "tag-probe.h"
 
+#include "errors.h"
 #include "memalloc.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** All line state lives in a single block trailing the header.  Each
+ *  set is a structure-of-arrays of setWords unsigned words:
+ *
+ *    [ nValid | pad | tag[0..E) | replacement-policy state | dirty bits |
+ *      prefetched bits ]
+ *
+ *  so a lookup touches one contiguous region per set and the whole
+ *  cache is a single allocation.  Tags are full 64-bit MemAddr's (two
+ *  words each) so no address width truncates them.  The dirty bits
+ *  and the prefetched bits (only there with a prefetcher) are 64-bit
+ *  words with bit i for slot i, last since reads only touch them once
+ *  a line has been dirtied or prefetched.  Sets, tags and flag bits
+ *  are kept 8-byte aligned.
+ *
+ *  Lines are filled in slot order and an invalidated line's slot is
+ *  refilled from the last valid slot, so the valid lines are always
+ *  exactly slots [0, nValid).  The policy (see repl-policy.h) is told
+ *  about every hit, fill and invalidation so it can maintain its own
+ *  per-set state.
+ */
+typedef void ResultsLoop(CacheSim *cache, const MemAddr addrs[], size_t n,
+                         CacheResult out[]);
+typedef void StatsLoop(CacheSim *cache, const MemAddr addrs[], size_t n,
+                       unsigned long stats[]);
+typedef size_t SampledLoop(CacheSim *cache, const MemAddr addrs[], size_t n,
+                           unsigned long setStats[]);
+
+struct CacheSimImpl {
+  unsigned nSetBits;
+  unsigned nLinesPerSet;
+  unsigned nLineBits;
+  unsigned nMemAddrBits;
+  Replacement replacement;
+  WritePolicy writePolicy;
+  AllocatePolicy allocatePolicy;
+  Prefetch prefetch;
+  bool hasDirty;           /** some line was ever dirtied: else all clean */
+  unsigned tagShift;       /** s + b */
+  MemAddr addrMask;        /** low m bits */
+  MemAddr setMask;         /** 2**s - 1, applied after shifting out b */
+  MemAddr sampleLimit;     /** set is sampled if its hash is below this */
+  const ReplPolicy *policy;
+  TagProbe *probe;         /** vector tag search, NULL for small sets */
+  RandGen rand;            /** generator for randomized policies */
+  unsigned long nextUse;   /** hint from cache_sim_next_use() */
+  size_t dirtyOffset;      /** offset of dirty bits within a set */
+  size_t prefetchedOffset; /** offset of prefetched bits within a set */
+  size_t stateOffset;      /** offset of policy state within a set */
+  size_t setWords;         /** # of words in lines[] per set */
+  ResultsLoop *resultsLoop;/** cache_sim_results() implementation */
+  StatsLoop *statsLoop;    /** cache_sim_stats() implementation */
+  SampledLoop *sampledLoop;/** cache_sim_sampled_stats() implementation */
+  const Prefetcher *prefetcher; /** NULL if none */
+  void *prefetchState;
+  PrefetchStats prefetchStats;
+  MemAddr *pollution;      /** line + 1 of lines replaced by prefetches,
+                            *  direct-mapped by line; 0 if empty */
+  MemAddr pollutionMask;
+  void *map;               /** mapping holding lines if loaded, else NULL */
+  size_t mapSize;
+  unsigned *lines;         /** sets, setWords words each, 8-byte aligned */
+};
+
+enum {
+  N_VALID_OFFSET,
+  SET_HEADER_WORDS = 2,
+  TAG_WORDS = sizeof(MemAddr) / sizeof(unsigned),
+  FLAG_BITS = 64,          /** # of per-line flag bits in each flag word */
+  FLAG_WORDS = sizeof(uint64_t) / sizeof(unsigned),
+  MAX_POLLUTION_LINES = 1 << 20,
+};
+
+/** Sets with fewer lines are searched by an inline loop since the
+ *  vector probes cannot do better than a couple of compares.
+ */
+enum { MIN_PROBE_LINES = 4 };
+
+static void set_loops(CacheSim *cache);
+
+/** Return a new cache with params.  Its sets are all empty if
+ *  hasLines, otherwise cache->lines is left NULL for the caller to
+ *  supply.
+ */
+static CacheSim *
+alloc_cache_sim(const CacheParams *params, bool hasLines)
+{
+  const ReplPolicy *policy = get_repl_policy(params->replacement);
+  unsigned numLines = params->nLinesPerSet;
+  size_t numSets = (size_t)1 << params->nSetBits;
+  size_t stateOffset = SET_HEADER_WORDS + (size_t)numLines * TAG_WORDS;
+  const Prefetcher *prefetcher = get_prefetcher(params->prefetch);
+  // flag bits go last, keeping the tags and policy state together
+  size_t dirtyOffset = stateOffset + policy->state_words(numLines);
+  dirtyOffset = (dirtyOffset + FLAG_WORDS - 1) / FLAG_WORDS * FLAG_WORDS;
+  size_t flagWords = (numLines + FLAG_BITS - 1) / FLAG_BITS * FLAG_WORDS;
+  size_t prefetchedOffset = dirtyOffset + flagWords;
+  size_t setWords = prefetchedOffset + (prefetcher ? flagWords : 0);
+  CacheSim *cache = callocChk(1, sizeof(CacheSim));
+  // calloc() so every set starts out with nValid == 0 and zero state
+  if (hasLines) cache->lines = callocChk(numSets * setWords, sizeof(unsigned));
+  cache->nSetBits = params->nSetBits;
+  cache->nLinesPerSet = numLines;
+  cache->nLineBits = params->nLineBits;
+  cache->nMemAddrBits = params->nMemAddrBits;
+  cache->replacement = params->replacement;
+  cache->writePolicy = params->writePolicy;
+  cache->allocatePolicy = params->allocatePolicy;
+  cache->prefetch = params->prefetch;
+  cache->hasDirty = false;
+  // derive the address masks once rather than on every access
+  cache->tagShift = params->nSetBits + params->nLineBits;
+  // if using all 64 bits then method for creating mask will overflow
+  cache->addrMask = (params->nMemAddrBits >= 64)
+    ? ~0UL : (1UL << params->nMemAddrBits) - 1;
+  cache->setMask = ((MemAddr)1 << params->nSetBits) - 1;
+  cache->sampleLimit = cache->setMask + 1;
+  cache->policy = policy;
+  cache->probe = (numLines >= MIN_PROBE_LINES) ? best_tag_probe() : NULL;
+  cache->nextUse = ULONG_MAX;
+  rand_gen_seed(&cache->rand, 0, RAND_GEN_STREAM);
+  cache->dirtyOffset = dirtyOffset;
+  cache->prefetchedOffset = prefetchedOffset;
+  cache->stateOffset = stateOffset;
+  cache->setWords = setWords;
+  if (prefetcher) {
+    cache->prefetcher = prefetcher;
+    size_t stateSize = prefetcher->state_size();
+    cache->prefetchState = (stateSize > 0) ? callocChk(1, stateSize) : NULL;
+    size_t nPollution = 1;
+    while (nPollution < numSets * numLines &&
+           nPollution < MAX_POLLUTION_LINES) {
+      nPollution *= 2;
+    }
+    cache->pollution = callocChk(nPollution, sizeof(MemAddr));
+    cache->pollutionMask = nPollution - 1;
+  }
+  set_loops(cache);
+  return cache;
+}
 
 /** Create and return a new cache-simulation structure for a
  *  cache for main memory withe the specified cache parameters params.
@@ -13,158 +168,790 @@
 CacheSim *
 new_cache_sim(const CacheParams *params)
 {
-  unsigned setBits = params->nSetBits;
-  unsigned int numSets = 1<<setBits;
-  unsigned numLines = params->nLinesPerSet;
-  unsigned lineBits = params->nLineBits;
-  unsigned memAddrBits = params->nMemAddrBits;
-  unsigned replacement = params->replacement;
-  // 3D array (ragged?)
-  unsigned int ***cache = mallocChk((numSets+1) * sizeof(unsigned int **));
-  cache[0] = mallocChk(sizeof(unsigned int *));
-  cache[0][0] = mallocChk(5 * sizeof(unsigned int));
-  for (int i = 1; i < (numSets+1); i++) {
-    cache[i] = mallocChk(numLines * sizeof(unsigned int *));
-    for (int j = 0; j < numLines; j++) {
-      // each line has [valid, tag, accessOrder], so size of 3
-      cache[i][j] = mallocChk(3 * sizeof(unsigned int));
-    }
-  }
-  cache[0][0][0] = setBits;
-  cache[0][0][1] = numLines;
-  cache[0][0][2] = lineBits;
-  cache[0][0][3] = memAddrBits;
-  cache[0][0][4] = replacement;
-  return (void *)cache;
+  return alloc_cache_sim(params, true);
 }
 
 /** Free all resources used by cache-simulation structure *cache */
 void
 free_cache_sim(CacheSim *cache)
 {
-  unsigned ***cacheSim = (unsigned int ***)cache;
-  unsigned int numSets = 1<<(cacheSim[0][0][0]);
-  unsigned numLines = cacheSim[0][0][1];
-  for (int i = 1; i < (numSets+1); i++) {
-    for (int j = 0; j < numLines; j++) {
-      free(cacheSim[i][j]);
+  if (cache->map) {
+    munmap(cache->map, cache->mapSize);
+  }
+  else {
+    free(cache->lines);
+  }
+  free(cache->prefetchState);
+  free(cache->pollution);
+  free(cache);
+}
+
+/** Seed the pseudo-random generator used by cache for RANDOM_R and
+ *  BRRIP_R replacement.  A new cache behaves as if seeded with 0.
+ */
+void
+cache_sim_seed(CacheSim *cache, unsigned seed)
+{
+  rand_gen_seed(&cache->rand, seed, RAND_GEN_STREAM);
+}
+
+/** Tell an OPT_R cache the trace position of the next access to the
+ *  line containing the address which will be passed to the following
+ *  cache_sim_result() call (ULONG_MAX if there is none).  Ignored by
+ *  other replacement strategies.  See next_uses() in next-use.h.
+ */
+void
+cache_sim_next_use(CacheSim *cache, unsigned long nextUse)
+{
+  cache->nextUse = nextUse;
+}
+
+/** Multiplying by an odd constant permutes set #s mod 2**s, so the
+ *  sampled sets are exactly those whose permuted # is below
+ *  sampleLimit: scattered across the cache rather than a contiguous
+ *  range, so strided accesses are not all in or all out of the sample.
+ */
+static inline bool
+is_sampled_set(const CacheSim *cache, size_t setNum, MemAddr setMask)
+{
+  return ((setNum * 0x9E3779B97F4A7C15UL) & setMask) < cache->sampleLimit;
+}
+
+/** Restrict cache_sim_sampled_stats() to exactly 1 in 2**sampleBits
+ *  of the sets of cache.  Must have sampleBits <= s.  A new cache
+ *  samples every set.
+ */
+void
+cache_sim_sample_sets(CacheSim *cache, unsigned sampleBits)
+{
+  cache->sampleLimit = (cache->setMask + 1) >> sampleBits;
+}
+
+/** Return true if set # setNum of cache is sampled */
+bool
+cache_sim_is_sampled_set(const CacheSim *cache, size_t setNum)
+{
+  return is_sampled_set(cache, setNum, cache->setMask);
+}
+
+/** Return a pointer to the words of the set addressed by addr,
+ *  setting *tagP and *setNumP to addr's tag and set index.  setBits
+ *  and lineBits are always cache->nSetBits and cache->nLineBits, but
+ *  are passed separately so that callers can make them constants.
+ */
+static inline unsigned *
+get_set(const CacheSim *cache, MemAddr addr, unsigned setBits,
+        unsigned lineBits, MemAddr *tagP, size_t *setNumP)
+{
+  *tagP = (addr & cache->addrMask) >> (setBits + lineBits);
+  *setNumP = (addr >> lineBits) & (((MemAddr)1 << setBits) - 1);
+  return (unsigned *)&cache->lines[*setNumP * cache->setWords];
+}
+
+static inline MemAddr *
+set_tags(unsigned *set)
+{
+  return (MemAddr *)(set + SET_HEADER_WORDS);
+}
+
+static inline uint64_t *
+set_dirty(const CacheSim *cache, unsigned *set)
+{
+  return (uint64_t *)(set + cache->dirtyOffset);
+}
+
+static inline uint64_t *
+set_prefetched(const CacheSim *cache, unsigned *set)
+{
+  return (uint64_t *)(set + cache->prefetchedOffset);
+}
+
+static inline bool
+get_flag(const uint64_t flags[], unsigned line)
+{
+  return (flags[line / FLAG_BITS] >> (line % FLAG_BITS)) & 1;
+}
+
+static inline void
+put_flag(uint64_t flags[], unsigned line, bool isSet)
+{
+  uint64_t bit = (uint64_t)1 << (line % FLAG_BITS);
+  flags[line / FLAG_BITS] =
+    (flags[line / FLAG_BITS] & ~bit) | (isSet ? bit : 0);
+}
+
+/** Return index of the valid line in tags[0, nValid) with tag, or
+ *  nValid if there is none.
+ */
+static inline unsigned
+find_line(const CacheSim *cache, const MemAddr tags[], unsigned nValid,
+          MemAddr tag)
+{
+  if (cache->probe) return cache->probe(tags, nValid, tag);
+  unsigned i;
+  for (i = 0; i < nValid && tags[i] != tag; i++) {}
+  return i;
+}
+
+/** Return the policy's view of set */
+static inline ReplSet
+repl_set(CacheSim *cache, unsigned *set)
+{
+  ReplSet replSet = {
+    .state = set + cache->stateOffset,
+    .nLines = cache->nLinesPerSet,
+    .nValid = set[N_VALID_OFFSET],
+    .rand = &cache->rand,
+    .nextUse = cache->nextUse,
+  };
+  return replSet;
+}
+
+/** Fill tag into the set of setNum (of which set and replSet are the
+ *  words and policy view), into its first invalid slot if there is one
+ *  and otherwise in place of the policy's victim.  The line is dirty
+ *  if isDirty and marked as prefetched if isPrefetch.  Returns and
+ *  sets results as cache_access(), and isTracked is as for it.
+ */
+__attribute__((always_inline))
+static inline CacheStatus
+fill_line(CacheSim *cache, unsigned *set, const ReplSet *replSet,
+          MemAddr tag, size_t setNum, bool isDirty, bool isPrefetch,
+          MemAddr *replaceAddrP, bool *isWriteBackP,
+          unsigned setBits, unsigned lineBits, bool isTracked)
+{
+  const ReplPolicy *policy = cache->policy;
+  bool hasDirty = isTracked && cache->hasDirty;
+  MemAddr *tags = set_tags(set);
+  unsigned nValid = replSet->nValid;
+  unsigned slot;
+  CacheStatus status;
+  if (nValid < cache->nLinesPerSet) {
+    // MISS NO REPLACE: fill first invalid line
+    slot = nValid;
+    tags[slot] = tag;
+    policy->insert(replSet, slot);
+    set[N_VALID_OFFSET]++;
+    status = CACHE_MISS_WITHOUT_REPLACE;
+  }
+  else {
+    // MISS WITH REPLACE
+    slot = policy->victim(replSet);
+    policy->insert(replSet, slot);
+    MemAddr replacedTag = tags[slot];
+    *replaceAddrP = ((replacedTag << setBits) | setNum) << lineBits;
+    tags[slot] = tag;
+    if (hasDirty) *isWriteBackP = get_flag(set_dirty(cache, set), slot);
+    status = CACHE_MISS_WITH_REPLACE;
+  }
+  if (hasDirty) put_flag(set_dirty(cache, set), slot, isDirty);
+  if (isTracked && cache->prefetcher) {
+    put_flag(set_prefetched(cache, set), slot, isPrefetch);
+  }
+  return status;
+}
+
+static void prefetch(CacheSim *cache, MemAddr addr, bool isMiss,
+                     bool isPrefetchHit);
+
+/** Look up addr in cache for a write if isWrite, otherwise for a
+ *  read, updating it as needed.  Return the status and set
+ *  *replaceAddrP to the address of the replaced line if the status is
+ *  CACHE_MISS_WITH_REPLACE, and *isWriteBackP to true if that line was
+ *  dirty (it is left alone otherwise).  Then run the prefetcher, if
+ *  any.  setBits and lineBits are as for get_set().
+ *
+ *  Dirty and prefetched bits are only maintained if isTracked.  Until
+ *  the first dirtying write every dirty bit is clear, so without a
+ *  prefetcher reads need not maintain them: see is_tracked().
+ *
+ *  Always inlined so that each batch loop below keeps everything in
+ *  registers and folds constant isWrite, setBits, lineBits and
+ *  isTracked.
+ */
+__attribute__((always_inline))
+static inline CacheStatus
+cache_access(CacheSim *cache, MemAddr addr, bool isWrite,
+             MemAddr *replaceAddrP, bool *isWriteBackP,
+             unsigned setBits, unsigned lineBits, bool isTracked)
+{
+  // get set pointed by address
+  MemAddr tag;
+  size_t setNum;
+  unsigned *set = get_set(cache, addr, setBits, lineBits, &tag, &setNum);
+  ReplSet replSet = repl_set(cache, set);
+  bool isDirty = isWrite && cache->writePolicy == WRITE_BACK;
+  if (isDirty) cache->hasDirty = true;
+  // valid line whose tag matches tag from address, meaning HIT
+  unsigned line = find_line(cache, set_tags(set), replSet.nValid, tag);
+  if (line < replSet.nValid) {
+    cache->policy->hit(&replSet, line);
+    if (isDirty) put_flag(set_dirty(cache, set), line, true);
+    if (isTracked && cache->prefetcher) {
+      uint64_t *prefetched = set_prefetched(cache, set);
+      bool isPrefetchHit = get_flag(prefetched, line);
+      put_flag(prefetched, line, false);
+      prefetch(cache, addr, false, isPrefetchHit);
+    }
+    return CACHE_HIT;
+  }
+  CacheStatus status = CACHE_MISS_WITHOUT_REPLACE;
+  // a no-allocate write goes straight to memory without touching the
+  // cache
+  if (!isWrite || cache->allocatePolicy == WRITE_ALLOCATE) {
+    status = fill_line(cache, set, &replSet, tag, setNum, isDirty, false,
+                       replaceAddrP, isWriteBackP, setBits, lineBits,
+                       isTracked);
+  }
+  if (isTracked && cache->prefetcher) prefetch(cache, addr, true, false);
+  return status;
+}
+
+static inline size_t
+pollution_index(const CacheSim *cache, MemAddr line)
+{
+  return line & cache->pollutionMask;
+}
+
+/** Fill the line at lineAddr into cache as a prefetch, unless it is
+ *  already there.  Neither the prefetcher nor the results or stats
+ *  of demand accesses see it.
+ */
+static void
+prefetch_line(CacheSim *cache, MemAddr lineAddr)
+{
+  PrefetchStats *stats = &cache->prefetchStats;
+  MemAddr tag;
+  size_t setNum;
+  unsigned *set = get_set(cache, lineAddr, cache->nSetBits, cache->nLineBits,
+                          &tag, &setNum);
+  ReplSet replSet = repl_set(cache, set);
+  if (find_line(cache, set_tags(set), replSet.nValid, tag) < replSet.nValid) {
+    return;
+  }
+  MemAddr line = (lineAddr & cache->addrMask) >> cache->nLineBits;
+  MemAddr *filtered = &cache->pollution[pollution_index(cache, line)];
+  if (*filtered == line + 1) *filtered = 0;
+  MemAddr replaceAddr = 0;
+  bool isWriteBack = false;
+  CacheStatus status =
+    fill_line(cache, set, &replSet, tag, setNum, false, true, &replaceAddr,
+              &isWriteBack, cache->nSetBits, cache->nLineBits, true);
+  stats->nIssued++;
+  stats->nWriteBacks += isWriteBack;
+  if (status == CACHE_MISS_WITH_REPLACE) {
+    MemAddr replaced = replaceAddr >> cache->nLineBits;
+    cache->pollution[pollution_index(cache, replaced)] = replaced + 1;
+  }
+}
+
+/** Account for a demand access to addr which missed if isMiss and was
+ *  the first use of a prefetched line if isPrefetchHit, then fill the
+ *  lines proposed by cache's prefetcher.  Kept out of line so that
+ *  caches without a prefetcher pay only for the test of
+ *  cache->prefetcher.
+ */
+__attribute__((noinline))
+static void
+prefetch(CacheSim *cache, MemAddr addr, bool isMiss, bool isPrefetchHit)
+{
+  PrefetchStats *stats = &cache->prefetchStats;
+  MemAddr line = (addr & cache->addrMask) >> cache->nLineBits;
+  if (isMiss) {
+    stats->nDemandMisses++;
+    // a miss to a line which a prefetch pushed out is pollution
+    MemAddr *filtered = &cache->pollution[pollution_index(cache, line)];
+    if (*filtered == line + 1) {
+      stats->nPolluting++;
+      *filtered = 0;
     }
-    free(cacheSim[i]);
   }
-  free(cacheSim[0][0]);
-  free(cacheSim[0]);
-  free(cacheSim);
+  stats->nUseful += isPrefetchHit;
+  PrefetchAccess access = { line, isMiss, isPrefetchHit };
+  MemAddr lines[MAX_PREFETCH_LINES];
+  unsigned n = cache->prefetcher->access(cache->prefetchState, &access, lines);
+  for (unsigned i = 0; i < n; i++) {
+    prefetch_line(cache, lines[i] << cache->nLineBits);
+  }
+}
+
+/** Set *stats to the effect of cache's prefetcher so far.  Accuracy
+ *  is nUseful/nIssued, coverage nUseful/(nUseful + nDemandMisses) and
+ *  pollution nPolluting/nDemandMisses.
+ */
+void
+cache_sim_prefetch_stats(const CacheSim *cache, PrefetchStats *stats)
+{
+  *stats = cache->prefetchStats;
 }
 
 /** Return result for requesting addr from cache */
 CacheResult
 cache_sim_result(CacheSim *cache, MemAddr addr)
 {
-  unsigned int ***cacheSim = (unsigned int ***)cache;
-  // default to CACHE_HIT
-  CacheResult r = { 0, 0 };
- 
-  unsigned setBits = cacheSim[0][0][0];
-  unsigned numLines = cacheSim[0][0][1];
-  unsigned lineBits = cacheSim[0][0][2];
-  unsigned memAddrBits = cacheSim[0][0][3];
-  unsigned replacement = cacheSim[0][0][4];
-  
-  unsigned long addrMask;
-  // if using all 64 bits then method for creating mask will overflow and won't work
-  if (memAddrBits == 64) addrMask = 0xFFFFFFFFFFFFFFFF;
-  else addrMask = ((1UL<<memAddrBits) - 1);
-
-  unsigned long tagMask = addrMask & ~((1UL<<(setBits+lineBits)) - 1);
-  unsigned int tag = (addr & tagMask)>>(setBits+lineBits);
-
-  unsigned long setMask = ((1<<(setBits+lineBits)) - 1) & ~((1<<lineBits) - 1);
-  unsigned int setNum = (addr & setMask)>>lineBits;
-  
-  // get set pointed by address
-  unsigned int **set = cacheSim[setNum+1];
-  unsigned emptyLine = -1;
-  for (int i = 0; i < numLines; i++) {
-    // valid is set and tag matches tag from address, meaning HIT
-    if ((set[i][0] == 1) && (set[i][1] == tag)) {
-      // update access order of lines
-      if (set[i][2] != numLines*2) {
-	for (int l = 0; l < numLines; l++) {
-	  if (i == l) set[l][2] = numLines*2;
-	  else {
-	    if (--set[l][2] < 0) set[l][2] = 0;
-	  }
-	}
-      }
-      return r;
-    }
-    // save first occurance of an invalid line in case we miss
-    if ((emptyLine == -1) && (set[i][0] == 0)) {
-      emptyLine = i;
-    }
+  CacheResult result = { CACHE_HIT, 0, false };
+  result.status = cache_access(cache, addr, false, &result.replaceAddr,
+                               &result.isWriteBack,
+                               cache->nSetBits, cache->nLineBits, true);
+  return result;
+}
+
+/** Return result for writing to addr in cache.  A write miss with
+ *  NO_WRITE_ALLOCATE is CACHE_MISS_WITHOUT_REPLACE and leaves cache
+ *  unchanged.
+ */
+CacheResult
+cache_sim_write(CacheSim *cache, MemAddr addr)
+{
+  CacheResult result = { CACHE_HIT, 0, false };
+  result.status = cache_access(cache, addr, true, &result.replaceAddr,
+                               &result.isWriteBack,
+                               cache->nSetBits, cache->nLineBits, true);
+  return result;
+}
+
+/** Define results_NAME(), stats_NAME() and sampled_NAME() batch loops
+ *  which access with setBits SET_BITS, lineBits LINE_BITS and
+ *  isTracked IS_TRACKED.
+ */
+#define DEFINE_LOOPS(NAME, SET_BITS, LINE_BITS, IS_TRACKED)             \
+  static void                                                           \
+  results_##NAME(CacheSim *cache, const MemAddr addrs[], size_t n,      \
+                 CacheResult out[])                                     \
+  {                                                                     \
+    for (size_t i = 0; i < n; i++) {                                    \
+      out[i].replaceAddr = 0;                                           \
+      out[i].isWriteBack = false;                                       \
+      out[i].status = cache_access(cache, addrs[i], false,              \
+                                   &out[i].replaceAddr,                 \
+                                   &out[i].isWriteBack,                 \
+                                   SET_BITS, LINE_BITS, IS_TRACKED);    \
+    }                                                                   \
+  }                                                                     \
+                                                                        \
+  static void                                                           \
+  stats_##NAME(CacheSim *cache, const MemAddr addrs[], size_t n,        \
+               unsigned long stats[])                                   \
+  {                                                                     \
+    MemAddr replaceAddr;                                                \
+    bool isWriteBack;                                                   \
+    for (size_t i = 0; i < n; i++) {                                    \
+      stats[cache_access(cache, addrs[i], false, &replaceAddr,          \
+                         &isWriteBack, SET_BITS, LINE_BITS,             \
+                         IS_TRACKED)]++;                                \
+    }                                                                   \
+  }                                                                     \
+                                                                        \
+  static size_t                                                         \
+  sampled_##NAME(CacheSim *cache, const MemAddr addrs[], size_t n,      \
+                 unsigned long setStats[])                              \
+  {                                                                     \
+    MemAddr setMask = ((MemAddr)1 << (SET_BITS)) - 1;                   \
+    MemAddr replaceAddr;                                                \
+    bool isWriteBack;                                                   \
+    size_t nSampled = 0;                                                \
+    for (size_t i = 0; i < n; i++) {                                    \
+      size_t setNum = (addrs[i] >> (LINE_BITS)) & setMask;              \
+      if (!is_sampled_set(cache, setNum, setMask)) continue;            \
+      CacheStatus status = cache_access(cache, addrs[i], false,         \
+                                        &replaceAddr, &isWriteBack,     \
+                                        SET_BITS, LINE_BITS,            \
+                                        IS_TRACKED);                    \
+      setStats[setNum*CACHE_N_STATUS + status]++;                       \
+      nSampled++;                                                       \
+    }                                                                   \
+    return nSampled;                                                    \
   }
-  // MISS NO REPLACE
-  if (emptyLine != -1) {
-    set[emptyLine][0] = 1;
-    set[emptyLine][1] = tag;
-    // update access order
-    if (set[emptyLine][2] != numLines*2) {
-      for (int l = 0; l < numLines; l++) {
-	if (l == emptyLine) set[emptyLine][2] = numLines*2;
-	else {
-	  if (--set[l][2] < 0) set[l][2] = 0;
-	}
-      }
+
+DEFINE_LOOPS(generic, cache->nSetBits, cache->nLineBits, false)
+DEFINE_LOOPS(tracked, cache->nSetBits, cache->nLineBits, true)
+
+/** (s, b) pairs which get batch loops specialized at compile time: 64
+ *  byte lines with fully associative and typical L1 through LLC-slice
+ *  set counts.
+ */
+#define FAST_PATHS(X) \
+  X(0, 6) X(6, 6) X(7, 6) X(8, 6) X(9, 6) X(10, 6) X(11, 6) X(12, 6)
+
+#define DEFINE_FAST_LOOPS(S, B) DEFINE_LOOPS(s##S##_b##B, S, B, false)
+FAST_PATHS(DEFINE_FAST_LOOPS)
+
+static const struct {
+  unsigned nSetBits, nLineBits;
+  ResultsLoop *results;
+  StatsLoop *stats;
+  SampledLoop *sampled;
+} FAST_LOOPS[] = {
+#define FAST_LOOPS_ENTRY(S, B) \
+  { S, B, results_s##S##_b##B, stats_s##S##_b##B, sampled_s##S##_b##B },
+  FAST_PATHS(FAST_LOOPS_ENTRY)
+};
+
+/** Return true if batch accesses to cache must maintain dirty or
+ *  prefetched bits, which only the *_tracked loops do.
+ */
+static inline bool
+is_tracked(const CacheSim *cache)
+{
+  return cache->hasDirty || cache->prefetcher;
+}
+
+/** Select the untracked batch loops for cache's geometry */
+static void
+set_loops(CacheSim *cache)
+{
+  cache->resultsLoop = results_generic;
+  cache->statsLoop = stats_generic;
+  cache->sampledLoop = sampled_generic;
+  for (size_t i = 0; i < sizeof(FAST_LOOPS)/sizeof(FAST_LOOPS[0]); i++) {
+    if (FAST_LOOPS[i].nSetBits == cache->nSetBits &&
+        FAST_LOOPS[i].nLineBits == cache->nLineBits) {
+      cache->resultsLoop = FAST_LOOPS[i].results;
+      cache->statsLoop = FAST_LOOPS[i].stats;
+      cache->sampledLoop = FAST_LOOPS[i].sampled;
     }
-    CacheResult result = { 1, 0 };
-    return result;
   }
-  // MISS WITH REPLACE
+}
+
+/** Request addrs[0, n) from cache in order, setting out[i] to the
+ *  result for addrs[i].  Equivalent to n cache_sim_result() calls.
+ */
+void
+cache_sim_results(CacheSim *cache, const MemAddr addrs[], size_t n,
+                  CacheResult out[])
+{
+  if (is_tracked(cache)) {
+    results_tracked(cache, addrs, n, out);
+  }
   else {
-    unsigned int lineToReplace = 0;
-    // least recently used
-    if (replacement == 0) {
-      unsigned int lru = numLines*2 + 1;
-      unsigned int lruLine = 0;
-      for (int l = 0; l < numLines; l++) {
-	if (set[l][2] < lru) {
-	  lruLine = l;
-	  lru = set[l][2];
-	}
-      }
-      lineToReplace = lruLine;
-    }
-    // most recently used
-    else if (replacement == 1) {
-      unsigned int mru = 0;
-      unsigned int mruLine = 0;
-      for (int l = 0; l < numLines; l++) {
-	if (set[l][2] > mru){
-	  mruLine = l;
-	  mru = set[l][2];
-	}
-      }
-      lineToReplace = mruLine;
-    }
-    // random
-    else if (replacement == 2) {
-      lineToReplace = rand() % numLines;
-    }
-    // update access order
-    if (set[lineToReplace][2] != numLines*2) {
-      for (int l = 0; l < numLines; l++) {
-	if (l == lineToReplace) set[lineToReplace][2] = numLines*2;
-	else {
-	  if (--set[l][2] < 0) set[l][2] = 0;
-	}
-      }
-    }
-    // replace specified line in set
-    unsigned int replacedTag = set[lineToReplace][1];
-    MemAddr replacedAddr = ((replacedTag<<setBits) | setNum)<<lineBits;
-    set[lineToReplace][1] = tag;
-    CacheResult result = { 2, replacedAddr };
-    return result;
-  }
-  return r;
+    cache->resultsLoop(cache, addrs, n, out);
+  }
+}
+
+/** Request addrs[0, n) from cache in order, adding the # of results
+ *  with each CacheStatus to stats[CACHE_N_STATUS].
+ */
+void
+cache_sim_stats(CacheSim *cache, const MemAddr addrs[], size_t n,
+                unsigned long stats[])
+{
+  if (is_tracked(cache)) {
+    stats_tracked(cache, addrs, n, stats);
+  }
+  else {
+    cache->statsLoop(cache, addrs, n, stats);
+  }
+}
+
+/** Add the memory traffic caused by an access with op and the given
+ *  result to *traffic.
+ */
+static inline void
+add_traffic(const CacheSim *cache, AccessOp op, CacheStatus status,
+            bool isWriteBack, CacheTraffic *traffic)
+{
+  bool isWrite = op.kind == WRITE_ACCESS;
+  bool isAllocated = status != CACHE_HIT &&
+    !(isWrite && cache->allocatePolicy == NO_WRITE_ALLOCATE);
+  traffic->nWrites += isWrite;
+  traffic->nFills += isAllocated;
+  traffic->nWriteBacks += isWriteBack;
+  if (isWrite && (cache->writePolicy == WRITE_THROUGH ||
+                  (status != CACHE_HIT && !isAllocated))) {
+    traffic->nWriteThroughs++;
+    traffic->nWriteThroughBytes += op.size;
+  }
+}
+
+/** Access addrs[0, n) in cache in order, reading or writing each as
+ *  given by ops[0, n), setting out[i] to the result for addrs[i] and
+ *  adding the memory traffic to *traffic.  Unlike the read-only entry
+ *  points these are not specialized by geometry: traces with writes
+ *  are text, so decoding them dominates.
+ */
+void
+cache_sim_op_results(CacheSim *cache, const MemAddr addrs[],
+                     const AccessOp ops[], size_t n, CacheResult out[],
+                     CacheTraffic *traffic)
+{
+  for (size_t i = 0; i < n; i++) {
+    out[i].replaceAddr = 0;
+    out[i].isWriteBack = false;
+    out[i].status = cache_access(cache, addrs[i], ops[i].kind == WRITE_ACCESS,
+                                 &out[i].replaceAddr, &out[i].isWriteBack,
+                                 cache->nSetBits, cache->nLineBits, true);
+    add_traffic(cache, ops[i], out[i].status, out[i].isWriteBack, traffic);
+  }
+}
+
+/** As cache_sim_op_results(), but only add the # of results with each
+ *  CacheStatus to stats[CACHE_N_STATUS].
+ */
+void
+cache_sim_op_stats(CacheSim *cache, const MemAddr addrs[],
+                   const AccessOp ops[], size_t n,
+                   unsigned long stats[], CacheTraffic *traffic)
+{
+  for (size_t i = 0; i < n; i++) {
+    MemAddr replaceAddr;
+    bool isWriteBack = false;
+    CacheStatus status =
+      cache_access(cache, addrs[i], ops[i].kind == WRITE_ACCESS,
+                   &replaceAddr, &isWriteBack,
+                   cache->nSetBits, cache->nLineBits, true);
+    stats[status]++;
+    add_traffic(cache, ops[i], status, isWriteBack, traffic);
+  }
+}
+
+/** Request only those addrs[0, n) in sets sampled by cache, in order,
+ *  adding 1 to setStats[setNum*CACHE_N_STATUS + status] for each.
+ *  Return the # of addresses requested.
+ */
+size_t
+cache_sim_sampled_stats(CacheSim *cache, const MemAddr addrs[], size_t n,
+                        unsigned long setStats[])
+{
+  return is_tracked(cache)
+    ? sampled_tracked(cache, addrs, n, setStats)
+    : cache->sampledLoop(cache, addrs, n, setStats);
+}
+
+/** If the line containing addr is in cache, remove it and return
+ *  true; otherwise return false.  Used by multi-level hierarchies to
+ *  keep levels inclusive or exclusive of each other.  A dirty line is
+ *  dropped without being written back.
+ */
+bool
+cache_sim_invalidate(CacheSim *cache, MemAddr addr)
+{
+  MemAddr tag;
+  size_t setNum;
+  unsigned *set =
+    get_set(cache, addr, cache->nSetBits, cache->nLineBits, &tag, &setNum);
+  MemAddr *tags = set_tags(set);
+  unsigned nValid = set[N_VALID_OFFSET];
+  unsigned i = find_line(cache, tags, nValid, tag);
+  if (i == nValid) return false;
+  // keep valid lines contiguous by moving the last one into slot i
+  unsigned last = nValid - 1;
+  ReplSet replSet = repl_set(cache, set);
+  cache->policy->remove(&replSet, i, last);
+  tags[i] = tags[last];
+  if (cache->hasDirty) {
+    uint64_t *dirty = set_dirty(cache, set);
+    put_flag(dirty, i, get_flag(dirty, last));
+  }
+  if (cache->prefetcher) {
+    uint64_t *prefetched = set_prefetched(cache, set);
+    put_flag(prefetched, i, get_flag(prefetched, last));
+  }
+  set[N_VALID_OFFSET] = last;
+  return true;
+}
+
+/****************************** Snapshots ******************************/
+
+/** A snapshot is a SnapshotHeader, the sets of the cache exactly as
+ *  in memory starting at the page-aligned linesOffset, then the
+ *  prefetcher state and pollution filter.  Everything is in native
+ *  byte order; byteOrder and the sizes in the header reject snapshots
+ *  from an incompatible build.  Since the sets are stored as they are
+ *  used, loading maps them copy-on-write instead of reading them.
+ */
+enum {
+  SNAPSHOT_VERSION = 2,
+  SNAPSHOT_ALIGN = 4096,
+  SNAPSHOT_BYTE_ORDER = 0x01020304,
+};
+
+static const char SNAPSHOT_MAGIC[8] = "CSIMSNAP";
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t nSetBits, nLinesPerSet, nLineBits, nMemAddrBits;
+  uint32_t replacement, writePolicy, allocatePolicy, prefetch;
+  uint32_t hasDirty;
+  uint64_t randState, randInc;
+  uint64_t position;            /** caller's trace position */
+  uint64_t setWords;
+  uint64_t linesOffset;
+  uint64_t linesBytes;
+  uint64_t prefetchStateBytes;
+  uint64_t pollutionBytes;
+  uint64_t prefetchStats[5];    /** PrefetchStats in declaration order */
+} SnapshotHeader;
+
+static size_t
+lines_bytes(const CacheSim *cache)
+{
+  return ((size_t)1 << cache->nSetBits) * cache->setWords * sizeof(unsigned);
+}
+
+static size_t
+pollution_bytes(const CacheSim *cache)
+{
+  return cache->pollution ? (cache->pollutionMask + 1) * sizeof(MemAddr) : 0;
+}
+
+static void
+write_snapshot_bytes(FILE *f, const void *bytes, size_t n, const char *path)
+{
+  if (n > 0 && fwrite(bytes, 1, n, f) != n) {
+    fatal("cannot write snapshot %s: %s", path, strerror(errno));
+  }
+}
+
+/** Set *params to the parameters cache was created with */
+void
+cache_sim_params(const CacheSim *cache, CacheParams *params)
+{
+  CacheParams p = {
+    cache->nSetBits, cache->nLinesPerSet, cache->nLineBits,
+    cache->nMemAddrBits, cache->replacement, cache->writePolicy,
+    cache->allocatePolicy, cache->prefetch,
+  };
+  *params = p;
+}
+
+/** Save all state of cache to a new snapshot file at path, together
+ *  with position, which is for the caller to record how much of its
+ *  trace it has simulated.  Exits with a message on I/O errors.
+ */
+void
+cache_sim_save(const CacheSim *cache, unsigned long position,
+               const char *path)
+{
+  const PrefetchStats *p = &cache->prefetchStats;
+  SnapshotHeader header = {
+    .version = SNAPSHOT_VERSION,
+    .byteOrder = SNAPSHOT_BYTE_ORDER,
+    .nSetBits = cache->nSetBits,
+    .nLinesPerSet = cache->nLinesPerSet,
+    .nLineBits = cache->nLineBits,
+    .nMemAddrBits = cache->nMemAddrBits,
+    .replacement = cache->replacement,
+    .writePolicy = cache->writePolicy,
+    .allocatePolicy = cache->allocatePolicy,
+    .prefetch = cache->prefetch,
+    .randState = cache->rand.state,
+    .randInc = cache->rand.inc,
+    .hasDirty = cache->hasDirty,
+    .position = position,
+    .setWords = cache->setWords,
+    .linesOffset = SNAPSHOT_ALIGN,
+    .linesBytes = lines_bytes(cache),
+    .prefetchStateBytes =
+      cache->prefetcher ? cache->prefetcher->state_size() : 0,
+    .pollutionBytes = pollution_bytes(cache),
+    .prefetchStats = {
+      p->nDemandMisses, p->nIssued, p->nUseful, p->nPolluting, p->nWriteBacks,
+    },
+  };
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  _Static_assert(sizeof(SnapshotHeader) <= SNAPSHOT_ALIGN, "header too big");
+  FILE *f = fopen(path, "wb");
+  if (!f) fatal("cannot create snapshot %s: %s", path, strerror(errno));
+  static const unsigned char zeros[SNAPSHOT_ALIGN];
+  write_snapshot_bytes(f, &header, sizeof(header), path);
+  write_snapshot_bytes(f, zeros, SNAPSHOT_ALIGN - sizeof(header), path);
+  write_snapshot_bytes(f, cache->lines, header.linesBytes, path);
+  write_snapshot_bytes(f, cache->prefetchState, header.prefetchStateBytes,
+                       path);
+  write_snapshot_bytes(f, cache->pollution, header.pollutionBytes, path);
+  if (fclose(f) != 0) {
+    fatal("cannot write snapshot %s: %s", path, strerror(errno));
+  }
+}
+
+/** Read exactly n bytes at offset of fd into bytes */
+static void
+read_snapshot_bytes(int fd, void *bytes, size_t n, off_t offset,
+                    const char *path)
+{
+  unsigned char *p = bytes;
+  while (n > 0) {
+    ssize_t nRead = pread(fd, p, n, offset);
+    if (nRead < 0 && errno == EINTR) continue;
+    if (nRead < 0) fatal("cannot read snapshot %s: %s", path, strerror(errno));
+    if (nRead == 0) fatal("snapshot %s is truncated", path);
+    p += nRead;
+    n -= nRead;
+    offset += nRead;
+  }
+}
+
+/** Return a cache restored from the snapshot file at path written by
+ *  cache_sim_save(), setting *positionP to the position saved with
+ *  it.  The sets are mapped copy-on-write rather than read, so this
+ *  takes time independent of the cache size and pages are only
+ *  copied as the simulation dirties them; the file must not change
+ *  while the cache is in use.  Exits with a message if the file cannot
+ *  be read or is not a compatible snapshot.
+ */
+CacheSim *
+cache_sim_load(const char *path, unsigned long *positionP)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) fatal("cannot open snapshot %s: %s", path, strerror(errno));
+  SnapshotHeader header;
+  read_snapshot_bytes(fd, &header, sizeof(header), 0, path);
+  if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != SNAPSHOT_VERSION ||
+      header.byteOrder != SNAPSHOT_BYTE_ORDER) {
+    fatal("%s is not a compatible cache snapshot", path);
+  }
+  CacheParams params = {
+    header.nSetBits, header.nLinesPerSet, header.nLineBits,
+    header.nMemAddrBits, header.replacement, header.writePolicy,
+    header.allocatePolicy, header.prefetch,
+  };
+  if (params.nLineBits < 2 || params.nMemAddrBits > 64 ||
+      params.nSetBits + params.nLineBits >= params.nMemAddrBits ||
+      params.nLinesPerSet == 0 || params.replacement >= N_REPLACEMENTS ||
+      params.writePolicy >= N_WRITE_POLICIES ||
+      params.allocatePolicy >= N_ALLOCATE_POLICIES ||
+      params.prefetch >= N_PREFETCHES) {
+    fatal("snapshot %s has invalid cache params", path);
+  }
+  CacheSim *cache = alloc_cache_sim(&params, false);
+  if (header.setWords != cache->setWords ||
+      header.linesBytes != lines_bytes(cache) ||
+      header.linesOffset % SNAPSHOT_ALIGN != 0 ||
+      header.prefetchStateBytes !=
+        (cache->prefetcher ? cache->prefetcher->state_size() : 0) ||
+      header.pollutionBytes != pollution_bytes(cache)) {
+    fatal("snapshot %s has a different layout from this cache-sim", path);
+  }
+  struct stat st;
+  size_t mapSize = header.linesOffset + header.linesBytes;
+  if (fstat(fd, &st) < 0 ||
+      (size_t)st.st_size < mapSize + header.prefetchStateBytes +
+        header.pollutionBytes) {
+    fatal("snapshot %s is truncated", path);
+  }
+  void *map = mmap(NULL, mapSize, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    fatal("cannot map snapshot %s: %s", path, strerror(errno));
+  }
+  cache->map = map;
+  cache->mapSize = mapSize;
+  cache->lines = (unsigned *)((char *)map + header.linesOffset);
+  read_snapshot_bytes(fd, cache->prefetchState, header.prefetchStateBytes,
+                      mapSize, path);
+  read_snapshot_bytes(fd, cache->pollution, header.pollutionBytes,
+                      mapSize + header.prefetchStateBytes, path);
+  close(fd);   // the mapping stays valid
+  cache->rand.state = header.randState;
+  cache->rand.inc = header.randInc;
+  cache->hasDirty = header.hasDirty;
+  PrefetchStats prefetchStats = {
+    header.prefetchStats[0], header.prefetchStats[1], header.prefetchStats[2],
+    header.prefetchStats[3], header.prefetchStats[4],
+  };
+  cache->prefetchStats = prefetchStats;
+  *positionP = header.position;
+  return cache;
 }
@@ -1,6 +1,9 @@
 #ifndef CACHE_SIM_
 #define CACHE_SIM_
 
+#include <stdbool.h>
+#include <stddef.h>
+
 /** Opaque implementation */
 typedef struct CacheSimImpl CacheSim;
 
@@ -8,14 +11,48 @@ typedef struct CacheSimImpl CacheSim;
 typedef enum {
   LRU_R,         /** Least Recently Used */
   MRU_R,         /** Most Recently Used */
-  RANDOM_R       /** Random replacement */
+  RANDOM_R,      /** Random replacement */
+  FIFO_R,        /** First In First Out */
+  LFU_R,         /** Least Frequently Used */
+  PLRU_R,        /** tree Pseudo-LRU */
+  SRRIP_R,       /** Static Re-Reference Interval Prediction */
+  BRRIP_R,       /** Bimodal Re-Reference Interval Prediction */
+  OPT_R,         /** Belady's offline optimal; requires
+                  *  cache_sim_next_use() before every access */
+  N_REPLACEMENTS /** dummy value: # of replacement strategies */
 } Replacement;
 
+/** What happens when a write hits */
+typedef enum {
+  WRITE_BACK,    /** line is marked dirty and written back when replaced */
+  WRITE_THROUGH, /** write is passed on to memory; lines are never dirty */
+  N_WRITE_POLICIES
+} WritePolicy;
+
+/** What happens when a write misses */
+typedef enum {
+  WRITE_ALLOCATE,    /** line is filled as for a read, then written */
+  NO_WRITE_ALLOCATE, /** write is passed on to memory; cache unchanged */
+  N_ALLOCATE_POLICIES
+} AllocatePolicy;
+
+/** Hardware prefetcher, run on every demand access (see prefetch.h) */
+typedef enum {
+  NO_PREFETCH,
+  NEXT_LINE_PREFETCH, /** next line on a miss or first hit of a
+                       *  prefetched line (tagged prefetch) */
+  STRIDE_PREFETCH,    /** constant stride within a region */
+  STREAM_PREFETCH,    /** ascending or descending runs of misses */
+  N_PREFETCHES
+} Prefetch;
+
 /** A primary memory address */
 typedef unsigned long MemAddr;
 
 /** Parameters which specify a cache.
- *  Must have nMemAddrBits > nLineBits >= 2.
+ *  Must have nMemAddrBits > nLineBits >= 2.  The write policies and
+ *  prefetcher are last so that initializers which omit them get the
+ *  defaults.
  */
 typedef struct {
   unsigned nSetBits;       /** Slides notation: s; # of sets is 2**this */
@@ -24,6 +61,9 @@ typedef struct {
   unsigned nMemAddrBits;   /** Slides notation: m; # of bits in primary mem
                                addr; total primary addr space is 2**this */
   Replacement replacement; /** replacement strategy */
+  WritePolicy writePolicy; /** default WRITE_BACK */
+  AllocatePolicy allocatePolicy; /** default WRITE_ALLOCATE */
+  Prefetch prefetch;       /** default NO_PREFETCH */
 } CacheParams;
 
 
@@ -36,6 +76,14 @@ CacheSim *new_cache_sim(const CacheParams *params);
 /** Free all resources used by cache-simulation structure *cache */
 void free_cache_sim(CacheSim *cache);
 
+/** Seed the pseudo-random generator used by cache for RANDOM_R and
+ *  BRRIP_R replacement.  Each cache owns its generator, so caches do
+ *  not affect each other's choices and may be used from different
+ *  threads, and a given seed gives the same choices on every
+ *  platform.  A new cache behaves as if seeded with 0.
+ */
+void cache_sim_seed(CacheSim *cache, unsigned seed);
+
 typedef enum {
   CACHE_HIT,                  /** address found in cache */
   CACHE_MISS_WITHOUT_REPLACE, /** address not found, no line replaced */
@@ -47,9 +95,146 @@ typedef struct {
   CacheStatus status;  /** status of requested address */
   MemAddr replaceAddr; /** address of replaced line if status is
                         *  CACHE_MISS_WITH_REPLACE */
+  bool isWriteBack;    /** replaced line was dirty, so it was written
+                        *  back to memory */
 } CacheResult;
 
 /** Return result for requesting addr from cache */
 CacheResult cache_sim_result(CacheSim *cache, MemAddr addr);
 
+/** Kind of a memory access */
+typedef enum {
+  READ_ACCESS,
+  WRITE_ACCESS,
+} AccessKind;
+
+/** How an address is accessed */
+typedef struct {
+  unsigned char kind;      /** AccessKind */
+  unsigned char core;      /** core which made the access, 0 if unknown */
+  unsigned short size;     /** # of bytes accessed, 0 if unknown */
+} AccessOp;
+
+/** Return result for writing to addr in cache.  A write miss with
+ *  NO_WRITE_ALLOCATE is CACHE_MISS_WITHOUT_REPLACE and leaves cache
+ *  unchanged.
+ */
+CacheResult cache_sim_write(CacheSim *cache, MemAddr addr);
+
+/** Request addrs[0, n) from cache in order, setting out[i] to the
+ *  result for addrs[i].  Equivalent to n cache_sim_result() calls.
+ */
+void cache_sim_results(CacheSim *cache, const MemAddr addrs[], size_t n,
+                       CacheResult out[]);
+
+/** Request addrs[0, n) from cache in order, adding the # of results
+ *  with each CacheStatus to stats[CACHE_N_STATUS].  Cheaper than
+ *  cache_sim_results() when only totals are needed.
+ */
+void cache_sim_stats(CacheSim *cache, const MemAddr addrs[], size_t n,
+                     unsigned long stats[]);
+
+/** Set sampling for approximate simulation: restrict
+ *  cache_sim_sampled_stats() to exactly 1 in 2**sampleBits of the sets
+ *  of cache, chosen by a hash of the set # so that the sample is
+ *  spread over the whole cache.  Must have sampleBits <= s.  A new
+ *  cache samples every set.  Since sets are independent, each sampled
+ *  set behaves exactly as in a full simulation, except that randomized
+ *  policies draw fewer numbers from the cache's shared generator.
+ */
+void cache_sim_sample_sets(CacheSim *cache, unsigned sampleBits);
+
+/** Return true if set # setNum of cache is sampled */
+bool cache_sim_is_sampled_set(const CacheSim *cache, size_t setNum);
+
+/** Request only those addrs[0, n) in sets sampled by cache, in order,
+ *  adding 1 to setStats[setNum*CACHE_N_STATUS + status] for each;
+ *  setStats[] has CACHE_N_STATUS entries for each of the 2**s sets.
+ *  Addresses in other sets are skipped before any tag is examined.
+ *  Return the # of addresses requested.
+ */
+size_t cache_sim_sampled_stats(CacheSim *cache, const MemAddr addrs[],
+                               size_t n, unsigned long setStats[]);
+
+/** Memory traffic other than the accesses themselves */
+typedef struct {
+  unsigned long nWrites;           /** # of write accesses */
+  unsigned long nFills;            /** # of lines read from memory */
+  unsigned long nWriteBacks;       /** # of dirty lines written back */
+  unsigned long nWriteThroughs;    /** # of writes passed on to memory */
+  unsigned long nWriteThroughBytes;/** total size of those writes */
+} CacheTraffic;
+
+/** Access addrs[0, n) in cache in order, reading or writing each as
+ *  given by ops[0, n), setting out[i] to the result for addrs[i] and
+ *  adding the memory traffic to *traffic.
+ */
+void cache_sim_op_results(CacheSim *cache, const MemAddr addrs[],
+                          const AccessOp ops[], size_t n, CacheResult out[],
+                          CacheTraffic *traffic);
+
+/** As cache_sim_op_results(), but only add the # of results with each
+ *  CacheStatus to stats[CACHE_N_STATUS].
+ */
+void cache_sim_op_stats(CacheSim *cache, const MemAddr addrs[],
+                        const AccessOp ops[], size_t n,
+                        unsigned long stats[], CacheTraffic *traffic);
+
+/** Effect of the prefetcher of a cache.  Prefetches are not accesses:
+ *  they do not appear in results or stats, and a demand access to a
+ *  prefetched line is an ordinary hit.
+ */
+typedef struct {
+  unsigned long nDemandMisses; /** # of misses of demand accesses */
+  unsigned long nIssued;       /** # of lines filled by prefetches */
+  unsigned long nUseful;       /** # of those hit by a demand access
+                                *  before being replaced */
+  unsigned long nPolluting;    /** # of demand misses to lines replaced
+                                *  by a prefetch, approximate */
+  unsigned long nWriteBacks;   /** # of dirty lines replaced by prefetches */
+} PrefetchStats;
+
+/** Set *stats to the effect of cache's prefetcher so far.  Accuracy
+ *  is nUseful/nIssued, coverage nUseful/(nUseful + nDemandMisses) and
+ *  pollution nPolluting/nDemandMisses.
+ */
+void cache_sim_prefetch_stats(const CacheSim *cache, PrefetchStats *stats);
+
+/** Tell an OPT_R cache the trace position of the next access to the
+ *  line containing the address which will be passed to the following
+ *  cache_sim_result() call (ULONG_MAX if there is none).  Ignored by
+ *  other replacement strategies.  See next_uses() in next-use.h.
+ *  Since this is per address, OPT_R callers cannot use the batch
+ *  entry points.
+ */
+void cache_sim_next_use(CacheSim *cache, unsigned long nextUse);
+
+/** If the line containing addr is in cache, remove it and return
+ *  true; otherwise return false.  Used by multi-level hierarchies to
+ *  keep levels inclusive or exclusive of each other.  A dirty line is
+ *  dropped without being written back.
+ */
+bool cache_sim_invalidate(CacheSim *cache, MemAddr addr);
+
+/** Set *params to the parameters cache was created with */
+void cache_sim_params(const CacheSim *cache, CacheParams *params);
+
+/** Save all state of cache (params, lines, policy, generator and
+ *  prefetcher state) to a new snapshot file at path, together with
+ *  position, which is for the caller to record how much of its trace
+ *  it has simulated.  Exits with a message on I/O errors.
+ */
+void cache_sim_save(const CacheSim *cache, unsigned long position,
+                    const char *path);
+
+/** Return a cache restored from the snapshot file at path written by
+ *  cache_sim_save() of the same build, setting *positionP to the
+ *  position saved with it.  Restoring maps the lines copy-on-write so
+ *  it takes constant time; the file must not change while the cache
+ *  is in use.  The cache_sim_next_use() hint and set sampling are per
+ *  run, so they are not saved.  Exits with a message if the file
+ *  cannot be read or is not a compatible snapshot.
+ */
+CacheSim *cache_sim_load(const char *path, unsigned long *positionP);
+
 #endif //ifndef CACHE_SIM_
@@ -0,0 +1,115 @@
+#include "cache-spec.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  const char *name;
+  Replacement replacement;
+} ReplacementName;
+
+static ReplacementName REPLACEMENTS[] = {
+  { "lru", LRU_R },
+  { "mru", MRU_R },
+  { "rand", RANDOM_R },
+  { "fifo", FIFO_R },
+  { "lfu", LFU_R },
+  { "plru", PLRU_R },
+  { "srrip", SRRIP_R },
+  { "brrip", BRRIP_R },
+  { "opt", OPT_R },
+};
+
+/** Translate from name (e.g. lru|mru|rand) to Replacement enum.  Return < 0
+ *  on error.
+ */
+int
+get_replacement(const char *name) {
+  for (int i = 0; i < N_REPLACEMENTS; i++) {
+    if (strcmp(name, REPLACEMENTS[i].name) == 0) {
+      return REPLACEMENTS[i].replacement;
+    }
+  }
+  return -1;
+}
+
+/** Return name of replacement, as accepted by get_replacement() */
+const char *
+replacement_name(Replacement replacement)
+{
+  for (int i = 0; i < N_REPLACEMENTS; i++) {
+    if (REPLACEMENTS[i].replacement == replacement) {
+      return REPLACEMENTS[i].name;
+    }
+  }
+  return "?";
+}
+
+static const char *WRITE_POLICY_NAMES[] = { "back", "through" };
+static const char *ALLOCATE_POLICY_NAMES[] = { "allocate", "no-allocate" };
+//must be in sync with Prefetch enum
+static const char *PREFETCHES[] = { "none", "next", "stride", "stream" };
+
+/** Translate from name back|through to WritePolicy enum.  Return < 0
+ *  on error.
+ */
+int
+get_write_policy(const char *name)
+{
+  for (int i = 0; i < N_WRITE_POLICIES; i++) {
+    if (strcmp(name, WRITE_POLICY_NAMES[i]) == 0) return i;
+  }
+  return -1;
+}
+
+/** Translate from name allocate|no-allocate to AllocatePolicy enum.
+ *  Return < 0 on error.
+ */
+int
+get_allocate_policy(const char *name)
+{
+  for (int i = 0; i < N_ALLOCATE_POLICIES; i++) {
+    if (strcmp(name, ALLOCATE_POLICY_NAMES[i]) == 0) return i;
+  }
+  return -1;
+}
+
+/** Translate from name none|next|stride|stream to Prefetch enum.
+ *  Return < 0 on error.
+ */
+int
+get_prefetch(const char *name)
+{
+  for (int i = 0; i < N_PREFETCHES; i++) {
+    if (strcmp(name, PREFETCHES[i]) == 0) return i;
+  }
+  return -1;
+}
+
+/** Parse paramsSpec s-E-b-m into *params, leaving params->replacement
+ *  untouched and setting the default WRITE_BACK and WRITE_ALLOCATE
+ *  write policies and no prefetcher.  Returns false on error.
+ */
+bool
+get_cache_params(const char *paramsSpec, CacheParams *params)
+{
+  unsigned *fieldsP[] = {
+    &params->nSetBits, &params->nLinesPerSet,
+    &params->nLineBits, &params->nMemAddrBits,
+  };
+  params->writePolicy = WRITE_BACK;
+  params->allocatePolicy = WRITE_ALLOCATE;
+  params->prefetch = NO_PREFETCH;
+  int i = 0;
+  const char *p;
+  for (p = paramsSpec; *p != '\0' && i < 4; i++, p += (i < 4)) {
+    char *q;
+    long v = strtol(p, &q, 10);
+    p = q;
+    if (v < 0 || ((i < 3) ? (*p != '-') : (*p != '\0'))) return false;
+    *fieldsP[i] = v;
+  }
+  return (*p == '\0') && (i == 4) && (params->nLineBits >= 2) &&
+         (params->nLineBits + params->nSetBits < params->nMemAddrBits) &&
+         (params->nMemAddrBits <= 64);
+}
@@ -0,0 +1,47 @@
+#ifndef CACHE_SPEC_H_
+#define CACHE_SPEC_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+
+/** Command-line names for cache parameters shared by the cache-sim
+ *  programs.
+ */
+
+/** Translate from name (e.g. lru|mru|rand) to Replacement enum.
+ *  Return < 0 on error.
+ */
+int get_replacement(const char *name);
+
+/** All replacement names separated by '|', for usage messages */
+#define REPLACEMENT_NAMES "lru|mru|rand|fifo|lfu|plru|srrip|brrip|opt"
+
+/** Return name of replacement, as accepted by get_replacement() */
+const char *replacement_name(Replacement replacement);
+
+/** Translate from name back|through to WritePolicy enum.  Return < 0
+ *  on error.
+ */
+int get_write_policy(const char *name);
+
+/** Translate from name allocate|no-allocate to AllocatePolicy enum.
+ *  Return < 0 on error.
+ */
+int get_allocate_policy(const char *name);
+
+/** Translate from name none|next|stride|stream to Prefetch enum.
+ *  Return < 0 on error.
+ */
+int get_prefetch(const char *name);
+
+/** All prefetcher names separated by '|', for usage messages */
+#define PREFETCH_NAMES "none|next|stride|stream"
+
+/** Parse paramsSpec s-E-b-m into *params, leaving params->replacement
+ *  untouched and setting the default WRITE_BACK and WRITE_ALLOCATE
+ *  write policies and no prefetcher.  Returns false on error.
+ */
+bool get_cache_params(const char *paramsSpec, CacheParams *params);
+
+#endif //ifndef CACHE_SPEC_H_
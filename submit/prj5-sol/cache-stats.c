@@ -0,0 +1,366 @@
+#include "cache-stats.h"
+
+#include "cache-spec.h"
+
+#include "memalloc.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+enum {
+  MIN_TABLE_ENTRIES = 1024,
+  MIN_TIMES = 1024,
+};
+
+/** Map from line address to the time of its most recent access,
+ *  using open addressing with linear probing.
+ */
+typedef struct {
+  MemAddr line;
+  unsigned long time;      /** ULONG_MAX if slot unused */
+} Entry;
+
+/** Reuse distances are computed over access times.  The Fenwick tree
+ *  counts the times which are still the latest access of some line,
+ *  so the distance of an access to a line last accessed at time t is
+ *  the # of counted times after t.  When the times run out they are
+ *  renumbered densely, which keeps everything proportional to the #
+ *  of distinct lines rather than to the length of the trace.
+ */
+struct CacheStatsImpl {
+  CacheParams params;
+  MemAddr addrMask;           /** low m bits */
+  MemAddr setMask;            /** 2**s - 1, applied after shifting out b */
+  unsigned long nCacheLines;  /** # of lines in cache and shadow cache */
+  unsigned long *setCounts;   /** setCounts[setNum*N_STATS + StatKind] */
+  unsigned long reuse[N_REUSE_BUCKETS];
+  unsigned long nCold;        /** # of first accesses to a line */
+  Entry *table;
+  size_t tableMask;           /** # of table entries - 1 */
+  unsigned long nLines;       /** # of distinct lines in table */
+  unsigned long *fenwick;     /** 1-based Fenwick tree over times */
+  MemAddr *timeLines;         /** line accessed at each time */
+  unsigned long nTimes;       /** next time */
+  unsigned long maxTimes;     /** # of times in fenwick and timeLines */
+};
+
+static inline size_t
+hash_line(MemAddr line, size_t mask)
+{
+  return (line * 0x9E3779B97F4A7C15UL) >> 17 & mask;
+}
+
+/** Return entry for line, or the unused entry where it belongs */
+static inline Entry *
+find_entry(const CacheStats *cacheStats, MemAddr line)
+{
+  size_t mask = cacheStats->tableMask;
+  size_t h;
+  for (h = hash_line(line, mask);
+       cacheStats->table[h].time != ULONG_MAX &&
+         cacheStats->table[h].line != line;
+       h = (h + 1) & mask) {
+  }
+  return &cacheStats->table[h];
+}
+
+static void
+grow_table(CacheStats *cacheStats)
+{
+  Entry *old = cacheStats->table;
+  size_t nOld = cacheStats->tableMask + 1;
+  size_t nEntries = 2*nOld;
+  cacheStats->table = mallocChk(nEntries * sizeof(Entry));
+  cacheStats->tableMask = nEntries - 1;
+  for (size_t i = 0; i < nEntries; i++) cacheStats->table[i].time = ULONG_MAX;
+  for (size_t i = 0; i < nOld; i++) {
+    if (old[i].time != ULONG_MAX) *find_entry(cacheStats, old[i].line) = old[i];
+  }
+  free(old);
+}
+
+static inline void
+fenwick_add(CacheStats *cacheStats, unsigned long time, long delta)
+{
+  for (unsigned long i = time + 1; i <= cacheStats->maxTimes; i += i & -i) {
+    cacheStats->fenwick[i] += delta;
+  }
+}
+
+/** Return # of counted times in [0, time] */
+static inline unsigned long
+fenwick_prefix(const CacheStats *cacheStats, unsigned long time)
+{
+  unsigned long sum = 0;
+  for (unsigned long i = time + 1; i > 0; i -= i & -i) {
+    sum += cacheStats->fenwick[i];
+  }
+  return sum;
+}
+
+/** Renumber the latest access times of all lines as [0, nLines) in
+ *  their original order and make room for at least as many more.
+ */
+static void
+compact_times(CacheStats *cacheStats)
+{
+  unsigned long k = 0;
+  for (unsigned long t = 0; t < cacheStats->nTimes; t++) {
+    MemAddr line = cacheStats->timeLines[t];
+    Entry *entry = find_entry(cacheStats, line);
+    if (entry->time == t) {
+      entry->time = k;
+      cacheStats->timeLines[k++] = line;
+    }
+  }
+  cacheStats->nTimes = k;
+  unsigned long maxTimes = (2*k < MIN_TIMES) ? MIN_TIMES : 2*k;
+  cacheStats->maxTimes = maxTimes;
+  cacheStats->timeLines =
+    reallocChk(cacheStats->timeLines, maxTimes * sizeof(MemAddr));
+  free(cacheStats->fenwick);
+  unsigned long *fenwick = callocChk(maxTimes + 1, sizeof(unsigned long));
+  for (unsigned long i = 1; i <= maxTimes; i++) {
+    if (i <= k) fenwick[i]++;
+    unsigned long j = i + (i & -i);
+    if (j <= maxTimes) fenwick[j] += fenwick[i];
+  }
+  cacheStats->fenwick = fenwick;
+}
+
+/** Record an access to line at the next time.  Return its reuse
+ *  distance, or ULONG_MAX if this is the first access to line.
+ */
+static unsigned long
+reuse_distance(CacheStats *cacheStats, MemAddr line)
+{
+  if (cacheStats->nTimes == cacheStats->maxTimes) compact_times(cacheStats);
+  unsigned long now = cacheStats->nTimes++;
+  cacheStats->timeLines[now] = line;
+  Entry *entry = find_entry(cacheStats, line);
+  unsigned long dist;
+  if (entry->time == ULONG_MAX) {
+    dist = ULONG_MAX;
+    entry->line = line;
+    cacheStats->nLines++;
+  }
+  else {
+    dist = cacheStats->nLines - fenwick_prefix(cacheStats, entry->time);
+    fenwick_add(cacheStats, entry->time, -1);
+  }
+  entry->time = now;
+  fenwick_add(cacheStats, now, 1);
+  if (2*cacheStats->nLines > cacheStats->tableMask) grow_table(cacheStats);
+  return dist;
+}
+
+/** Create and return instrumentation for a cache with params */
+CacheStats *
+new_cache_stats(const CacheParams *params)
+{
+  CacheStats *cacheStats = callocChk(1, sizeof(CacheStats));
+  cacheStats->params = *params;
+  cacheStats->addrMask = (params->nMemAddrBits >= 64)
+    ? ~0UL : (1UL << params->nMemAddrBits) - 1;
+  cacheStats->setMask = (1UL << params->nSetBits) - 1;
+  cacheStats->nCacheLines = (unsigned long)params->nLinesPerSet
+    << params->nSetBits;
+  size_t nSets = (size_t)1 << params->nSetBits;
+  cacheStats->setCounts = callocChk(nSets * N_STATS, sizeof(unsigned long));
+  cacheStats->table = mallocChk(MIN_TABLE_ENTRIES * sizeof(Entry));
+  cacheStats->tableMask = MIN_TABLE_ENTRIES - 1;
+  for (size_t i = 0; i < MIN_TABLE_ENTRIES; i++) {
+    cacheStats->table[i].time = ULONG_MAX;
+  }
+  cacheStats->maxTimes = MIN_TIMES;
+  cacheStats->fenwick = callocChk(MIN_TIMES + 1, sizeof(unsigned long));
+  cacheStats->timeLines = mallocChk(MIN_TIMES * sizeof(MemAddr));
+  return cacheStats;
+}
+
+/** Free all resources used by cacheStats */
+void
+free_cache_stats(CacheStats *cacheStats)
+{
+  free(cacheStats->setCounts);
+  free(cacheStats->table);
+  free(cacheStats->fenwick);
+  free(cacheStats->timeLines);
+  free(cacheStats);
+}
+
+/** Account for results[n] of simulating addrs[n] in order */
+void
+cache_stats_add(CacheStats *cacheStats, const MemAddr addrs[],
+                const CacheResult results[], size_t n)
+{
+  unsigned nLineBits = cacheStats->params.nLineBits;
+  for (size_t i = 0; i < n; i++) {
+    MemAddr line = (addrs[i] & cacheStats->addrMask) >> nLineBits;
+    unsigned long *counts =
+      &cacheStats->setCounts[(line & cacheStats->setMask) * N_STATS];
+    unsigned long dist = reuse_distance(cacheStats, line);
+    if (dist == ULONG_MAX) {
+      cacheStats->nCold++;
+    }
+    else {
+      cacheStats->reuse[(dist == 0) ? 0 : 64 - __builtin_clzl(dist)]++;
+    }
+    counts[STAT_ACCESSES]++;
+    switch (results[i].status) {
+    case CACHE_HIT:
+      counts[STAT_HITS]++;
+      continue;
+    case CACHE_MISS_WITH_REPLACE:
+      counts[STAT_EVICTIONS]++;
+      break;
+    default:
+      break;
+    }
+    counts[STAT_MISSES]++;
+    if (dist == ULONG_MAX) {
+      counts[STAT_COMPULSORY]++;
+    }
+    else if (dist >= cacheStats->nCacheLines) {
+      counts[STAT_CAPACITY]++;
+    }
+    else {
+      counts[STAT_CONFLICT]++;
+    }
+  }
+}
+
+/** Set counts[N_STATS] to the counts for set # setNum */
+void
+cache_stats_set_counts(const CacheStats *cacheStats, unsigned long setNum,
+                       unsigned long counts[])
+{
+  for (int k = 0; k < N_STATS; k++) {
+    counts[k] = cacheStats->setCounts[setNum*N_STATS + k];
+  }
+}
+
+/** Set counts[N_STATS] to the counts summed over all sets */
+void
+cache_stats_totals(const CacheStats *cacheStats, unsigned long counts[])
+{
+  for (int k = 0; k < N_STATS; k++) counts[k] = 0;
+  unsigned long nSets = cacheStats->setMask + 1;
+  for (unsigned long s = 0; s < nSets; s++) {
+    for (int k = 0; k < N_STATS; k++) {
+      counts[k] += cacheStats->setCounts[s*N_STATS + k];
+    }
+  }
+}
+
+/** Set hist[N_REUSE_BUCKETS] to the reuse-distance histogram and
+ *  return the # of first accesses, which have no reuse distance.
+ */
+unsigned long
+cache_stats_reuse(const CacheStats *cacheStats, unsigned long hist[])
+{
+  for (int k = 0; k < N_REUSE_BUCKETS; k++) hist[k] = cacheStats->reuse[k];
+  return cacheStats->nCold;
+}
+
+//must be in sync with StatKind enum
+static const char *STAT_NAMES[] = {
+  "accesses", "hits", "misses", "evictions",
+  "compulsory", "capacity", "conflict",
+};
+
+/** Return # of buckets up to and including the last non-empty one */
+static int
+n_reuse_buckets(const CacheStats *cacheStats)
+{
+  int n = N_REUSE_BUCKETS;
+  while (n > 0 && cacheStats->reuse[n - 1] == 0) n--;
+  return n;
+}
+
+static unsigned long
+bucket_min(int k)
+{
+  return (k == 0) ? 0 : 1UL << (k - 1);
+}
+
+static unsigned long
+bucket_max(int k)
+{
+  return (k == 0) ? 0 : (k == 64) ? ULONG_MAX : (1UL << k) - 1;
+}
+
+static void
+out_counts_json(const unsigned long counts[], FILE *out)
+{
+  for (int k = 0; k < N_STATS; k++) {
+    fprintf(out, "%s\"%s\": %lu", (k == 0) ? "" : ", ", STAT_NAMES[k],
+            counts[k]);
+  }
+}
+
+/** Output cache parameters, totals, per-set counts and reuse
+ *  histogram as a JSON object.
+ */
+void
+out_stats_json(const CacheStats *cacheStats, FILE *out)
+{
+  const CacheParams *p = &cacheStats->params;
+  fprintf(out, "{\n  \"params\": { \"s\": %u, \"E\": %u, \"b\": %u, "
+          "\"m\": %u, \"replacement\": \"%s\" },\n",
+          p->nSetBits, p->nLinesPerSet, p->nLineBits, p->nMemAddrBits,
+          replacement_name(p->replacement));
+  unsigned long counts[N_STATS];
+  cache_stats_totals(cacheStats, counts);
+  fprintf(out, "  \"totals\": { ");
+  out_counts_json(counts, out);
+  fprintf(out, " },\n  \"sets\": [\n");
+  unsigned long nSets = cacheStats->setMask + 1;
+  for (unsigned long s = 0; s < nSets; s++) {
+    cache_stats_set_counts(cacheStats, s, counts);
+    fprintf(out, "    { \"set\": %lu, ", s);
+    out_counts_json(counts, out);
+    fprintf(out, " }%s\n", (s + 1 < nSets) ? "," : "");
+  }
+  fprintf(out, "  ],\n  \"reuse\": {\n    \"cold\": %lu,\n"
+          "    \"buckets\": [\n", cacheStats->nCold);
+  int nBuckets = n_reuse_buckets(cacheStats);
+  for (int k = 0; k < nBuckets; k++) {
+    fprintf(out, "      { \"min\": %lu, \"max\": %lu, \"count\": %lu }%s\n",
+            bucket_min(k), bucket_max(k), cacheStats->reuse[k],
+            (k + 1 < nBuckets) ? "," : "");
+  }
+  fprintf(out, "    ]\n  }\n}\n");
+}
+
+/** Output per-set counts as CSV with one row per set */
+void
+out_set_stats_csv(const CacheStats *cacheStats, FILE *out)
+{
+  fprintf(out, "set");
+  for (int k = 0; k < N_STATS; k++) fprintf(out, ",%s", STAT_NAMES[k]);
+  fprintf(out, "\n");
+  unsigned long nSets = cacheStats->setMask + 1;
+  for (unsigned long s = 0; s < nSets; s++) {
+    fprintf(out, "%lu", s);
+    for (int k = 0; k < N_STATS; k++) {
+      fprintf(out, ",%lu", cacheStats->setCounts[s*N_STATS + k]);
+    }
+    fprintf(out, "\n");
+  }
+}
+
+/** Output the reuse-distance histogram as CSV rows of min and max
+ *  distance and count, ending with an "inf" row for first accesses.
+ */
+void
+out_reuse_csv(const CacheStats *cacheStats, FILE *out)
+{
+  fprintf(out, "min_distance,max_distance,count\n");
+  int nBuckets = n_reuse_buckets(cacheStats);
+  for (int k = 0; k < nBuckets; k++) {
+    fprintf(out, "%lu,%lu,%lu\n", bucket_min(k), bucket_max(k),
+            cacheStats->reuse[k]);
+  }
+  fprintf(out, "inf,inf,%lu\n", cacheStats->nCold);
+}
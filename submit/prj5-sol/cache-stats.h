@@ -0,0 +1,79 @@
+#ifndef CACHE_STATS_H_
+#define CACHE_STATS_H_
+
+#include "cache-sim.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+/** Optional instrumentation fed with the per-access results of a
+ *  cache simulation.  Keeps per-set counts, classifies every miss as
+ *  compulsory, capacity or conflict, and histograms reuse distances.
+ *  The simulator itself knows nothing about it, so it costs nothing
+ *  unless a caller collects results and passes them on.
+ *
+ *  The reuse distance of an access is the # of distinct other lines
+ *  accessed since the previous access to its line.  A shadow fully
+ *  associative LRU cache with as many lines as the simulated one hits
+ *  exactly when that distance is less than its # of lines; a miss is
+ *  compulsory on the first access to a line, otherwise capacity if
+ *  the shadow cache misses too and conflict if it hits.
+ */
+
+/** Opaque implementation */
+typedef struct CacheStatsImpl CacheStats;
+
+/** Counts kept for each set and in total */
+typedef enum {
+  STAT_ACCESSES,
+  STAT_HITS,
+  STAT_MISSES,
+  STAT_EVICTIONS,          /** misses which replaced a line */
+  STAT_COMPULSORY,
+  STAT_CAPACITY,
+  STAT_CONFLICT,
+  N_STATS                  /** dummy value: # of counts */
+} StatKind;
+
+/** # of reuse-distance buckets: bucket 0 is distance 0 and bucket
+ *  k > 0 is distances in [2**(k-1), 2**k).
+ */
+enum { N_REUSE_BUCKETS = 65 };
+
+/** Create and return instrumentation for a cache with params */
+CacheStats *new_cache_stats(const CacheParams *params);
+
+/** Free all resources used by cacheStats */
+void free_cache_stats(CacheStats *cacheStats);
+
+/** Account for results[n] of simulating addrs[n] in order */
+void cache_stats_add(CacheStats *cacheStats, const MemAddr addrs[],
+                     const CacheResult results[], size_t n);
+
+/** Set counts[N_STATS] to the counts for set # setNum */
+void cache_stats_set_counts(const CacheStats *cacheStats,
+                            unsigned long setNum, unsigned long counts[]);
+
+/** Set counts[N_STATS] to the counts summed over all sets */
+void cache_stats_totals(const CacheStats *cacheStats, unsigned long counts[]);
+
+/** Set hist[N_REUSE_BUCKETS] to the reuse-distance histogram and
+ *  return the # of first accesses, which have no reuse distance.
+ */
+unsigned long cache_stats_reuse(const CacheStats *cacheStats,
+                                unsigned long hist[]);
+
+/** Output cache parameters, totals, per-set counts and reuse
+ *  histogram as a JSON object.
+ */
+void out_stats_json(const CacheStats *cacheStats, FILE *out);
+
+/** Output per-set counts as CSV with one row per set */
+void out_set_stats_csv(const CacheStats *cacheStats, FILE *out);
+
+/** Output the reuse-distance histogram as CSV rows of min and max
+ *  distance and count, ending with an "inf" row for first accesses.
+ */
+void out_reuse_csv(const CacheStats *cacheStats, FILE *out);
+
+#endif //ifndef CACHE_STATS_H_
@@ -0,0 +1,228 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache-sim.h"
+#include "cache-spec.h"
+#include "next-use.h"
+#include "trace.h"
+
+#include "memalloc.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Parallel parameter sweep: loads a trace once, then simulates every
+ *  combination of the given cache specs and replacement policies on a
+ *  pool of threads, one CacheSim per combination, and outputs a CSV
+ *  table.  Unlike cache-sim --sweep this works for any replacement
+ *  policy.
+ */
+
+static void
+usage(const char *program, const char *msg)
+{
+  fprintf(stderr, "%susage: %s [-f " TRACE_FORMAT_NAMES "] "
+          "[-j N_THREADS] [-r POLICY[,POLICY...]] [-s seed] s-E-b-m...\n"
+          "simulates the trace on stdin once for each s-E-b-m and each\n"
+          "POLICY in " REPLACEMENT_NAMES " (default lru) using N_THREADS\n"
+          "threads (default # of online processors) and outputs a CSV\n"
+          "table.\n"
+          "Every simulation is seeded with seed (default 0), so each row\n"
+          "matches cache-sim -s seed run on that configuration.\n",
+          msg, program);
+  exit(1);
+}
+
+/** A single simulation to be run and its results */
+typedef struct {
+  const char *spec;
+  CacheParams params;
+  unsigned long stats[CACHE_N_STATUS];
+  double secs;
+} SweepJob;
+
+typedef struct {
+  SweepJob *jobs;
+  unsigned nJobs;
+  atomic_uint nextJob;       /** index of next job to be claimed */
+  const MemAddr *addrs;      /** shared read-only trace */
+  size_t nAddrs;
+  unsigned seed;
+} Sweep;
+
+static double
+now_secs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static void
+run_job(const Sweep *sweep, SweepJob *job)
+{
+  double t0 = now_secs();
+  CacheSim *cache = new_cache_sim(&job->params);
+  cache_sim_seed(cache, sweep->seed);
+  //next uses depend on the line size, so OPT jobs compute their own
+  unsigned long *nextUses = (job->params.replacement == OPT_R)
+    ? next_uses(sweep->addrs, sweep->nAddrs, &job->params) : NULL;
+  unsigned long stats[CACHE_N_STATUS] = { 0 };
+  if (nextUses) {
+    for (size_t i = 0; i < sweep->nAddrs; i++) {
+      cache_sim_next_use(cache, nextUses[i]);
+      stats[cache_sim_result(cache, sweep->addrs[i]).status]++;
+    }
+  }
+  else {
+    cache_sim_stats(cache, sweep->addrs, sweep->nAddrs, stats);
+  }
+  free_cache_sim(cache);
+  free(nextUses);
+  memcpy(job->stats, stats, sizeof(stats));
+  job->secs = now_secs() - t0;
+}
+
+/** Thread body: claim and run jobs until none are left */
+static void *
+sweep_worker(void *arg)
+{
+  Sweep *sweep = arg;
+  unsigned i;
+  while ((i = atomic_fetch_add(&sweep->nextJob, 1)) < sweep->nJobs) {
+    run_job(sweep, &sweep->jobs[i]);
+  }
+  return NULL;
+}
+
+static void
+run_sweep(Sweep *sweep, unsigned nThreads)
+{
+  if (nThreads > sweep->nJobs) nThreads = sweep->nJobs;
+  pthread_t threads[nThreads];
+  for (unsigned i = 0; i < nThreads; i++) {
+    if (pthread_create(&threads[i], NULL, sweep_worker, sweep) != 0) {
+      fprintf(stderr, "cannot create sweep thread\n");
+      exit(1);
+    }
+  }
+  for (unsigned i = 0; i < nThreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+static void
+out_sweep(const Sweep *sweep, FILE *out)
+{
+  fprintf(out, "spec,s,E,b,m,replacement,accesses,hits,"
+          "misses_without_replace,misses_with_replace,hit_rate,secs\n");
+  for (unsigned i = 0; i < sweep->nJobs; i++) {
+    const SweepJob *job = &sweep->jobs[i];
+    const CacheParams *p = &job->params;
+    const unsigned long *stats = job->stats;
+    fprintf(out, "%s,%u,%u,%u,%u,%s,%zu,%lu,%lu,%lu,%.4f,%.3f\n",
+            job->spec, p->nSetBits, p->nLinesPerSet, p->nLineBits,
+            p->nMemAddrBits, replacement_name(p->replacement),
+            sweep->nAddrs, stats[CACHE_HIT],
+            stats[CACHE_MISS_WITHOUT_REPLACE], stats[CACHE_MISS_WITH_REPLACE],
+            (sweep->nAddrs == 0) ? 0 : (double)stats[CACHE_HIT]/sweep->nAddrs,
+            job->secs);
+  }
+}
+
+/** Parse comma-separated list of policy names into policies[], returning
+ *  # of policies or < 0 on error.
+ */
+static int
+get_policies(const char *list, Replacement policies[], int maxPolicies)
+{
+  char buf[strlen(list) + 1];
+  strcpy(buf, list);
+  int n = 0;
+  for (char *save, *name = strtok_r(buf, ",", &save); name != NULL;
+       name = strtok_r(NULL, ",", &save)) {
+    int r = get_replacement(name);
+    if (r < 0 || n >= maxPolicies) return -1;
+    policies[n++] = r;
+  }
+  return n;
+}
+
+enum { MAX_POLICIES = 16 };
+
+int
+main(int argc, const char *argv[])
+{
+  const char *program = argv[0];
+  int format = HEX_TRACE;
+  long nThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  Replacement policies[MAX_POLICIES] = { LRU_R };
+  int nPolicies = 1;
+  unsigned seed = 0;
+  int i;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    const char *opt = argv[i];
+    if (i >= argc - 1) usage(program, "option requires an argument\n");
+    const char *arg = argv[++i];
+    char *p;
+    if (strcmp(opt, "-f") == 0) {
+      if ((format = get_trace_format(arg)) < 0) {
+        usage(program, "trace format must be " TRACE_FORMAT_NAMES "\n");
+      }
+    }
+    else if (strcmp(opt, "-j") == 0) {
+      nThreads = strtol(arg, &p, 10);
+      if (nThreads <= 0 || *p != '\0') {
+        usage(program, "# of threads must be a positive integer\n");
+      }
+    }
+    else if (strcmp(opt, "-r") == 0) {
+      if ((nPolicies = get_policies(arg, policies, MAX_POLICIES)) <= 0) {
+        usage(program, "policies must be comma-separated "
+              REPLACEMENT_NAMES "\n");
+      }
+    }
+    else if (strcmp(opt, "-s") == 0) {
+      long v = strtol(arg, &p, 10);
+      if (v < 0 || *p != '\0') {
+        usage(program, "seed must be a non-negative integer\n");
+      }
+      seed = v;
+    }
+    else {
+      usage(program, "invalid option\n");
+    }
+  }
+  if (i == argc) usage(program, "at least one cache spec s-E-b-m required\n");
+  if (nThreads <= 0) nThreads = 1;
+
+  unsigned nJobs = (argc - i) * nPolicies;
+  SweepJob *jobs = callocChk(nJobs, sizeof(SweepJob));
+  for (unsigned j = 0; i < argc; i++) {
+    CacheParams params;
+    if (!get_cache_params(argv[i], &params)) {
+      fprintf(stderr, "invalid cache params \"%s\"\n", argv[i]);
+      usage(program, "");
+    }
+    for (int k = 0; k < nPolicies; k++, j++) {
+      jobs[j].spec = argv[i];
+      jobs[j].params = params;
+      jobs[j].params.replacement = policies[k];
+    }
+  }
+
+  Trace *trace = new_trace(stdin, format);
+  Sweep sweep = { .jobs = jobs, .nJobs = nJobs, .seed = seed };
+  atomic_init(&sweep.nextJob, 0);
+  sweep.addrs = load_trace(trace, &sweep.nAddrs);
+  run_sweep(&sweep, nThreads);
+  out_sweep(&sweep, stdout);
+  free_trace(trace);
+  free(jobs);
+  return 0;
+}
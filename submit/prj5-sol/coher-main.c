@@ -0,0 +1,204 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache-coher.h"
+#include "cache-sim.h"
+#include "cache-spec.h"
+#include "trace.h"
+
+#include "errors.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { DEFAULT_N_HOT = 10 };
+
+static void
+usage(const char *program, const char *msg)
+{
+  fprintf(stderr, "%susage: %s [-f " TRACE_FORMAT_NAMES "] [-r REPLACEMENT] "
+          "[-s seed] [-n HOT] [--line-csv CSV]\n"
+          "          CORE-s-E-b-m LLC-s-E-b-m\n"
+          "simulates the multi-core trace on stdin through one private\n"
+          "cache CORE-s-E-b-m per core kept coherent by MESI, backed by a\n"
+          "shared last-level cache LLC-s-E-b-m with the same b and m.\n"
+          "Each line of an rw trace may start with the # of the core\n"
+          "(less than %d) which made the access; other formats are core 0.\n"
+          "  -f: format of the trace (default rw)\n"
+          "  -r: one of " REPLACEMENT_NAMES " except opt (default lru)\n"
+          "  -n: # of hottest lines (most coherence misses plus\n"
+          "      invalidations) to output (default %d)\n"
+          "  --line-csv: write stats for every line with coherence misses\n"
+          "      or invalidations to CSV, hottest first\n",
+          msg, program, MAX_CORES, DEFAULT_N_HOT);
+  exit(1);
+}
+
+/** Output the #'s of the cores whose bits are set in cores */
+static void
+out_cores(uint64_t cores, FILE *out)
+{
+  const char *sep = "";
+  for (unsigned c = 0; c < MAX_CORES; c++) {
+    if (cores & (1UL << c)) {
+      fprintf(out, "%s%u", sep, c);
+      sep = ",";
+    }
+  }
+}
+
+static double
+percent(unsigned long n, unsigned long nTotal)
+{
+  return (nTotal == 0) ? 0 : n*100.0/nTotal;
+}
+
+static void
+out_coher_stats(const CacheCoher *coher, FILE *out)
+{
+  for (unsigned c = 0; c < cache_coher_n_cores(coher); c++) {
+    const CoherCoreStats *stats = cache_coher_core_stats(coher, c);
+    if (stats->nAccesses == 0) continue;
+    fprintf(out, "core %u: accesses: %lu writes: %lu hits: %lu (%.2f%%) "
+            "upgrades: %lu misses: %lu coherence misses: %lu "
+            "(false sharing: %lu)\n",
+            c, stats->nAccesses, stats->nWrites, stats->nHits,
+            percent(stats->nHits, stats->nAccesses), stats->nUpgrades,
+            stats->nMisses, stats->nCoherenceMisses,
+            stats->nFalseSharingMisses);
+  }
+  const CoherStats *stats = cache_coher_stats(coher);
+  fprintf(out, "invalidations: %lu\n", stats->nInvalidations);
+  fprintf(out, "cache-to-cache transfers: %lu\n", stats->nTransfers);
+  fprintf(out, "write-backs to LLC: %lu\n", stats->nWriteBacks);
+  fprintf(out, "LLC: accesses: %lu hits: %lu (%.2f%%) "
+          "write-backs to memory: %lu\n",
+          stats->nLlcAccesses, stats->nLlcHits,
+          percent(stats->nLlcHits, stats->nLlcAccesses),
+          stats->nMemWriteBacks);
+}
+
+/** Output the first nHot of lines[n] */
+static void
+out_hot_lines(const CoherLineStats lines[], size_t n, size_t nHot, FILE *out)
+{
+  if (n == 0) return;
+  fprintf(out, "hot lines:\n");
+  for (size_t i = 0; i < n && i < nHot; i++) {
+    const CoherLineStats *line = &lines[i];
+    fprintf(out, "  %lx: coherence misses: %lu (false sharing: %lu) "
+            "invalidations: %lu cores: ",
+            line->addr, line->nCoherenceMisses, line->nFalseSharingMisses,
+            line->nInvalidations);
+    out_cores(line->cores, out);
+    fprintf(out, " writers: ");
+    out_cores(line->writers, out);
+    fprintf(out, "\n");
+  }
+}
+
+/** Write lines[n] to a new CSV file at path */
+static void
+out_lines_csv(const CoherLineStats lines[], size_t n, const char *path)
+{
+  FILE *f = fopen(path, "w");
+  if (!f) fatal("cannot open %s: %s", path, strerror(errno));
+  fprintf(f, "addr,accesses,writes,coherence_misses,false_sharing_misses,"
+          "invalidations,cores,writers\n");
+  for (size_t i = 0; i < n; i++) {
+    const CoherLineStats *line = &lines[i];
+    fprintf(f, "0x%lx,%lu,%lu,%lu,%lu,%lu,0x%lx,0x%lx\n",
+            line->addr, line->nAccesses, line->nWrites,
+            line->nCoherenceMisses, line->nFalseSharingMisses,
+            line->nInvalidations, (unsigned long)line->cores,
+            (unsigned long)line->writers);
+  }
+  if (fclose(f) != 0) fatal("cannot write %s: %s", path, strerror(errno));
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const char *program = argv[0];
+  int format = RW_TRACE;
+  int replacement = LRU_R;
+  unsigned seed = 0;
+  size_t nHot = DEFAULT_N_HOT;
+  const char *csvPath = NULL;
+  int i;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    const char *opt = argv[i];
+    if (i >= argc - 1) usage(program, "option requires an argument\n");
+    const char *arg = argv[++i];
+    char *p;
+    if (strcmp(opt, "-f") == 0) {
+      if ((format = get_trace_format(arg)) < 0) {
+        usage(program, "trace format must be " TRACE_FORMAT_NAMES "\n");
+      }
+    }
+    else if (strcmp(opt, "-r") == 0) {
+      if ((replacement = get_replacement(arg)) < 0) {
+        usage(program, "replacement must be " REPLACEMENT_NAMES "\n");
+      }
+      // each cache sees only part of the trace, so no lookahead
+      if (replacement == OPT_R) usage(program, "opt not supported\n");
+    }
+    else if (strcmp(opt, "-s") == 0) {
+      long v = strtol(arg, &p, 10);
+      if (v < 0 || *p != '\0') {
+        usage(program, "seed must be a non-negative integer\n");
+      }
+      seed = v;
+    }
+    else if (strcmp(opt, "-n") == 0) {
+      long v = strtol(arg, &p, 10);
+      if (v < 0 || *p != '\0') {
+        usage(program, "HOT must be a non-negative integer\n");
+      }
+      nHot = v;
+    }
+    else if (strcmp(opt, "--line-csv") == 0) {
+      csvPath = arg;
+    }
+    else {
+      usage(program, "invalid option\n");
+    }
+  }
+  if (argc - i != 2) usage(program, "core and LLC cache specs required\n");
+  CacheParams coreParams = { .replacement = replacement };
+  CacheParams llcParams = { .replacement = replacement };
+  if (!get_cache_params(argv[i], &coreParams) ||
+      !get_cache_params(argv[i + 1], &llcParams)) {
+    usage(program, "invalid cache params\n");
+  }
+  if (coreParams.nLineBits != llcParams.nLineBits ||
+      coreParams.nMemAddrBits != llcParams.nMemAddrBits) {
+    usage(program, "core and LLC caches must have the same b and m\n");
+  }
+
+  CacheCoher *coher = new_cache_coher(&coreParams, &llcParams, seed);
+  Trace *trace = new_threaded_trace(stdin, format);
+  const MemAddr *addrs;
+  const AccessOp *ops;
+  size_t nAddrs;
+  const AccessOp read = { READ_ACCESS, 0, 0 };
+  while ((addrs = next_trace_ops_block(trace, &nAddrs, &ops)) != NULL) {
+    for (size_t k = 0; k < nAddrs; k++) {
+      if (ops && ops[k].core >= MAX_CORES) {
+        fatal("core %u is not less than %d", ops[k].core, MAX_CORES);
+      }
+      cache_coher_access(coher, addrs[k], ops ? &ops[k] : &read);
+    }
+  }
+  free_trace(trace);
+  out_coher_stats(coher, stdout);
+  CoherLineStats *lines;
+  size_t nLines = cache_coher_hot_lines(coher, &lines);
+  out_hot_lines(lines, nLines, nHot, stdout);
+  if (csvPath) out_lines_csv(lines, nLines, csvPath);
+  free(lines);
+  free_cache_coher(coher);
+  return 0;
+}
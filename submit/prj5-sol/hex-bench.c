@@ -0,0 +1,129 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Benchmark for parsing hex traces: writes N_ADDRS random addresses
+ *  of mixed widths as text to a temporary file, then reports MB/s for
+ *  the fscanf("%lx") loop cache-sim used to read traces with and for
+ *  the HEX_TRACE reader in trace.c.  Both must decode the same
+ *  addresses.
+ */
+
+enum { DEFAULT_N_ADDRS = 10000000 };
+
+static void
+usage(const char *program)
+{
+  fprintf(stderr, "usage: %s [-n N_ADDRS]\n"
+          "reports hex trace parsing speed for fscanf() and trace.c\n",
+          program);
+  exit(1);
+}
+
+/** xorshift64: fixed sequence so runs are comparable across builds */
+static unsigned long
+next_rand(unsigned long *state)
+{
+  unsigned long x = *state;
+  x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+  return *state = x;
+}
+
+static double
+now_secs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+/** Decoding results, compared to check the readers agree */
+typedef struct {
+  unsigned long nAddrs;
+  unsigned long sum;
+} Decoded;
+
+static Decoded
+fscanf_decode(FILE *in)
+{
+  Decoded d = { 0, 0 };
+  MemAddr addr;
+  while (fscanf(in, "%lx", &addr) == 1) {
+    d.nAddrs++;
+    d.sum += addr;
+  }
+  return d;
+}
+
+static Decoded
+trace_decode(FILE *in)
+{
+  Decoded d = { 0, 0 };
+  Trace *trace = new_trace(in, HEX_TRACE);
+  const MemAddr *addrs;
+  size_t n;
+  while ((addrs = next_trace_block(trace, &n)) != NULL) {
+    d.nAddrs += n;
+    for (size_t i = 0; i < n; i++) d.sum += addrs[i];
+  }
+  free_trace(trace);
+  return d;
+}
+
+static void
+bench(const char *name, Decoded decode(FILE *), FILE *in, long nBytes,
+      Decoded *expected, FILE *out)
+{
+  rewind(in);
+  double t0 = now_secs();
+  Decoded d = decode(in);
+  double secs = now_secs() - t0;
+  if (expected->nAddrs == 0) {
+    *expected = d;
+  }
+  else if (d.nAddrs != expected->nAddrs || d.sum != expected->sum) {
+    fprintf(stderr, "%s decoded different addresses\n", name);
+    exit(1);
+  }
+  fprintf(out, "%-8s %lu addrs %.3fs %.1f MB/s\n",
+          name, d.nAddrs, secs, nBytes/secs/1e6);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  unsigned long nAddrs = DEFAULT_N_ADDRS;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i < argc - 1) {
+      nAddrs = strtoul(argv[++i], NULL, 10);
+    }
+    else {
+      usage(argv[0]);
+    }
+  }
+  if (nAddrs == 0) usage(argv[0]);
+  FILE *tmp = tmpfile();
+  if (!tmp) {
+    perror("cannot create temporary file");
+    exit(1);
+  }
+  unsigned long state = 0x9E3779B97F4A7C15UL;
+  for (unsigned long i = 0; i < nAddrs; i++) {
+    //mostly 48-bit addresses with some short and some full-width ones
+    unsigned long r = next_rand(&state);
+    unsigned width = (r % 8 == 0) ? 64 : (r % 8 == 1) ? 16 : 48;
+    MemAddr addr = next_rand(&state) >> (64 - width);
+    fprintf(tmp, "%lx\n", addr);
+  }
+  long nBytes = ftell(tmp);
+  Decoded expected = { 0, 0 };
+  bench("fscanf", fscanf_decode, tmp, nBytes, &expected, stdout);
+  bench("trace", trace_decode, tmp, nBytes, &expected, stdout);
+  fclose(tmp);
+  return 0;
+}
@@ -0,0 +1,165 @@
+#include "cache-hier.h"
+#include "cache-sim.h"
+#include "cache-spec.h"
+#include "trace.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+  MAX_LEVELS = 8,
+  DEFAULT_LATENCY = 4,
+  DEFAULT_MEM_LATENCY = 200,
+};
+
+static void
+usage(const char *program, const char *msg)
+{
+  fprintf(stderr, "%susage: %s [-f " TRACE_FORMAT_NAMES "] "
+          "[-i incl|excl|nine] [-m MEM_LATENCY] [-r REPLACEMENT] [-s seed] "
+          "s-E-b-m[@LATENCY]...\n"
+          "simulates the trace on stdin through a hierarchy of caches, one\n"
+          "per s-E-b-m, listed from closest to the processor outwards.\n"
+          "All levels must have the same b and m.\n"
+          "  -i: inclusive (default), exclusive or non-inclusive levels\n"
+          "  -m: cycles for an access to memory (default %u)\n"
+          "  -r: one of " REPLACEMENT_NAMES " except opt (default lru)\n"
+          "  LATENCY: cycles for a lookup at that level (default %u)\n",
+          msg, program, DEFAULT_MEM_LATENCY, DEFAULT_LATENCY);
+  exit(1);
+}
+
+static const char *INCLUSION_NAMES[] = { "incl", "excl", "nine" };
+
+/** Translate from name to Inclusion enum.  Return < 0 on error */
+static int
+get_inclusion(const char *name)
+{
+  for (int i = 0; i < N_INCLUSIONS; i++) {
+    if (strcmp(name, INCLUSION_NAMES[i]) == 0) return i;
+  }
+  return -1;
+}
+
+/** Parse levelSpec s-E-b-m[@LATENCY] into *params and *latencyP.
+ *  Returns false on error.
+ */
+static bool
+get_level_params(const char *levelSpec, CacheParams *params,
+                 unsigned *latencyP)
+{
+  const char *at = strchr(levelSpec, '@');
+  size_t len = at ? at - levelSpec : strlen(levelSpec);
+  char spec[len + 1];
+  memcpy(spec, levelSpec, len);
+  spec[len] = '\0';
+  if (at) {
+    char *p;
+    long v = strtol(at + 1, &p, 10);
+    if (v < 0 || *p != '\0' || p == at + 1) return false;
+    *latencyP = v;
+  }
+  return get_cache_params(spec, params);
+}
+
+static void
+out_hier_stats(const CacheHier *hier, const char *specs[], unsigned nLevels,
+               const unsigned latencies[], FILE *out)
+{
+  for (unsigned i = 0; i < nLevels; i++) {
+    const CacheLevelStats *stats = cache_hier_stats(hier, i);
+    unsigned long nMisses = stats->nAccesses - stats->nHits;
+    fprintf(out, "L%u %s: accesses: %lu hits: %lu (%.2f%%) misses: %lu "
+            "evictions: %lu invalidations: %lu\n",
+            i + 1, specs[i], stats->nAccesses, stats->nHits,
+            (stats->nAccesses == 0) ? 0 : stats->nHits*100.0/stats->nAccesses,
+            nMisses, stats->nEvictions, stats->nInvalidations);
+  }
+  fprintf(out, "AMAT: %.2f cycles\n", cache_hier_amat(hier, latencies));
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const char *program = argv[0];
+  int format = HEX_TRACE;
+  int inclusion = INCLUSIVE_H;
+  int replacement = LRU_R;
+  unsigned memLatency = DEFAULT_MEM_LATENCY;
+  unsigned seed = 0;
+  int i;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    const char *opt = argv[i];
+    if (i >= argc - 1) usage(program, "option requires an argument\n");
+    const char *arg = argv[++i];
+    char *p;
+    if (strcmp(opt, "-f") == 0) {
+      if ((format = get_trace_format(arg)) < 0) {
+        usage(program, "trace format must be " TRACE_FORMAT_NAMES "\n");
+      }
+    }
+    else if (strcmp(opt, "-i") == 0) {
+      if ((inclusion = get_inclusion(arg)) < 0) {
+        usage(program, "inclusion must be incl|excl|nine\n");
+      }
+    }
+    else if (strcmp(opt, "-m") == 0) {
+      long v = strtol(arg, &p, 10);
+      if (v < 0 || *p != '\0') {
+        usage(program, "memory latency must be a non-negative integer\n");
+      }
+      memLatency = v;
+    }
+    else if (strcmp(opt, "-r") == 0) {
+      if ((replacement = get_replacement(arg)) < 0) {
+        usage(program, "replacement must be " REPLACEMENT_NAMES "\n");
+      }
+      // levels below L1 see a filtered stream, so no trace lookahead
+      if (replacement == OPT_R) usage(program, "opt not supported\n");
+    }
+    else if (strcmp(opt, "-s") == 0) {
+      long v = strtol(arg, &p, 10);
+      if (v < 0 || *p != '\0') {
+        usage(program, "seed must be a non-negative integer\n");
+      }
+      seed = v;
+    }
+    else {
+      usage(program, "invalid option\n");
+    }
+  }
+  unsigned nLevels = argc - i;
+  if (nLevels == 0 || nLevels > MAX_LEVELS) {
+    usage(program, "between 1 and 8 cache specs s-E-b-m required\n");
+  }
+  CacheParams params[nLevels];
+  unsigned latencies[nLevels + 1];
+  const char **specs = &argv[i];
+  for (unsigned k = 0; k < nLevels; k++) {
+    params[k].replacement = replacement;
+    latencies[k] = DEFAULT_LATENCY;
+    if (!get_level_params(specs[k], &params[k], &latencies[k])) {
+      fprintf(stderr, "invalid cache params \"%s\"\n", specs[k]);
+      usage(program, "");
+    }
+    if (params[k].nLineBits != params[0].nLineBits ||
+        params[k].nMemAddrBits != params[0].nMemAddrBits) {
+      usage(program, "all levels must have the same b and m\n");
+    }
+  }
+  latencies[nLevels] = memLatency;
+
+  CacheHier *hier = new_cache_hier(params, nLevels, inclusion, seed);
+  Trace *trace = new_threaded_trace(stdin, format);
+  const MemAddr *addrs;
+  size_t nAddrs;
+  while ((addrs = next_trace_block(trace, &nAddrs)) != NULL) {
+    for (size_t k = 0; k < nAddrs; k++) cache_hier_access(hier, addrs[k]);
+  }
+  out_hier_stats(hier, specs, nLevels, latencies, stdout);
+  free_trace(trace);
+  free_cache_hier(hier);
+  return 0;
+}
@@ -1,125 +1,571 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "cache-sim.h"
+#include "cache-spec.h"
+#include "cache-stats.h"
+#include "next-use.h"
+#include "result-out.h"
+#include "stack-dist.h"
+#include "tlb-sim.h"
+#include "trace.h"
+
+#include "errors.h"
+#include "memalloc.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 static void
 usage(const char *program, const char *msg)
 {
-  fprintf(stderr, "%susage: %s [-r lru|mru|rand] [-s seed] [-v] s-E-b-m\n"
+  fprintf(stderr, "%susage: %s [-f " TRACE_FORMAT_NAMES "] [-r REPLACEMENT] "
+          "[-s seed]\n"
+          "          [-w back|through] [-a allocate|no-allocate] "
+          "[-p " PREFETCH_NAMES "]\n"
+          "          [-v] [-o RESULTS]"
+          " [--stats JSON] [--set-csv CSV] [--reuse-csv CSV]\n"
+          "          [--page " PAGE_SIZE_NAMES " [--tlb s-E[,s-E]...] "
+          "[--page-map " PAGE_MAP_NAMES "]]\n"
+          "          [--sample K] [--limit N] [--save SNAPSHOT] s-E-b-m\n"
+          "       %s [-f " TRACE_FORMAT_NAMES "] [OUTPUT OPTIONS] [--limit N]\n"
+          "          [--save SNAPSHOT] --load|--resume SNAPSHOT\n"
+          "       %s [-f " TRACE_FORMAT_NAMES "] --sweep [sMin:]s-E-b-m\n"
           "where s-E-b-m specified cache parameters:\n"
           "  s: # of bits in address used to specify set\n"
           "  E: # of cache lines per set\n"
           "  b: # of bits in address used to specify offset in cache line\n"
           "  m: total # of bits used to address primary memory\n"
-          "  must have all non-negative and 2 <= b and b + s < m\n",
-          msg, program);
+          "  must have all non-negative and 2 <= b and b + s < m <= 64\n"
+          "REPLACEMENT is one of " REPLACEMENT_NAMES " (default lru)\n"
+          "-f gives the format of the address trace read from stdin\n"
+          "  (default hex; see trace-convert for producing bin|delta);\n"
+          "  gzip or zstd compressed input is detected automatically;\n"
+          "  an rw trace of loads and stores also gives memory traffic\n"
+          "-w and -a give what happens on a write hit and a write miss\n"
+          "  (default back and allocate)\n"
+          "-p runs a next-line, stride or stream prefetcher (default none)\n"
+          "  and outputs its accuracy, coverage and pollution; not with opt\n"
+          "-v outputs the result of each access before the stats\n"
+          "-o writes the result of each access to file RESULTS as 16-byte\n"
+          "  records: little-endian 64-bit address and replaceAddr|status\n"
+          "  with status 0 hit, 1 miss-without-replace, 2 miss-with-replace\n"
+          "--stats writes totals, per-set counts and reuse distances to JSON;\n"
+          "  misses are classified as compulsory, capacity (also a miss in\n"
+          "  a fully associative LRU cache of the same size) or conflict\n"
+          "--set-csv writes per-set counts to CSV, one row per set\n"
+          "--reuse-csv writes the reuse-distance histogram to CSV\n"
+          "--sample K simulates only 1 in 2**K sets (K <= s) and outputs\n"
+          "  stats extrapolated from them with 95%% confidence intervals\n"
+          "--limit N simulates at most N accesses of the trace\n"
+          "--page translates the trace's virtual addresses to physical\n"
+          "  ones for the cache using pages of that size, giving each page\n"
+          "  a frame of the 2**m bytes of memory on first touch, and\n"
+          "  outputs the hits and misses of a TLB with a level for each\n"
+          "  s-E of --tlb (default " DEFAULT_TLB_SPEC ") and the page walks\n"
+          "--page-map assigns frames in order of first touch (seq) or by\n"
+          "  a permutation seeded by -s (hash, the default)\n"
+          "--save writes the state of the cache after the trace to file\n"
+          "  SNAPSHOT, recording how many accesses of the trace it has seen\n"
+          "--load restores the cache (including its params) from SNAPSHOT\n"
+          "  and continues it with the trace on stdin\n"
+          "--resume is like --load but skips the accesses of the trace\n"
+          "  already seen, so the whole trace can be given again\n"
+          "  (snapshots are not supported with opt, --page and --sweep)\n"
+          "--sweep makes a single pass over the trace and outputs CSV\n"
+          "  LRU stats for every set bits in [sMin, s] (default sMin = s)\n"
+          "  and every # of lines per set in [1, E]\n",
+          msg, program, program, program);
     exit(1);
 }
 
-typedef struct {
-  const char *name;
-  Replacement replacement;
-} ReplacementName;
-
-static ReplacementName REPLACEMENTS[] = {
-  { "lru", LRU_R },
-  { "mru", MRU_R },
-  { "rand", RANDOM_R },
-};
-
-/** Translate from name to Replacement enum.  Return < 0 on error */
-static int
-get_replacement(const char *name) {
-  for (int i = 0; i < sizeof(REPLACEMENTS)/sizeof(REPLACEMENTS[0]); i++) {
-    if (strcmp(name, REPLACEMENTS[i].name) == 0) {
-      return REPLACEMENTS[i].replacement;
-    }
-  }
-  return -1;
-}
-
 /** Somewhat non-elegant allocation here to force new_cache_sim() to
- *  make copies of *params.  Sets *nMemAddrBitsP which is used for
- *  verbose formatting in do_cache_sim().  Returns NULL on error.
+ *  make copies of *params.  Sets *paramsP to a copy of the parsed
+ *  params which is used by do_cache_sim().  Returns NULL on error.
  */
 static CacheSim *
 make_cache_sim(const char *paramsSpec, Replacement replacement,
-               unsigned *nMemAddrBitsP)
+               WritePolicy writePolicy, AllocatePolicy allocatePolicy,
+               Prefetch prefetch, CacheParams *paramsP)
 {
   CacheParams params;
   params.replacement = replacement;
-  unsigned *fieldsP[] = {
-    &params.nSetBits, &params.nLinesPerSet,
-    &params.nLineBits, &params.nMemAddrBits,
-  };
-  int i = 0;
-  const char *p;
-  for (p = paramsSpec; *p != '\0' && i < 4; i++, p += (i < 4)) {
-    char *q;
-    long v = strtol(p, &q, 10);
-    p = q;
-    if (v < 0 || ((i < 3) ? (*p != '-') : (*p != '\0'))) return NULL;
-    *fieldsP[i] = v;
-  }
-  *nMemAddrBitsP = params.nMemAddrBits;
-  return (*p == '\0') && (i == 4) && (params.nLineBits >= 2) &&
-         (params.nLineBits + params.nSetBits < params.nMemAddrBits)
-         ? new_cache_sim(&params)
-         : NULL;
+  if (!get_cache_params(paramsSpec, &params)) return NULL;
+  params.writePolicy = writePolicy;
+  params.allocatePolicy = allocatePolicy;
+  params.prefetch = prefetch;
+  *paramsP = params;
+  return new_cache_sim(&params);
 }
 
+//must be in sync with CACHE_STATUS enum
+static const char *STATUS_LABELS[] = {
+  "hits: ", "misses without replace: ", "misses with replace: "
+};
+
 static void
 out_cache_stats(unsigned long stats[], unsigned long nTotal, FILE *out)
 {
   for (int i = 0; i < CACHE_N_STATUS; i++) {
-    switch (i) {
-    case CACHE_HIT:
-      fprintf(out, "hits: ");
-      break;
-    case CACHE_MISS_WITHOUT_REPLACE:
-      fprintf(out, "misses without replace: ");
-      break;
-    case CACHE_MISS_WITH_REPLACE:
-      fprintf(out, "misses with replace: ");
-      break;
-    }
-    fprintf(out, "%lu/%lu (%.2f%%) hits\n", stats[i], nTotal,
-          (nTotal == 0) ? 0 : stats[i] * 100.0/nTotal);
+    fprintf(out, "%s%lu/%lu (%.2f%%) hits\n", STATUS_LABELS[i], stats[i],
+            nTotal, (nTotal == 0) ? 0 : stats[i] * 100.0/nTotal);
   }
 }
 
-//must be in sync with CACHE_STATUS enum
-static const char *STATUS_STRS[] = {
-  "hit", "miss-without-replace", "miss-with-replace"
+enum { VERBOSE_CHUNK = 1024 };
+
+/** Destinations for per-access results */
+enum {
+  VERBOSE_OUT,                  /** -v text on stdout */
+  BIN_OUT,                      /** -o binary records */
+  N_OUTS
 };
 
+/** Consumers of per-access results; all NULL when only the totals
+ *  are needed, which lets sim_addrs() use cache_sim_stats().
+ */
+typedef struct {
+  ResultWriter *writers[N_OUTS];
+  CacheStats *cacheStats;       /** --stats, --set-csv, --reuse-csv */
+} ResultOuts;
+
+static bool
+has_result_outs(const ResultOuts *outs)
+{
+  for (int k = 0; k < N_OUTS; k++) {
+    if (outs->writers[k]) return true;
+  }
+  return outs->cacheStats != NULL;
+}
+
+static void
+out_results(const ResultOuts *outs, const MemAddr addrs[],
+            const CacheResult results[], size_t n)
+{
+  for (int k = 0; k < N_OUTS; k++) {
+    if (outs->writers[k]) write_results(outs->writers[k], addrs, results, n);
+  }
+  if (outs->cacheStats) cache_stats_add(outs->cacheStats, addrs, results, n);
+}
+
+/** Simulate addrs[nAddrs] accumulating counts into stats[].  If ops
+ *  is not NULL, addrs[i] is read or written as given by ops[i] and the
+ *  memory traffic is added to *traffic; otherwise every access is a
+ *  read.  If nextUses is not NULL, nextUses[i] is passed to
+ *  cache_sim_next_use() before simulating addrs[i]; otherwise the
+ *  batch entry points are used.  The per-access results are passed on
+ *  to outs.
+ */
+static void
+sim_addrs(CacheSim *cache, const MemAddr addrs[], const AccessOp ops[],
+          size_t nAddrs, const unsigned long nextUses[],
+          const ResultOuts *outs, unsigned long stats[], CacheTraffic *traffic)
+{
+  if (nextUses) {
+    for (size_t i = 0; i < nAddrs; i++) {
+      cache_sim_next_use(cache, nextUses[i]);
+      CacheResult result;
+      if (ops) {
+        cache_sim_op_results(cache, &addrs[i], &ops[i], 1, &result, traffic);
+      }
+      else {
+        result = cache_sim_result(cache, addrs[i]);
+      }
+      stats[result.status]++;
+      out_results(outs, &addrs[i], &result, 1);
+    }
+  }
+  else if (!has_result_outs(outs)) {
+    if (ops) {
+      cache_sim_op_stats(cache, addrs, ops, nAddrs, stats, traffic);
+    }
+    else {
+      cache_sim_stats(cache, addrs, nAddrs, stats);
+    }
+  }
+  else {
+    CacheResult results[VERBOSE_CHUNK];
+    for (size_t i = 0; i < nAddrs; i += VERBOSE_CHUNK) {
+      size_t n = (nAddrs - i < VERBOSE_CHUNK) ? nAddrs - i : VERBOSE_CHUNK;
+      if (ops) {
+        cache_sim_op_results(cache, &addrs[i], &ops[i], n, results, traffic);
+      }
+      else {
+        cache_sim_results(cache, &addrs[i], n, results);
+      }
+      for (size_t k = 0; k < n; k++) stats[results[k].status]++;
+      out_results(outs, &addrs[i], results, n);
+    }
+  }
+}
+
+/** Output the memory traffic of a cache with 2**nLineBits byte lines
+ *  over nTotal accesses.
+ */
+static void
+out_traffic(const CacheTraffic *traffic, unsigned nLineBits,
+            unsigned long nTotal, FILE *out)
+{
+  unsigned long lineBytes = 1UL << nLineBits;
+  fprintf(out, "writes: %lu/%lu (%.2f%%) accesses\n", traffic->nWrites,
+          nTotal, (nTotal == 0) ? 0 : traffic->nWrites * 100.0/nTotal);
+  fprintf(out, "write-backs: %lu (%lu bytes)\n", traffic->nWriteBacks,
+          traffic->nWriteBacks * lineBytes);
+  fprintf(out, "write-throughs: %lu (%lu bytes)\n", traffic->nWriteThroughs,
+          traffic->nWriteThroughBytes);
+  fprintf(out, "memory bytes read: %lu\n", traffic->nFills * lineBytes);
+  fprintf(out, "memory bytes written: %lu\n",
+          traffic->nWriteBacks * lineBytes + traffic->nWriteThroughBytes);
+}
+
+/** Set *stats to the effect of cache's prefetcher since it was
+ *  *before; a cache loaded from a snapshot has been prefetching since
+ *  the start of its trace.
+ */
+static void
+prefetch_stats_since(const CacheSim *cache, const PrefetchStats *before,
+                     PrefetchStats *stats)
+{
+  cache_sim_prefetch_stats(cache, stats);
+  stats->nDemandMisses -= before->nDemandMisses;
+  stats->nIssued -= before->nIssued;
+  stats->nUseful -= before->nUseful;
+  stats->nPolluting -= before->nPolluting;
+  stats->nWriteBacks -= before->nWriteBacks;
+}
+
+/** Output the accuracy, coverage and pollution of a prefetcher */
+static void
+out_prefetch_stats(const PrefetchStats *stats, FILE *out)
+{
+  unsigned long nWouldMiss = stats->nUseful + stats->nDemandMisses;
+  fprintf(out, "prefetches: %lu issued, %lu useful, %lu write-backs\n",
+          stats->nIssued, stats->nUseful, stats->nWriteBacks);
+  fprintf(out, "prefetch accuracy: %.2f%%\n",
+          (stats->nIssued == 0) ? 0 : stats->nUseful * 100.0/stats->nIssued);
+  fprintf(out, "prefetch coverage: %.2f%%\n",
+          (nWouldMiss == 0) ? 0 : stats->nUseful * 100.0/nWouldMiss);
+  fprintf(out, "prefetch pollution: %lu/%lu (%.2f%%) misses\n",
+          stats->nPolluting, stats->nDemandMisses,
+          (stats->nDemandMisses == 0)
+          ? 0 : stats->nPolluting * 100.0/stats->nDemandMisses);
+}
+
+/** Translation of the blocks of a trace from virtual to physical
+ *  addresses, or none.
+ */
+typedef struct {
+  TlbSim *tlb;              /** NULL if addresses are used as they are */
+  MemAddr *paddrs;          /** translation of the last block */
+  size_t nMax;              /** # of addresses paddrs can hold */
+} Translator;
+
+/** Return the physical addresses of addrs[n] as given by xlate */
+static const MemAddr *
+translate_block(Translator *xlate, const MemAddr addrs[], size_t n)
+{
+  if (!xlate->tlb) return addrs;
+  if (n > xlate->nMax) {
+    xlate->paddrs = reallocChk(xlate->paddrs, n * sizeof(MemAddr));
+    xlate->nMax = n;
+  }
+  tlb_sim_translate(xlate->tlb, addrs, xlate->paddrs, n);
+  return xlate->paddrs;
+}
+
+/** Output the stats of each TLB level, the page walks (misses in the
+ *  last level) and the # of pages touched.
+ */
 static void
-do_cache_sim(CacheSim *cache, bool isVerbose, unsigned nMemAddrBits,
-             FILE *in, FILE *out)
+out_tlb_stats(const TlbSim *tlb, const TlbParams *params, FILE *out)
+{
+  for (unsigned i = 0; i < params->nLevels; i++) {
+    CacheLevelStats stats = tlb_sim_stats(tlb, i);
+    fprintf(out, "TLB L%u %u-%u: accesses: %lu hits: %lu (%.2f%%) "
+            "misses: %lu\n",
+            i + 1, params->nSetBits[i], params->nEntriesPerSet[i],
+            stats.nAccesses, stats.nHits,
+            (stats.nAccesses == 0) ? 0 : stats.nHits*100.0/stats.nAccesses,
+            stats.nAccesses - stats.nHits);
+  }
+  unsigned long nAccesses = tlb_sim_stats(tlb, 0).nAccesses;
+  CacheLevelStats last = tlb_sim_stats(tlb, params->nLevels - 1);
+  unsigned long nWalks = last.nAccesses - last.nHits;
+  fprintf(out, "page walks: %lu (%.2f per 1000 accesses)\n", nWalks,
+          (nAccesses == 0) ? 0 : nWalks*1000.0/nAccesses);
+  unsigned long nPages = tlb_sim_n_pages(tlb);
+  fprintf(out, "pages touched: %lu (%lu bytes)\n", nPages,
+          nPages << params->nPageBits);
+}
+
+/** The part of a trace to simulate */
+typedef struct {
+  unsigned long nSkip;      /** # of accesses still to be skipped */
+  unsigned long nLimit;     /** max # of accesses still to be simulated */
+  unsigned long nSimulated; /** # of accesses in window so far */
+} TraceWindow;
+
+/** Clip the block of *nP addresses at *addrsP (and ops at *opsP if
+ *  not NULL) to window, updating it.  Return false if nothing is left.
+ */
+static bool
+clip_block(TraceWindow *window, const MemAddr **addrsP,
+           const AccessOp **opsP, size_t *nP)
+{
+  size_t nSkip = (*nP < window->nSkip) ? *nP : window->nSkip;
+  size_t n = *nP - nSkip;
+  if (n > window->nLimit) n = window->nLimit;
+  window->nSkip -= nSkip;
+  window->nLimit -= n;
+  window->nSimulated += n;
+  *addrsP += nSkip;
+  if (*opsP) *opsP += nSkip;
+  *nP = n;
+  return n > 0;
+}
+
+/** As next_trace_ops_block(), but only return accesses in window */
+static const MemAddr *
+next_window_block(Trace *trace, TraceWindow *window, size_t *nP,
+                  const AccessOp **opsP)
+{
+  const MemAddr *addrs;
+  while (window->nLimit > 0 &&
+         (addrs = next_trace_ops_block(trace, nP, opsP)) != NULL) {
+    if (clip_block(window, &addrs, opsP, nP)) return addrs;
+  }
+  return NULL;
+}
+
+/** OPT_R needs to look ahead, so it loads the entire trace before
+ *  simulating it; everything else is simulated a block at a time.
+ *  Only the accesses in window are simulated, after translation by
+ *  xlate.  Memory traffic is
+ *  output after the stats if trace has loads and stores, followed by
+ *  the prefetcher's stats if there is one.
+ */
+static void
+do_cache_sim(CacheSim *cache, const CacheParams *params,
+             const ResultOuts *outs, Trace *trace, TraceWindow *window,
+             Translator *xlate, FILE *out)
 {
   unsigned long stats[] = { 0UL, 0UL, 0UL };
-  unsigned addrWidth = (nMemAddrBits + 3)/4;
-  while (1) {
-    MemAddr addr;
-    if (fscanf(in, "%lx", &addr) != 1) break;
-    CacheResult result = cache_sim_result(cache, addr);
-    stats[result.status]++;
-    if (isVerbose) {
-      fprintf(out, "%0*lx: %s", addrWidth, addr, STATUS_STRS[result.status]);
-      if (result.status == CACHE_MISS_WITH_REPLACE) {
-        fprintf(out, " %0*lx", addrWidth, result.replaceAddr);
-      }
-      fprintf(out, "\n");
-    }
-  } // while (1)
+  CacheTraffic traffic = { 0 };
+  bool hasOps = false;
+  const MemAddr *addrs;
+  const AccessOp *ops;
+  size_t nAddrs;
+  PrefetchStats prefetchStats;
+  cache_sim_prefetch_stats(cache, &prefetchStats);
+  const PrefetchStats before = prefetchStats;
+  if (params->replacement == OPT_R) {
+    addrs = load_trace_ops(trace, &nAddrs, &ops);
+    clip_block(window, &addrs, &ops, &nAddrs);
+    addrs = translate_block(xlate, addrs, nAddrs);
+    unsigned long *nextUses = next_uses(addrs, nAddrs, params);
+    sim_addrs(cache, addrs, ops, nAddrs, nextUses, outs, stats, &traffic);
+    hasOps = ops != NULL;
+    free(nextUses);
+  }
+  else {
+    while ((addrs = next_window_block(trace, window, &nAddrs, &ops))) {
+      addrs = translate_block(xlate, addrs, nAddrs);
+      sim_addrs(cache, addrs, ops, nAddrs, NULL, outs, stats, &traffic);
+      hasOps = hasOps || ops;
+    }
+  }
+  for (int k = 0; k < N_OUTS; k++) {
+    if (outs->writers[k]) flush_result_writer(outs->writers[k]);
+  }
   unsigned long nTotal = 0UL;
   for (int i = 0; i < CACHE_N_STATUS; i++) {
     nTotal += stats[i];
   }
   out_cache_stats(stats, nTotal, out);
+  prefetch_stats_since(cache, &before, &prefetchStats);
+  if (hasOps) {
+    // prefetches move lines too
+    traffic.nFills += prefetchStats.nIssued;
+    traffic.nWriteBacks += prefetchStats.nWriteBacks;
+    out_traffic(&traffic, params->nLineBits, nTotal, out);
+  }
+  if (params->prefetch != NO_PREFETCH) out_prefetch_stats(&prefetchStats, out);
+}
+
+/** Two-sided 95% critical values of Student's t for 1 to 30 degrees
+ *  of freedom; the normal 1.96 is close enough beyond that.
+ */
+static const double T_95[] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+static double
+t_95(size_t degrees)
+{
+  size_t nT = sizeof(T_95)/sizeof(T_95[0]);
+  return (degrees == 0) ? 0 : (degrees <= nT) ? T_95[degrees - 1] : 1.96;
+}
+
+/** Simulate only 1 in 2**sampleBits of the sets of cache and output
+ *  stats extrapolated to the whole trace, followed by a 95% confidence
+ *  interval for each rate.  The sampled sets are clusters of accesses,
+ *  so each rate is a ratio estimate whose variance comes from how much
+ *  it differs between sets.  Every access is translated by xlate, so
+ *  its TLB stats are exact.
+ */
+static void
+do_sampled_sim(CacheSim *cache, const CacheParams *params,
+               unsigned sampleBits, Trace *trace, TraceWindow *window,
+               Translator *xlate, FILE *out)
+{
+  size_t nSets = (size_t)1 << params->nSetBits;
+  unsigned long *setStats =
+    callocChk(nSets * CACHE_N_STATUS, sizeof(unsigned long));
+  cache_sim_sample_sets(cache, sampleBits);
+  unsigned long nTotal = 0UL;
+  unsigned long nSampled = 0UL;
+  const MemAddr *addrs;
+  const AccessOp *ops;
+  size_t nAddrs;
+  while ((addrs = next_window_block(trace, window, &nAddrs, &ops))) {
+    addrs = translate_block(xlate, addrs, nAddrs);
+    nSampled += cache_sim_sampled_stats(cache, addrs, nAddrs, setStats);
+    nTotal += nAddrs;
+  }
+  size_t nSampledSets = nSets >> sampleBits;
+  double meanAccesses = (double)nSampled / nSampledSets;
+  double fraction = 1.0 / ((size_t)1 << sampleBits);
+  unsigned long stats[CACHE_N_STATUS];
+  double rates[CACHE_N_STATUS];
+  double halfWidths[CACHE_N_STATUS];
+  for (int k = 0; k < CACHE_N_STATUS; k++) {
+    unsigned long sum = 0UL;
+    for (size_t set = 0; set < nSets; set++) {
+      sum += setStats[set*CACHE_N_STATUS + k];
+    }
+    double rate = (nSampled == 0) ? 0 : (double)sum / nSampled;
+    double sumSq = 0;
+    for (size_t set = 0; set < nSets; set++) {
+      if (!cache_sim_is_sampled_set(cache, set)) continue;
+      unsigned long *counts = &setStats[set*CACHE_N_STATUS];
+      unsigned long nSetAccesses = 0UL;
+      for (int j = 0; j < CACHE_N_STATUS; j++) nSetAccesses += counts[j];
+      double residual = counts[k] - rate * nSetAccesses;
+      sumSq += residual * residual;
+    }
+    double variance = (nSampledSets < 2 || nSampled == 0) ? 0
+      : (1 - fraction) * sumSq
+        / ((nSampledSets - 1) * nSampledSets * meanAccesses * meanAccesses);
+    rates[k] = rate;
+    halfWidths[k] = t_95(nSampledSets - 1) * sqrt(variance);
+    stats[k] = rate * nTotal + 0.5;
+  }
+  out_cache_stats(stats, nTotal, out);
+  fprintf(out, "sampled %zu/%zu sets, %lu/%lu accesses\n",
+          nSampledSets, nSets, nSampled, nTotal);
+  for (int k = 0; k < CACHE_N_STATUS; k++) {
+    fprintf(out, "%s%.2f%% +/- %.2f%% (95%% confidence)\n", STATUS_LABELS[k],
+            rates[k] * 100, halfWidths[k] * 100);
+  }
+  free(setStats);
+}
+
+/** Write cacheStats to the file at path using out_fn() */
+static void
+out_stats_file(const char *path, const CacheStats *cacheStats,
+               void out_fn(const CacheStats *, FILE *))
+{
+  FILE *f = fopen(path, "w");
+  if (!f) fatal("cannot open %s: %s", path, strerror(errno));
+  out_fn(cacheStats, f);
+  if (fclose(f) != 0) fatal("cannot write %s: %s", path, strerror(errno));
+}
+
+/** Parse sweepSpec of the form [sMin:]sMax-E-b-m into *params (with
+ *  params->nSetBits set to sMax) and *minSetBitsP.  Returns false on
+ *  error.
+ */
+static bool
+get_sweep_params(const char *sweepSpec, CacheParams *params,
+                 unsigned *minSetBitsP)
+{
+  const char *colon = strchr(sweepSpec, ':');
+  const char *spec = sweepSpec;
+  if (colon) {
+    char *q;
+    long v = strtol(sweepSpec, &q, 10);
+    if (q != colon || v < 0) return false;
+    *minSetBitsP = v;
+    spec = colon + 1;
+  }
+  if (!get_cache_params(spec, params)) return false;
+  if (!colon) *minSetBitsP = params->nSetBits;
+  return *minSetBitsP <= params->nSetBits && params->nLinesPerSet > 0;
+}
+
+/** Make one pass over trace computing LRU stack distances and output
+ *  a CSV row of stats for every s in [minSetBits, params->nSetBits]
+ *  and every E in [1, params->nLinesPerSet].
+ */
+static void
+do_sweep(const CacheParams *params, unsigned minSetBits, Trace *trace,
+         FILE *out)
+{
+  StackDist *stackDist = new_stack_dist(params, minSetBits);
+  const MemAddr *addrs;
+  size_t nAddrs;
+  while ((addrs = next_trace_block(trace, &nAddrs)) != NULL) {
+    stack_dist_addrs(stackDist, addrs, nAddrs);
+  }
+  fprintf(out, "s,E,b,m,accesses,hits,misses_without_replace,"
+          "misses_with_replace,hit_rate\n");
+  for (unsigned s = minSetBits; s <= params->nSetBits; s++) {
+    for (unsigned e = 1; e <= params->nLinesPerSet; e++) {
+      CacheParams p = *params;
+      p.nSetBits = s;
+      p.nLinesPerSet = e;
+      unsigned long stats[CACHE_N_STATUS];
+      stack_dist_stats(stackDist, &p, stats);
+      unsigned long nTotal = 0UL;
+      for (int i = 0; i < CACHE_N_STATUS; i++) nTotal += stats[i];
+      fprintf(out, "%u,%u,%u,%u,%lu,%lu,%lu,%lu,%.4f\n",
+              s, e, p.nLineBits, p.nMemAddrBits, nTotal,
+              stats[CACHE_HIT], stats[CACHE_MISS_WITHOUT_REPLACE],
+              stats[CACHE_MISS_WITH_REPLACE],
+              (nTotal == 0) ? 0 : (double)stats[CACHE_HIT]/nTotal);
+    }
+  }
+  free_stack_dist(stackDist);
+}
+
+/** Options which write cacheStats to a file */
+static const struct {
+  const char *option;
+  void (*out_fn)(const CacheStats *, FILE *);
+} STATS_OUTS[] = {
+  { "--stats", out_stats_json },
+  { "--set-csv", out_set_stats_csv },
+  { "--reuse-csv", out_reuse_csv },
+};
+
+enum { N_STATS_OUTS = sizeof(STATS_OUTS)/sizeof(STATS_OUTS[0]) };
+
+/** Return index of option in STATS_OUTS[], < 0 if not there */
+static int
+get_stats_out(const char *option)
+{
+  for (int k = 0; k < N_STATS_OUTS; k++) {
+    if (strcmp(option, STATS_OUTS[k].option) == 0) return k;
+  }
+  return -1;
 }
 
 int
@@ -128,23 +574,108 @@ main(int argc, const char *argv[])
   const char *program = argv[0];
   if (argc <= 1) usage(program, "");
   bool isVerbose = false;
+  const char *resultsPath = NULL;
+  int sampleBits = -1;
+  //paths given to --stats, --set-csv and --reuse-csv
+  const char *statsPaths[N_STATS_OUTS] = { NULL, NULL, NULL };
+  bool isSweep = false;
   int replacement = LRU_R;
+  int format = HEX_TRACE;
+  int writePolicy = WRITE_BACK;
+  int allocatePolicy = WRITE_ALLOCATE;
+  int prefetch = NO_PREFETCH;
   int seed = 0;
+  unsigned long limit = ULONG_MAX;
+  const char *savePath = NULL;
+  const char *loadPath = NULL;
+  bool isResume = false;
+  TlbParams tlbParams = { .pageMap = HASH_PAGE_MAP };
+  const char *tlbSpec = NULL;
+  const char *pageMapName = NULL;
+  //true if any option giving a param of a new cache was specified
+  bool isNewParams = false;
   int i;
   for (i = 1; i < argc && argv[i][0] == '-'; i++) {
     if (strcmp(argv[i], "-v") == 0) {
       isVerbose = true;
     }
+    else if (strcmp(argv[i], "-o") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "-o requires results file additional argument\n");
+      }
+      resultsPath = argv[++i];
+    }
+    else if (get_stats_out(argv[i]) >= 0) {
+      if (i >= argc - 1) {
+        usage(program, "stats option requires file additional argument\n");
+      }
+      int k = get_stats_out(argv[i]);
+      statsPaths[k] = argv[++i];
+    }
+    else if (strcmp(argv[i], "--sample") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--sample requires K additional argument\n");
+      }
+      char *p;
+      sampleBits = strtol(argv[++i], &p, 10);
+      if (sampleBits < 0 || *p != '\0') {
+        usage(program, "sample K must be a non-negative integer\n");
+      }
+    }
+    else if (strcmp(argv[i], "--sweep") == 0) {
+      isSweep = true;
+    }
     else if (strcmp(argv[i], "-r") == 0) {
+      isNewParams = true;
       if (i >= argc - 1) {
-        usage(program, "-r requires lru|mru|rand additional argument\n");
+        usage(program, "-r requires replacement additional argument\n");
       }
       replacement = get_replacement(argv[++i]);
       if (replacement < 0) {
-        usage(program, "replacement must be lru|mru|rand\n");
+        usage(program, "replacement must be " REPLACEMENT_NAMES "\n");
+      }
+    }
+    else if (strcmp(argv[i], "-f") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "-f requires format additional argument\n");
+      }
+      format = get_trace_format(argv[++i]);
+      if (format < 0) {
+        usage(program, "trace format must be " TRACE_FORMAT_NAMES "\n");
+      }
+    }
+    else if (strcmp(argv[i], "-w") == 0) {
+      isNewParams = true;
+      if (i >= argc - 1) {
+        usage(program, "-w requires write policy additional argument\n");
+      }
+      writePolicy = get_write_policy(argv[++i]);
+      if (writePolicy < 0) {
+        usage(program, "write policy must be back|through\n");
+      }
+    }
+    else if (strcmp(argv[i], "-a") == 0) {
+      isNewParams = true;
+      if (i >= argc - 1) {
+        usage(program, "-a requires allocate policy additional argument\n");
+      }
+      allocatePolicy = get_allocate_policy(argv[++i]);
+      if (allocatePolicy < 0) {
+        usage(program, "allocate policy must be allocate|no-allocate\n");
+      }
+    }
+    else if (strcmp(argv[i], "-p") == 0) {
+      isNewParams = true;
+      if (i >= argc - 1) {
+        usage(program, "-p requires prefetcher additional argument\n");
+      }
+      prefetch = get_prefetch(argv[++i]);
+      if (prefetch < 0) {
+        usage(program, "prefetcher must be " PREFETCH_NAMES "\n");
       }
     }
     else if (strcmp(argv[i], "-s") == 0) {
+      isNewParams = true;
       if (i >= argc - 1) {
         usage(program, "-s requires seed additional argument\n");
       }
@@ -154,21 +685,206 @@ main(int argc, const char *argv[])
         usage(program, "seed must be a non-negative integer\n");
       }
     }
+    else if (strcmp(argv[i], "--limit") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--limit requires N additional argument\n");
+      }
+      char *p;
+      const char *arg = argv[++i];
+      limit = strtoul(arg, &p, 10);
+      if (arg[0] == '-' || p == arg || *p != '\0') {
+        usage(program, "limit N must be a non-negative integer\n");
+      }
+    }
+    else if (strcmp(argv[i], "--page") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--page requires size additional argument\n");
+      }
+      int nPageBits = get_page_bits(argv[++i]);
+      if (nPageBits < 0) {
+        usage(program, "page size must be " PAGE_SIZE_NAMES "\n");
+      }
+      tlbParams.nPageBits = nPageBits;
+    }
+    else if (strcmp(argv[i], "--tlb") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--tlb requires TLB spec additional argument\n");
+      }
+      tlbSpec = argv[++i];
+      if (!get_tlb_levels(tlbSpec, &tlbParams)) {
+        usage(program, "invalid TLB spec\n");
+      }
+    }
+    else if (strcmp(argv[i], "--page-map") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--page-map requires map additional argument\n");
+      }
+      pageMapName = argv[++i];
+      int pageMap = get_page_map(pageMapName);
+      if (pageMap < 0) {
+        usage(program, "page map must be " PAGE_MAP_NAMES "\n");
+      }
+      tlbParams.pageMap = pageMap;
+    }
+    else if (strcmp(argv[i], "--save") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--save requires snapshot additional argument\n");
+      }
+      savePath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--load") == 0 ||
+             strcmp(argv[i], "--resume") == 0) {
+      isResume = strcmp(argv[i], "--resume") == 0;
+      if (i >= argc - 1) {
+        usage(program, isResume
+              ? "--resume requires snapshot additional argument\n"
+              : "--load requires snapshot additional argument\n");
+      }
+      loadPath = argv[++i];
+    }
     else {
       usage(program, "invalid option\n");
     }
   }
-  if (i != argc - 1) {
+  if (loadPath) {
+    if (i != argc || isNewParams) {
+      usage(program, "--load and --resume take all cache params "
+            "from the snapshot\n");
+    }
+  }
+  else if (i != argc - 1) {
     usage(program, "cache spec s-E-b-m required\n");
   }
 
-  srand(seed);
   const char *paramsSpec = argv[i];
 
-  unsigned nMemAddrBits;
-  CacheSim *cacheSim = make_cache_sim(paramsSpec, replacement, &nMemAddrBits);
-  if (!cacheSim) usage(program, "invalid cache params\n");
-  do_cache_sim(cacheSim, isVerbose, nMemAddrBits, stdin, stdout);
+  bool isStats = false;
+  for (int k = 0; k < N_STATS_OUTS; k++) isStats = isStats || statsPaths[k];
+  bool isOutputs = isVerbose || resultsPath || isStats;
+  bool isTranslated = tlbParams.nPageBits > 0;
+  if ((tlbSpec || pageMapName) && !isTranslated) {
+    usage(program, "--tlb and --page-map require --page\n");
+  }
+  if (isTranslated && !tlbSpec) get_tlb_levels(DEFAULT_TLB_SPEC, &tlbParams);
+
+  if (isSweep) {
+    CacheParams params = { .replacement = replacement };
+    unsigned minSetBits;
+    if (replacement != LRU_R || isOutputs || sampleBits >= 0 ||
+        prefetch != NO_PREFETCH || savePath || loadPath ||
+        limit != ULONG_MAX || isTranslated) {
+      usage(program, "--sweep only supports lru without other outputs "
+            "or --page\n");
+    }
+    if (!get_sweep_params(paramsSpec, &params, &minSetBits)) {
+      usage(program, "invalid sweep params\n");
+    }
+    Trace *trace = new_threaded_trace(stdin, format);
+    do_sweep(&params, minSetBits, trace, stdout);
+    free_trace(trace);
+    return 0;
+  }
+
+  CacheParams params;
+  CacheSim *cacheSim;
+  //# of accesses of the trace seen by the cache before this run
+  unsigned long position = 0;
+  if (loadPath) {
+    cacheSim = cache_sim_load(loadPath, &position);
+    cache_sim_params(cacheSim, &params);
+  }
+  else {
+    if (prefetch != NO_PREFETCH && replacement == OPT_R) {
+      usage(program, "prefetching does not support opt\n");
+    }
+    cacheSim = make_cache_sim(paramsSpec, replacement, writePolicy,
+                              allocatePolicy, prefetch, &params);
+    if (!cacheSim) usage(program, "invalid cache params\n");
+    cache_sim_seed(cacheSim, seed);
+  }
+  if ((savePath || loadPath) && params.replacement == OPT_R) {
+    usage(program, "snapshots do not support opt\n");
+  }
+  //the TLB and page table are not part of a snapshot
+  if ((savePath || loadPath) && isTranslated) {
+    usage(program, "snapshots do not support --page\n");
+  }
+  Translator xlate = { .tlb = NULL, .paddrs = NULL, .nMax = 0 };
+  if (isTranslated) {
+    if (tlbParams.nPageBits >= params.nMemAddrBits) {
+      usage(program, "pages must be smaller than memory of 2**m bytes\n");
+    }
+    tlbParams.nPhysAddrBits = params.nMemAddrBits;
+    tlbParams.seed = seed;
+    xlate.tlb = new_tlb_sim(&tlbParams);
+  }
+  TraceWindow window = {
+    .nSkip = isResume ? position : 0, .nLimit = limit, .nSimulated = 0,
+  };
+  if (sampleBits >= 0) {
+    if (sampleBits > params.nSetBits || params.replacement == OPT_R ||
+        isOutputs || format == RW_TRACE ||
+        params.prefetch != NO_PREFETCH || savePath) {
+      usage(program, "--sample requires K <= s and no opt, rw trace, "
+            "prefetcher, snapshot or other outputs\n");
+    }
+    Trace *trace = new_threaded_trace(stdin, format);
+    do_sampled_sim(cacheSim, &params, sampleBits, trace, &window, &xlate,
+                   stdout);
+    free_trace(trace);
+    if (xlate.tlb) {
+      out_tlb_stats(xlate.tlb, &tlbParams, stdout);
+      free_tlb_sim(xlate.tlb);
+      free(xlate.paddrs);
+    }
+    free_cache_sim(cacheSim);
+    return 0;
+  }
+  ResultOuts outs = { .writers = { NULL, NULL }, .cacheStats = NULL };
+  for (int k = 0; k < N_STATS_OUTS; k++) {
+    if (statsPaths[k] && !outs.cacheStats) {
+      outs.cacheStats = new_cache_stats(&params);
+    }
+  }
+  if (isVerbose) {
+    fflush(stdout);
+    outs.writers[VERBOSE_OUT] =
+      new_result_writer(STDOUT_FILENO, TEXT_RESULTS, params.nMemAddrBits);
+  }
+  int resultsFd = -1;
+  if (resultsPath) {
+    resultsFd = open(resultsPath, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (resultsFd < 0) {
+      fatal("cannot open %s: %s", resultsPath, strerror(errno));
+    }
+    outs.writers[BIN_OUT] =
+      new_result_writer(resultsFd, BIN_RESULTS, params.nMemAddrBits);
+  }
+  Trace *trace = new_threaded_trace(stdin, format);
+  do_cache_sim(cacheSim, &params, &outs, trace, &window, &xlate, stdout);
+  free_trace(trace);
+  if (xlate.tlb) {
+    out_tlb_stats(xlate.tlb, &tlbParams, stdout);
+    free_tlb_sim(xlate.tlb);
+    free(xlate.paddrs);
+  }
+  if (savePath) {
+    cache_sim_save(cacheSim, position + window.nSimulated, savePath);
+  }
+  for (int k = 0; k < N_OUTS; k++) {
+    if (outs.writers[k]) free_result_writer(outs.writers[k]);
+  }
+  if (outs.cacheStats) {
+    for (int k = 0; k < N_STATS_OUTS; k++) {
+      if (statsPaths[k]) {
+        out_stats_file(statsPaths[k], outs.cacheStats, STATS_OUTS[k].out_fn);
+      }
+    }
+    free_cache_stats(outs.cacheStats);
+  }
+  if (resultsFd >= 0 && close(resultsFd) < 0) {
+    fatal("cannot close %s: %s", resultsPath, strerror(errno));
+  }
   free_cache_sim(cacheSim);
   return 0;
 
@@ -0,0 +1,55 @@
+#include "next-use.h"
+
+#include "memalloc.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+/** Map from line address to the position of its most recent access,
+ *  using open addressing with linear probing.
+ */
+typedef struct {
+  MemAddr line;
+  unsigned long pos;     /** ULONG_MAX if slot unused */
+} Entry;
+
+static inline size_t
+hash_line(MemAddr line, size_t mask)
+{
+  return (line * 0x9E3779B97F4A7C15UL) >> 17 & mask;
+}
+
+/** Lookahead pass over a whole trace for Belady's OPT_R replacement.
+ *  Return a newly allocated array nextUses[n] where nextUses[i] is the
+ *  smallest j > i such that addrs[j] is in the same line as addrs[i]
+ *  for a cache with params->nLineBits and params->nMemAddrBits, or
+ *  ULONG_MAX if there is no such j.  nextUses[i] should be passed to
+ *  cache_sim_next_use() before simulating addrs[i].
+ */
+unsigned long *
+next_uses(const MemAddr addrs[], size_t n, const CacheParams *params)
+{
+  MemAddr addrMask = (params->nMemAddrBits >= 64)
+    ? ~0UL : (1UL << params->nMemAddrBits) - 1;
+  unsigned long *nextUses = mallocChk((n == 0 ? 1 : n) * sizeof(unsigned long));
+  // table at least twice the # of accesses, so at most half full
+  size_t nEntries = 16;
+  while (nEntries < 2*n) nEntries *= 2;
+  Entry *table = mallocChk(nEntries * sizeof(Entry));
+  for (size_t i = 0; i < nEntries; i++) table[i].pos = ULONG_MAX;
+  size_t mask = nEntries - 1;
+  // scan backwards so each line's entry holds its next access
+  for (size_t i = n; i-- > 0; ) {
+    MemAddr line = (addrs[i] & addrMask) >> params->nLineBits;
+    size_t h;
+    for (h = hash_line(line, mask);
+         table[h].pos != ULONG_MAX && table[h].line != line;
+         h = (h + 1) & mask) {
+    }
+    nextUses[i] = table[h].pos;
+    table[h].line = line;
+    table[h].pos = i;
+  }
+  free(table);
+  return nextUses;
+}
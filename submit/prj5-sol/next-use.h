@@ -0,0 +1,18 @@
+#ifndef NEXT_USE_H_
+#define NEXT_USE_H_
+
+#include "cache-sim.h"
+
+#include <stddef.h>
+
+/** Lookahead pass over a whole trace for Belady's OPT_R replacement.
+ *  Return a newly allocated array nextUses[n] where nextUses[i] is the
+ *  smallest j > i such that addrs[j] is in the same line as addrs[i]
+ *  for a cache with params->nLineBits and params->nMemAddrBits, or
+ *  ULONG_MAX if there is no such j.  nextUses[i] should be passed to
+ *  cache_sim_next_use() before simulating addrs[i].
+ */
+unsigned long *next_uses(const MemAddr addrs[], size_t n,
+                         const CacheParams *params);
+
+#endif //ifndef NEXT_USE_H_
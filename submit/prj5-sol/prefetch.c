@@ -0,0 +1,192 @@
+#include "prefetch.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/****************************** Next line ******************************/
+
+/** Tagged next-line prefetch: a miss or the first use of a prefetched
+ *  line triggers a prefetch of the following line, so a sequential
+ *  run keeps one line ahead of its demand accesses.
+ */
+static size_t
+next_line_state_size(void)
+{
+  return 0;
+}
+
+static unsigned
+next_line_access(void *state, const PrefetchAccess *access, MemAddr lines[])
+{
+  if (!access->isMiss && !access->isPrefetchHit) return 0;
+  lines[0] = access->line + 1;
+  return 1;
+}
+
+static const Prefetcher NEXT_LINE_PREFETCHER = {
+  next_line_state_size, next_line_access,
+};
+
+/******************************* Stride ********************************/
+
+/** A direct-mapped table of REGION_LINES-line regions, each entry
+ *  remembering the last line accessed in its region and the stride
+ *  from the one before.  Once the same non-zero stride has been seen
+ *  STRIDE_CONFIDENT times in a row, every access prefetches the next
+ *  STRIDE_DEGREE lines along it.  A real stride prefetcher indexes by
+ *  the PC of the load instead of its region.
+ */
+enum {
+  REGION_LINE_BITS = 6,         /** 64 lines: 4 KiB pages for b = 6 */
+  N_STRIDE_ENTRIES = 256,
+  STRIDE_CONFIDENT = 2,
+  MAX_STRIDE_CONFIDENCE = 3,
+  STRIDE_DEGREE = 2,
+};
+
+typedef struct {
+  MemAddr region;               /** region # + 1, 0 if unused */
+  MemAddr lastLine;
+  long stride;
+  unsigned confidence;
+} StrideEntry;
+
+typedef struct {
+  StrideEntry entries[N_STRIDE_ENTRIES];
+} StrideState;
+
+static size_t
+stride_state_size(void)
+{
+  return sizeof(StrideState);
+}
+
+static unsigned
+stride_access(void *state, const PrefetchAccess *access, MemAddr lines[])
+{
+  StrideState *strides = state;
+  MemAddr region = (access->line >> REGION_LINE_BITS) + 1;
+  StrideEntry *entry = &strides->entries[region % N_STRIDE_ENTRIES];
+  if (entry->region != region) {
+    StrideEntry fresh = { region, access->line, 0, 0 };
+    *entry = fresh;
+    return 0;
+  }
+  long stride = (long)(access->line - entry->lastLine);
+  if (stride == 0) return 0;
+  if (stride == entry->stride) {
+    if (entry->confidence < MAX_STRIDE_CONFIDENCE) entry->confidence++;
+  }
+  else {
+    entry->stride = stride;
+    entry->confidence = 0;
+  }
+  entry->lastLine = access->line;
+  if (entry->confidence < STRIDE_CONFIDENT) return 0;
+  for (unsigned k = 0; k < STRIDE_DEGREE; k++) {
+    lines[k] = access->line + (k + 1) * stride;
+  }
+  return STRIDE_DEGREE;
+}
+
+static const Prefetcher STRIDE_PREFETCHER = {
+  stride_state_size, stride_access,
+};
+
+/******************************* Stream ********************************/
+
+/** Up to N_STREAMS streams of misses, replaced LRU.  A miss within
+ *  STREAM_WINDOW lines of the last line of a stream extends it; the
+ *  first extension fixes the stream's direction, and from then on
+ *  every extension prefetches the STREAM_DEGREE lines beyond it.
+ *  First uses of prefetched lines extend streams like misses, since
+ *  the prefetches hide the misses which would otherwise drive them.
+ */
+enum {
+  N_STREAMS = 16,
+  STREAM_WINDOW = 16,
+  STREAM_DEGREE = 4,
+};
+
+typedef struct {
+  MemAddr lastLine;
+  int direction;                /** +1 or -1, 0 until known */
+  unsigned long lastUse;        /** 0 if unused */
+} Stream;
+
+typedef struct {
+  unsigned long now;
+  Stream streams[N_STREAMS];
+} StreamState;
+
+static size_t
+stream_state_size(void)
+{
+  return sizeof(StreamState);
+}
+
+/** Return the stream which line extends, NULL if none */
+static Stream *
+find_stream(StreamState *state, MemAddr line)
+{
+  for (unsigned i = 0; i < N_STREAMS; i++) {
+    Stream *stream = &state->streams[i];
+    if (stream->lastUse == 0) continue;
+    long delta = (long)(line - stream->lastLine);
+    if (delta == 0 || delta > STREAM_WINDOW || delta < -STREAM_WINDOW) {
+      continue;
+    }
+    int direction = (delta > 0) ? 1 : -1;
+    if (stream->direction == 0 || stream->direction == direction) {
+      return stream;
+    }
+  }
+  return NULL;
+}
+
+static unsigned
+stream_access(void *state, const PrefetchAccess *access, MemAddr lines[])
+{
+  StreamState *streams = state;
+  if (!access->isMiss && !access->isPrefetchHit) return 0;
+  unsigned long now = ++streams->now;
+  Stream *stream = find_stream(streams, access->line);
+  if (!stream) {
+    stream = &streams->streams[0];
+    for (unsigned i = 1; i < N_STREAMS; i++) {
+      if (streams->streams[i].lastUse < stream->lastUse) {
+        stream = &streams->streams[i];
+      }
+    }
+    Stream fresh = { access->line, 0, now };
+    *stream = fresh;
+    return 0;
+  }
+  stream->direction = ((long)(access->line - stream->lastLine) > 0) ? 1 : -1;
+  stream->lastLine = access->line;
+  stream->lastUse = now;
+  for (unsigned k = 0; k < STREAM_DEGREE; k++) {
+    lines[k] = access->line + (long)(k + 1) * stream->direction;
+  }
+  return STREAM_DEGREE;
+}
+
+static const Prefetcher STREAM_PREFETCHER = {
+  stream_state_size, stream_access,
+};
+
+/** Return the prefetcher implementing prefetch, NULL for NO_PREFETCH */
+const Prefetcher *
+get_prefetcher(Prefetch prefetch)
+{
+  switch (prefetch) {
+  case NO_PREFETCH: return NULL;
+  case NEXT_LINE_PREFETCH: return &NEXT_LINE_PREFETCHER;
+  case STRIDE_PREFETCH: return &STRIDE_PREFETCHER;
+  case STREAM_PREFETCH: return &STREAM_PREFETCHER;
+  default:
+    assert(0);
+    return NULL;
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef PREFETCH_H_
+#define PREFETCH_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Pluggable hardware prefetchers used internally by cache-sim.
+ *
+ *  A prefetcher is shown the line address (addr >> b) of every demand
+ *  access and proposes lines to prefetch; the cache fills those which
+ *  are not already resident, without counting them as accesses.  Each
+ *  prefetcher keeps its own state in state_size() bytes owned by the
+ *  cache, which start out all zero.
+ *
+ *  Traces carry no program counters, so the stride prefetcher indexes
+ *  its table by the region of memory accessed rather than by PC.
+ */
+
+/** Max # of lines a prefetcher may propose for one access */
+enum { MAX_PREFETCH_LINES = 4 };
+
+/** A demand access as seen by a prefetcher */
+typedef struct {
+  MemAddr line;            /** line address: addr >> b within the low m bits */
+  bool isMiss;
+  bool isPrefetchHit;      /** first demand hit of a prefetched line */
+} PrefetchAccess;
+
+typedef struct {
+  /** # of bytes of state needed */
+  size_t (*state_size)(void);
+  /** set lines[] to the lines to prefetch after access and return
+   *  their #, at most MAX_PREFETCH_LINES
+   */
+  unsigned (*access)(void *state, const PrefetchAccess *access,
+                     MemAddr lines[]);
+} Prefetcher;
+
+/** Return the prefetcher implementing prefetch, NULL for NO_PREFETCH */
+const Prefetcher *get_prefetcher(Prefetch prefetch);
+
+#endif //ifndef PREFETCH_H_
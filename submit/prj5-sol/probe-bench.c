@@ -0,0 +1,132 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tag-probe.h"
+
+#include "memalloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Microbenchmark for the tag probes in tag-probe.h.  For each set
+ *  size E, searches N_SETS full sets of distinct tags with a mix of
+ *  hits at uniformly random positions and misses, and reports probes
+ *  per second for every implementation this CPU supports.  All
+ *  implementations must find the same lines.
+ */
+
+enum {
+  N_SETS = 4096,
+  DEFAULT_N_QUERIES = 20000000,
+  MAX_E = 1024,
+};
+
+static const unsigned DEFAULT_ES[] = { 4, 8, 16, 32 };
+
+static void
+usage(const char *program)
+{
+  fprintf(stderr, "usage: %s [-n N_QUERIES] [E...]\n"
+          "times each tag probe on sets of E lines (default 4 8 16 32)\n",
+          program);
+  exit(1);
+}
+
+/** xorshift64: fixed sequence so runs are comparable across builds */
+static unsigned long
+next_rand(unsigned long *state)
+{
+  unsigned long x = *state;
+  x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+  return *state = x;
+}
+
+static double
+now_secs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+/** A query looks for key in set # setNum */
+typedef struct {
+  unsigned setNum;
+  MemAddr key;
+} Query;
+
+static void
+bench_e(unsigned nLines, unsigned long nQueries, FILE *out)
+{
+  unsigned long state = 0x9E3779B97F4A7C15UL;
+  //tag j of set i is i*MAX_E + j scrambled, so tags within a set differ
+  MemAddr *tags = mallocChk((size_t)N_SETS * nLines * sizeof(MemAddr));
+  for (unsigned i = 0; i < N_SETS; i++) {
+    for (unsigned j = 0; j < nLines; j++) {
+      tags[(size_t)i*nLines + j] = (i*MAX_E + j) * 0x9E3779B97F4A7C15UL;
+    }
+  }
+  Query *queries = mallocChk(nQueries * sizeof(Query));
+  for (unsigned long q = 0; q < nQueries; q++) {
+    unsigned long r = next_rand(&state);
+    unsigned setNum = r % N_SETS;
+    unsigned line = (r >> 20) % nLines;
+    MemAddr key = tags[(size_t)setNum*nLines + line];
+    queries[q].setNum = setNum;
+    queries[q].key = (r >> 40) & 1 ? key : ~key;  //~key is never a tag
+  }
+  unsigned long expected = 0;
+  for (int kind = 0; kind < N_PROBES; kind++) {
+    TagProbe *probe = get_tag_probe(kind);
+    if (!probe) continue;
+    unsigned long sum = 0;
+    double t0 = now_secs();
+    for (unsigned long q = 0; q < nQueries; q++) {
+      const MemAddr *set = &tags[(size_t)queries[q].setNum * nLines];
+      sum += probe(set, nLines, queries[q].key);
+    }
+    double secs = now_secs() - t0;
+    if (kind == SCALAR_PROBE) {
+      expected = sum;
+    }
+    else if (sum != expected) {
+      fprintf(stderr, "%s probe disagrees with scalar for E=%u\n",
+              tag_probe_name(kind), nLines);
+      exit(1);
+    }
+    fprintf(out, "E=%-4u %-7s %lu probes %.3fs %.2f Mprobes/sec\n",
+            nLines, tag_probe_name(kind), nQueries, secs,
+            nQueries/secs/1e6);
+  }
+  free(queries);
+  free(tags);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  unsigned long nQueries = DEFAULT_N_QUERIES;
+  int i;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i < argc - 1) {
+      nQueries = strtoul(argv[++i], NULL, 10);
+    }
+    else {
+      usage(argv[0]);
+    }
+  }
+  if (nQueries == 0) usage(argv[0]);
+  if (i == argc) {
+    for (size_t k = 0; k < sizeof(DEFAULT_ES)/sizeof(DEFAULT_ES[0]); k++) {
+      bench_e(DEFAULT_ES[k], nQueries, stdout);
+    }
+  }
+  for (; i < argc; i++) {
+    char *p;
+    unsigned long nLines = strtoul(argv[i], &p, 10);
+    if (*p != '\0' || nLines == 0 || nLines > MAX_E) usage(argv[0]);
+    bench_e(nLines, nQueries, stdout);
+  }
+  return 0;
+}
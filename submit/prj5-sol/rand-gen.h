@@ -0,0 +1,66 @@
+#ifndef RAND_GEN_H_
+#define RAND_GEN_H_
+
+#include <stdint.h>
+
+/** A small, fast pseudo-random generator (O'Neill's PCG32: a 64-bit
+ *  LCG whose output is a permuted 32-bit word) for the randomized
+ *  replacement policies.  Each cache owns one, so simulations are
+ *  reproducible and independent of each other and of rand().
+ *
+ *  The functions are defined here so that they inline into the
+ *  replacement policies' miss paths.
+ */
+
+typedef struct {
+  uint64_t state;
+  uint64_t inc;            /** selects the stream; always odd */
+} RandGen;
+
+enum { RAND_GEN_STREAM = 0xCA5E };
+
+/** Return the next 32 random bits from gen */
+static inline uint32_t
+rand_gen_next(RandGen *gen)
+{
+  uint64_t old = gen->state;
+  gen->state = old * 6364136223846793005UL + gen->inc;
+  uint32_t xorShifted = ((old >> 18) ^ old) >> 27;
+  unsigned rot = old >> 59;
+  return (xorShifted >> rot) | (xorShifted << ((-rot) & 31));
+}
+
+/** Start gen on stream # stream at the position given by seed.
+ *  Different streams are independent sequences for the same seed.
+ */
+static inline void
+rand_gen_seed(RandGen *gen, uint64_t seed, uint64_t stream)
+{
+  gen->state = 0;
+  gen->inc = (stream << 1) | 1;
+  rand_gen_next(gen);
+  gen->state += seed;
+  rand_gen_next(gen);
+}
+
+/** Return a uniformly distributed random # in [0, bound), bound > 0.
+ *  Lemire's multiply-and-shift method: the top half of a 64-bit
+ *  product replaces the division of %, and the rare low products
+ *  which would bias the result are rejected.
+ */
+static inline uint32_t
+rand_gen_below(RandGen *gen, uint32_t bound)
+{
+  uint64_t product = (uint64_t)rand_gen_next(gen) * bound;
+  uint32_t low = product;
+  if (low < bound) {
+    uint32_t threshold = -bound % bound;
+    while (low < threshold) {
+      product = (uint64_t)rand_gen_next(gen) * bound;
+      low = product;
+    }
+  }
+  return product >> 32;
+}
+
+#endif //ifndef RAND_GEN_H_
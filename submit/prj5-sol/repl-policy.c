@@ -0,0 +1,401 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "repl-policy.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+static size_t
+even(size_t nWords)
+{
+  return (nWords + 1) & ~(size_t)1;
+}
+
+static void
+no_op_hit(const ReplSet *set, unsigned line)
+{
+}
+
+static void
+no_op_remove(const ReplSet *set, unsigned line, unsigned last)
+{
+}
+
+/************************ Recency-list policies ************************/
+
+/** LRU, MRU and FIFO keep the valid lines on a circular doubly linked
+ *  list threaded through prev[]/next[]:
+ *
+ *    [ head | prev[0..E) | next[0..E) ]
+ *
+ *  head is the most recently used (FIFO: most recently inserted) line
+ *  and prev[head] the least, which makes every update and victim
+ *  selection O(1).
+ */
+enum { HEAD_OFFSET, LIST_HEADER_WORDS };
+
+static size_t
+list_state_words(unsigned nLines)
+{
+  return even(LIST_HEADER_WORDS + 2 * nLines);
+}
+
+static inline unsigned *
+list_prev(const ReplSet *set)
+{
+  return set->state + LIST_HEADER_WORDS;
+}
+
+static inline unsigned *
+list_next(const ReplSet *set)
+{
+  return set->state + LIST_HEADER_WORDS + set->nLines;
+}
+
+/** Unlink line from set's list, which must contain other lines */
+static inline void
+list_unlink(const ReplSet *set, unsigned line)
+{
+  unsigned *prev = list_prev(set), *next = list_next(set);
+  next[prev[line]] = next[line];
+  prev[next[line]] = prev[line];
+  if (set->state[HEAD_OFFSET] == line) set->state[HEAD_OFFSET] = next[line];
+}
+
+/** Link line in at the head of set's list which has nOnList lines */
+static inline void
+list_link_head(const ReplSet *set, unsigned nOnList, unsigned line)
+{
+  unsigned *prev = list_prev(set), *next = list_next(set);
+  if (nOnList == 0) {
+    prev[line] = next[line] = line;
+  }
+  else {
+    unsigned head = set->state[HEAD_OFFSET];
+    unsigned tail = prev[head];
+    prev[line] = tail; next[line] = head;
+    next[tail] = line; prev[head] = line;
+  }
+  set->state[HEAD_OFFSET] = line;
+}
+
+/** Move line already on set's list to its head */
+static inline void
+list_touch(const ReplSet *set, unsigned line)
+{
+  if (set->state[HEAD_OFFSET] != line) {
+    list_unlink(set, line);
+    list_link_head(set, set->nValid, line);
+  }
+}
+
+static void
+list_insert(const ReplSet *set, unsigned line)
+{
+  if (line < set->nValid) {
+    list_touch(set, line);
+  }
+  else {
+    list_link_head(set, set->nValid, line);
+  }
+}
+
+static void
+list_remove(const ReplSet *set, unsigned line, unsigned last)
+{
+  unsigned *prev = list_prev(set), *next = list_next(set);
+  if (set->nValid > 1) list_unlink(set, line);
+  if (line != last) {
+    if (prev[last] == last) {
+      prev[line] = next[line] = line;
+    }
+    else {
+      prev[line] = prev[last]; next[line] = next[last];
+      next[prev[line]] = line; prev[next[line]] = line;
+    }
+    if (set->state[HEAD_OFFSET] == last) set->state[HEAD_OFFSET] = line;
+  }
+}
+
+static unsigned
+list_tail_victim(const ReplSet *set)
+{
+  return list_prev(set)[set->state[HEAD_OFFSET]];
+}
+
+static unsigned
+list_head_victim(const ReplSet *set)
+{
+  return set->state[HEAD_OFFSET];
+}
+
+static const ReplPolicy LRU_POLICY = {
+  list_state_words, list_touch, list_insert, list_tail_victim, list_remove,
+};
+
+static const ReplPolicy MRU_POLICY = {
+  list_state_words, list_touch, list_insert, list_head_victim, list_remove,
+};
+
+/** FIFO ignores hits, so its list is in order of insertion */
+static const ReplPolicy FIFO_POLICY = {
+  list_state_words, no_op_hit, list_insert, list_tail_victim, list_remove,
+};
+
+/******************************* Random ********************************/
+
+static size_t
+no_state_words(unsigned nLines)
+{
+  return 0;
+}
+
+static unsigned
+random_victim(const ReplSet *set)
+{
+  return rand_gen_below(set->rand, set->nLines);
+}
+
+static const ReplPolicy RANDOM_POLICY = {
+  no_state_words, no_op_hit, no_op_hit, random_victim, no_op_remove,
+};
+
+/***************************** Tree PLRU *******************************/
+
+/** Tree pseudo-LRU keeps one bit per internal node of a binary tree
+ *  whose leaves are the lines, padded to a power of 2.  Nodes are
+ *  numbered heap-style from 1 at the root; a node's bit is 1 if the
+ *  victim search should go right.  Accessing a line points every node
+ *  on its path away from it.  When E is not a power of 2, searches
+ *  never descend into a subtree containing no lines.
+ */
+static unsigned
+plru_n_leaves(unsigned nLines)
+{
+  unsigned n = 1;
+  while (n < nLines) n <<= 1;
+  return n;
+}
+
+static size_t
+plru_state_words(unsigned nLines)
+{
+  return even((plru_n_leaves(nLines) + 31) / 32);
+}
+
+static void
+plru_touch(const ReplSet *set, unsigned line)
+{
+  unsigned *bits = set->state;
+  unsigned lo = 0, hi = plru_n_leaves(set->nLines);
+  for (unsigned node = 1; hi - lo > 1; ) {
+    unsigned mid = lo + (hi - lo)/2;
+    unsigned mask = 1u << (node % 32);
+    if (line < mid) {
+      bits[node/32] |= mask;
+      hi = mid; node = 2*node;
+    }
+    else {
+      bits[node/32] &= ~mask;
+      lo = mid; node = 2*node + 1;
+    }
+  }
+}
+
+static unsigned
+plru_victim(const ReplSet *set)
+{
+  const unsigned *bits = set->state;
+  unsigned lo = 0, hi = plru_n_leaves(set->nLines);
+  for (unsigned node = 1; hi - lo > 1; ) {
+    unsigned mid = lo + (hi - lo)/2;
+    bool isRight = (bits[node/32] >> (node % 32)) & 1;
+    if (isRight && mid < set->nLines) {
+      lo = mid; node = 2*node + 1;
+    }
+    else {
+      hi = mid; node = 2*node;
+    }
+  }
+  return lo;
+}
+
+/** Tree bits are left as they are: a moved line inherits its new
+ *  slot's approximate age.
+ */
+static const ReplPolicy PLRU_POLICY = {
+  plru_state_words, plru_touch, plru_touch, plru_victim, no_op_remove,
+};
+
+/****************************** RRIP ***********************************/
+
+/** Re-reference interval prediction (Jaleel et al., ISCA 2010) with a
+ *  2-bit re-reference prediction value (RRPV) per line kept in a byte.
+ *  Hits predict near-immediate re-reference (RRPV 0).  SRRIP inserts
+ *  with a long interval (RRPV_MAX - 1); BRRIP inserts with a distant
+ *  interval (RRPV_MAX) except for 1 in BRRIP_LONG_ODDS insertions.
+ *  The victim is the first line with RRPV_MAX after aging all lines
+ *  until one exists.
+ */
+enum { RRPV_MAX = 3, BRRIP_LONG_ODDS = 32 };
+
+static size_t
+rrip_state_words(unsigned nLines)
+{
+  return even((nLines + sizeof(unsigned) - 1) / sizeof(unsigned));
+}
+
+static void
+rrip_hit(const ReplSet *set, unsigned line)
+{
+  ((unsigned char *)set->state)[line] = 0;
+}
+
+static void
+srrip_insert(const ReplSet *set, unsigned line)
+{
+  ((unsigned char *)set->state)[line] = RRPV_MAX - 1;
+}
+
+static void
+brrip_insert(const ReplSet *set, unsigned line)
+{
+  bool isLong = rand_gen_below(set->rand, BRRIP_LONG_ODDS) == 0;
+  ((unsigned char *)set->state)[line] = isLong ? RRPV_MAX - 1 : RRPV_MAX;
+}
+
+static unsigned
+rrip_victim(const ReplSet *set)
+{
+  unsigned char *rrpv = (unsigned char *)set->state;
+  unsigned victim = 0;
+  for (unsigned i = 1; i < set->nLines; i++) {
+    if (rrpv[i] > rrpv[victim]) victim = i;
+  }
+  unsigned age = RRPV_MAX - rrpv[victim];
+  if (age > 0) {
+    for (unsigned i = 0; i < set->nLines; i++) rrpv[i] += age;
+  }
+  return victim;
+}
+
+static void
+rrip_remove(const ReplSet *set, unsigned line, unsigned last)
+{
+  unsigned char *rrpv = (unsigned char *)set->state;
+  rrpv[line] = rrpv[last];
+}
+
+static const ReplPolicy SRRIP_POLICY = {
+  rrip_state_words, rrip_hit, srrip_insert, rrip_victim, rrip_remove,
+};
+
+static const ReplPolicy BRRIP_POLICY = {
+  rrip_state_words, rrip_hit, brrip_insert, rrip_victim, rrip_remove,
+};
+
+/******************************* LFU ***********************************/
+
+/** Least frequently used: a saturating access count per line; the
+ *  victim is the lowest-numbered line with the smallest count.
+ */
+static size_t
+lfu_state_words(unsigned nLines)
+{
+  return even(nLines);
+}
+
+static void
+lfu_hit(const ReplSet *set, unsigned line)
+{
+  if (set->state[line] < UINT_MAX) set->state[line]++;
+}
+
+static void
+lfu_insert(const ReplSet *set, unsigned line)
+{
+  set->state[line] = 1;
+}
+
+static unsigned
+lfu_victim(const ReplSet *set)
+{
+  unsigned victim = 0;
+  for (unsigned i = 1; i < set->nLines; i++) {
+    if (set->state[i] < set->state[victim]) victim = i;
+  }
+  return victim;
+}
+
+static void
+lfu_remove(const ReplSet *set, unsigned line, unsigned last)
+{
+  set->state[line] = set->state[last];
+}
+
+static const ReplPolicy LFU_POLICY = {
+  lfu_state_words, lfu_hit, lfu_insert, lfu_victim, lfu_remove,
+};
+
+/******************************* OPT ***********************************/
+
+/** Belady's offline optimal policy: each line records the trace
+ *  position of its next access (supplied by the caller through
+ *  cache_sim_next_use()) and the victim is the line used furthest in
+ *  the future.
+ */
+static size_t
+opt_state_words(unsigned nLines)
+{
+  return nLines * sizeof(unsigned long) / sizeof(unsigned);
+}
+
+static void
+opt_access(const ReplSet *set, unsigned line)
+{
+  ((unsigned long *)set->state)[line] = set->nextUse;
+}
+
+static unsigned
+opt_victim(const ReplSet *set)
+{
+  const unsigned long *nextUse = (const unsigned long *)set->state;
+  unsigned victim = 0;
+  for (unsigned i = 1; i < set->nLines; i++) {
+    if (nextUse[i] > nextUse[victim]) victim = i;
+  }
+  return victim;
+}
+
+static void
+opt_remove(const ReplSet *set, unsigned line, unsigned last)
+{
+  unsigned long *nextUse = (unsigned long *)set->state;
+  nextUse[line] = nextUse[last];
+}
+
+static const ReplPolicy OPT_POLICY = {
+  opt_state_words, opt_access, opt_access, opt_victim, opt_remove,
+};
+
+/** Return the policy implementing replacement */
+const ReplPolicy *
+get_repl_policy(Replacement replacement)
+{
+  switch (replacement) {
+  case LRU_R: return &LRU_POLICY;
+  case MRU_R: return &MRU_POLICY;
+  case RANDOM_R: return &RANDOM_POLICY;
+  case FIFO_R: return &FIFO_POLICY;
+  case LFU_R: return &LFU_POLICY;
+  case PLRU_R: return &PLRU_POLICY;
+  case SRRIP_R: return &SRRIP_POLICY;
+  case BRRIP_R: return &BRRIP_POLICY;
+  case OPT_R: return &OPT_POLICY;
+  default:
+    assert(0);
+    return NULL;
+  }
+}
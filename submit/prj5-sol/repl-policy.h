@@ -0,0 +1,49 @@
+#ifndef REPL_POLICY_H_
+#define REPL_POLICY_H_
+
+#include "cache-sim.h"
+#include "rand-gen.h"
+
+#include <stddef.h>
+
+/** Pluggable replacement policies used internally by cache-sim.
+ *
+ *  Each policy keeps its own per-set state in a region of
+ *  state_words(nLines) unsigned words within the set's block.  The
+ *  cache keeps the valid lines of a set in slots [0, nValid) and tells
+ *  the policy about every change through the operations below.
+ */
+
+/** The set a policy operation applies to */
+typedef struct {
+  unsigned *state;          /** this set's policy state, 8-byte aligned */
+  unsigned nLines;          /** # of lines in the set (E) */
+  unsigned nValid;          /** # of valid lines before the operation */
+  RandGen *rand;            /** cache's generator */
+  unsigned long nextUse;    /** trace position of the next access to the
+                             *  line being accessed (OPT_R only) */
+} ReplSet;
+
+typedef struct {
+  /** # of words of per-set state needed for a set of nLines lines.
+   *  Must be even; state starts out all zero.
+   */
+  size_t (*state_words)(unsigned nLines);
+  /** valid line has just been hit */
+  void (*hit)(const ReplSet *set, unsigned line);
+  /** a new line is being placed into slot line: either the free slot
+   *  nValid or the victim just returned by victim()
+   */
+  void (*insert)(const ReplSet *set, unsigned line);
+  /** return victim line of a full set */
+  unsigned (*victim)(const ReplSet *set);
+  /** valid line is being invalidated and the line in slot last
+   *  (== nValid - 1) moved into its slot
+   */
+  void (*remove)(const ReplSet *set, unsigned line, unsigned last);
+} ReplPolicy;
+
+/** Return the policy implementing replacement */
+const ReplPolicy *get_repl_policy(Replacement replacement);
+
+#endif //ifndef REPL_POLICY_H_
@@ -0,0 +1,132 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "result-out.h"
+
+#include "errors.h"
+#include "memalloc.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+  BUF_SIZE = 1 << 16,           /** # of bytes buffered between writes */
+  MAX_HEX_DIGITS = 16,
+  /** longest TEXT_RESULTS line: 2 addresses + ": miss-with-replace \n" */
+  MAX_RECORD_SIZE = 2*MAX_HEX_DIGITS + 32,
+  ADDR_BYTES = 8,
+};
+
+struct ResultWriterImpl {
+  int fd;
+  ResultFormat format;
+  unsigned addrWidth;           /** min # of hex digits in an address */
+  size_t n;                     /** # of bytes in buf */
+  unsigned char buf[BUF_SIZE];
+};
+
+//status strings, each followed by the separator for what comes next;
+//must be in sync with CACHE_STATUS enum
+static const struct {
+  const char *str;
+  size_t len;
+} STATUS_OUTS[] = {
+  { "hit\n", 4 },
+  { "miss-without-replace\n", 21 },
+  { "miss-with-replace ", 18 },
+};
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+/** Return a new writer which writes results encoded as format to file
+ *  descriptor fd for a cache with nMemAddrBits-bit addresses.
+ */
+ResultWriter *
+new_result_writer(int fd, ResultFormat format, unsigned nMemAddrBits)
+{
+  ResultWriter *writer = mallocChk(sizeof(ResultWriter));
+  writer->fd = fd;
+  writer->format = format;
+  writer->addrWidth = (nMemAddrBits + 3)/4;
+  writer->n = 0;
+  return writer;
+}
+
+/** Write out everything buffered by writer */
+void
+flush_result_writer(ResultWriter *writer)
+{
+  const unsigned char *p = writer->buf;
+  size_t n = writer->n;
+  while (n > 0) {
+    ssize_t nWritten = write(writer->fd, p, n);
+    if (nWritten < 0) {
+      if (errno == EINTR) continue;
+      fatal("cannot write results: %s", strerror(errno));
+    }
+    p += nWritten;
+    n -= nWritten;
+  }
+  writer->n = 0;
+}
+
+/** Format addr at p as "%0*lx" with width addrWidth; return the end */
+static inline unsigned char *
+put_hex(unsigned char *p, MemAddr addr, unsigned addrWidth)
+{
+  unsigned nDigits = (addr == 0) ? 1 : (67 - __builtin_clzl(addr))/4;
+  if (nDigits < addrWidth) nDigits = addrWidth;
+  for (unsigned i = nDigits; i > 0; i--) {
+    p[i - 1] = HEX_DIGITS[addr & 0xf];
+    addr >>= 4;
+  }
+  return p + nDigits;
+}
+
+static inline unsigned char *
+put_le64(unsigned char *p, uint64_t v)
+{
+  for (int j = 0; j < ADDR_BYTES; j++) *p++ = v >> (8*j);
+  return p;
+}
+
+/** Append the results[n] of simulating addrs[n] to writer */
+void
+write_results(ResultWriter *writer, const MemAddr addrs[],
+              const CacheResult results[], size_t n)
+{
+  unsigned addrWidth = writer->addrWidth;
+  for (size_t i = 0; i < n; i++) {
+    if (writer->n > BUF_SIZE - MAX_RECORD_SIZE) flush_result_writer(writer);
+    unsigned char *p = &writer->buf[writer->n];
+    CacheResult result = results[i];
+    if (writer->format == BIN_RESULTS) {
+      MemAddr replaceAddr =
+        (result.status == CACHE_MISS_WITH_REPLACE) ? result.replaceAddr : 0;
+      p = put_le64(p, addrs[i]);
+      p = put_le64(p, replaceAddr | result.status);
+    }
+    else {
+      p = put_hex(p, addrs[i], addrWidth);
+      *p++ = ':';
+      *p++ = ' ';
+      memcpy(p, STATUS_OUTS[result.status].str, STATUS_OUTS[result.status].len);
+      p += STATUS_OUTS[result.status].len;
+      if (result.status == CACHE_MISS_WITH_REPLACE) {
+        p = put_hex(p, result.replaceAddr, addrWidth);
+        *p++ = '\n';
+      }
+    }
+    writer->n = p - writer->buf;
+  }
+}
+
+/** Flush and free writer.  Does not close the fd it was created with. */
+void
+free_result_writer(ResultWriter *writer)
+{
+  flush_result_writer(writer);
+  free(writer);
+}
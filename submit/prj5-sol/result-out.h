@@ -0,0 +1,45 @@
+#ifndef RESULT_OUT_H_
+#define RESULT_OUT_H_
+
+#include "cache-sim.h"
+
+#include <stddef.h>
+
+/** Encoding used for per-access simulation results */
+typedef enum {
+  /** One "ADDR: STATUS[ REPLACE_ADDR]\n" line per access exactly as
+   *  printf("%0*lx", (m + 3)/4, ...) would format the addresses, with
+   *  STATUS one of hit, miss-without-replace or miss-with-replace.
+   */
+  TEXT_RESULTS,
+  /** One 16-byte record per access: the little-endian 64-bit address
+   *  followed by the little-endian 64-bit value replaceAddr | status
+   *  where status is the CacheStatus and replaceAddr is 0 unless status
+   *  is CACHE_MISS_WITH_REPLACE.  Since replaceAddr is the address of a
+   *  line and b >= 2, status never overlaps it.
+   */
+  BIN_RESULTS,
+} ResultFormat;
+
+/** Opaque per-access result writer */
+typedef struct ResultWriterImpl ResultWriter;
+
+/** Return a new writer which writes results encoded as format to file
+ *  descriptor fd for a cache with nMemAddrBits-bit addresses.  Output
+ *  is accumulated in a large buffer which is flushed using write(2),
+ *  so anything written to fd through stdio must be flushed first.
+ */
+ResultWriter *new_result_writer(int fd, ResultFormat format,
+                                unsigned nMemAddrBits);
+
+/** Append the results[n] of simulating addrs[n] to writer */
+void write_results(ResultWriter *writer, const MemAddr addrs[],
+                   const CacheResult results[], size_t n);
+
+/** Write out everything buffered by writer */
+void flush_result_writer(ResultWriter *writer);
+
+/** Flush and free writer.  Does not close the fd it was created with. */
+void free_result_writer(ResultWriter *writer);
+
+#endif //ifndef RESULT_OUT_H_
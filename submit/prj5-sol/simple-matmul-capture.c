@@ -0,0 +1,20 @@
+#include "matmul.h"
+#include "trace-capture.h"
+
+/** lab11's simple-matmul.c, instrumented for trace capture */
+
+void
+matrix_multiply(int n, double a[][n], double b[][n], double c[][n])
+{
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      TRACE_STORE(&c[i][j]);
+      c[i][j] = 0;
+      for (int k = 0; k < n; k++) {
+        TRACE_LOAD(&a[i][k]); TRACE_LOAD(&b[k][j]);
+        TRACE_LOAD(&c[i][j]); TRACE_STORE(&c[i][j]);
+        c[i][j] += a[i][k]*b[k][j];
+      }
+    }
+  }
+}
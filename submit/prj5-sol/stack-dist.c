@@ -0,0 +1,139 @@
+#include "stack-dist.h"
+
+#include "memalloc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** LRU stacks for a single set-index width */
+typedef struct {
+  MemAddr *stacks;        /** maxLines line addresses per set, MRU first */
+  unsigned *depths;       /** # of lines on each set's stack */
+  unsigned long *hist;    /** hist[d]: # of accesses found at depth d */
+} Level;
+
+struct StackDistImpl {
+  unsigned minSetBits;
+  unsigned maxSetBits;
+  unsigned maxLines;
+  unsigned nLineBits;
+  MemAddr addrMask;
+  unsigned long nAccesses;
+  Level levels[];         /** levels[s - minSetBits] */
+};
+
+/** Create and return a stack-distance analyzer covering LRU caches
+ *  with nSetBits in [minSetBits, params->nSetBits] and nLinesPerSet
+ *  in [1, params->nLinesPerSet].  params->nLineBits and
+ *  params->nMemAddrBits are shared by all those caches and
+ *  params->replacement is ignored.
+ */
+StackDist *
+new_stack_dist(const CacheParams *params, unsigned minSetBits)
+{
+  assert(minSetBits <= params->nSetBits && params->nLinesPerSet > 0);
+  unsigned nLevels = params->nSetBits - minSetBits + 1;
+  StackDist *stackDist =
+    callocChk(1, sizeof(StackDist) + nLevels * sizeof(Level));
+  stackDist->minSetBits = minSetBits;
+  stackDist->maxSetBits = params->nSetBits;
+  stackDist->maxLines = params->nLinesPerSet;
+  stackDist->nLineBits = params->nLineBits;
+  stackDist->addrMask = (params->nMemAddrBits >= 64)
+    ? ~0UL : (1UL << params->nMemAddrBits) - 1;
+  for (unsigned i = 0; i < nLevels; i++) {
+    size_t nSets = (size_t)1 << (minSetBits + i);
+    Level *level = &stackDist->levels[i];
+    level->stacks = mallocChk(nSets * stackDist->maxLines * sizeof(MemAddr));
+    level->depths = callocChk(nSets, sizeof(unsigned));
+    level->hist = callocChk(stackDist->maxLines, sizeof(unsigned long));
+  }
+  return stackDist;
+}
+
+/** Free all resources used by stackDist */
+void
+free_stack_dist(StackDist *stackDist)
+{
+  unsigned nLevels = stackDist->maxSetBits - stackDist->minSetBits + 1;
+  for (unsigned i = 0; i < nLevels; i++) {
+    free(stackDist->levels[i].stacks);
+    free(stackDist->levels[i].depths);
+    free(stackDist->levels[i].hist);
+  }
+  free(stackDist);
+}
+
+/** Record an access to line in level whose sets are selected by setMask.
+ *  Lines deeper than maxLines can never hit in any of the caches being
+ *  modeled, so each stack is truncated at maxLines entries.
+ */
+static inline void
+level_access(Level *level, unsigned maxLines, MemAddr setMask, MemAddr line)
+{
+  size_t setNum = line & setMask;
+  MemAddr *stack = &level->stacks[setNum * maxLines];
+  unsigned depth = level->depths[setNum];
+  unsigned d;
+  for (d = 0; d < depth; d++) {
+    if (stack[d] == line) break;
+  }
+  if (d < depth) {
+    level->hist[d]++;
+  }
+  else if (depth < maxLines) {
+    level->depths[setNum]++;
+  }
+  else {
+    d = maxLines - 1;  //drop LRU line off bottom of stack
+  }
+  memmove(&stack[1], &stack[0], d * sizeof(MemAddr));
+  stack[0] = line;
+}
+
+/** Feed addrs[n] through stackDist */
+void
+stack_dist_addrs(StackDist *stackDist, const MemAddr addrs[], unsigned long n)
+{
+  unsigned nLevels = stackDist->maxSetBits - stackDist->minSetBits + 1;
+  unsigned maxLines = stackDist->maxLines;
+  for (unsigned long i = 0; i < n; i++) {
+    MemAddr line = (addrs[i] & stackDist->addrMask) >> stackDist->nLineBits;
+    for (unsigned j = 0; j < nLevels; j++) {
+      MemAddr setMask = ((MemAddr)1 << (stackDist->minSetBits + j)) - 1;
+      level_access(&stackDist->levels[j], maxLines, setMask, line);
+    }
+  }
+  stackDist->nAccesses += n;
+}
+
+/** Set stats[] (indexed by CacheStatus) to the counts an LRU cache
+ *  with nSetBits and nLinesPerSet from params would have produced for
+ *  all the addresses seen so far by stackDist.  Both must be within
+ *  the ranges stackDist was created with.
+ */
+void
+stack_dist_stats(const StackDist *stackDist, const CacheParams *params,
+                 unsigned long stats[CACHE_N_STATUS])
+{
+  unsigned nSetBits = params->nSetBits;
+  unsigned nLines = params->nLinesPerSet;
+  assert(stackDist->minSetBits <= nSetBits &&
+         nSetBits <= stackDist->maxSetBits);
+  assert(0 < nLines && nLines <= stackDist->maxLines);
+  const Level *level = &stackDist->levels[nSetBits - stackDist->minSetBits];
+  unsigned long nHits = 0;
+  for (unsigned d = 0; d < nLines; d++) nHits += level->hist[d];
+  // a set's first E distinct lines fill its empty lines; a stack depth
+  // is its # of distinct lines (truncated at maxLines >= E)
+  unsigned long nFills = 0;
+  size_t nSets = (size_t)1 << nSetBits;
+  for (size_t i = 0; i < nSets; i++) {
+    unsigned depth = level->depths[i];
+    nFills += (depth < nLines) ? depth : nLines;
+  }
+  stats[CACHE_HIT] = nHits;
+  stats[CACHE_MISS_WITHOUT_REPLACE] = nFills;
+  stats[CACHE_MISS_WITH_REPLACE] = stackDist->nAccesses - nHits - nFills;
+}
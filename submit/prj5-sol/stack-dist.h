@@ -0,0 +1,39 @@
+#ifndef STACK_DIST_H_
+#define STACK_DIST_H_
+
+#include "cache-sim.h"
+
+/** Single-pass LRU simulation of many caches at once using Mattson
+ *  stack distances.  For each set-index width s in a range, every set
+ *  keeps an LRU stack of line addresses; an access at stack depth d is
+ *  a hit in every LRU cache with that s and more than d lines per set.
+ *  So one pass over a trace yields results for all E up to a maximum.
+ */
+
+/** Opaque implementation */
+typedef struct StackDistImpl StackDist;
+
+/** Create and return a stack-distance analyzer covering LRU caches
+ *  with nSetBits in [minSetBits, params->nSetBits] and nLinesPerSet
+ *  in [1, params->nLinesPerSet].  params->nLineBits and
+ *  params->nMemAddrBits are shared by all those caches and
+ *  params->replacement is ignored.
+ */
+StackDist *new_stack_dist(const CacheParams *params, unsigned minSetBits);
+
+/** Free all resources used by stackDist */
+void free_stack_dist(StackDist *stackDist);
+
+/** Feed addrs[n] through stackDist */
+void stack_dist_addrs(StackDist *stackDist, const MemAddr addrs[],
+                      unsigned long n);
+
+/** Set stats[] (indexed by CacheStatus) to the counts an LRU cache
+ *  with nSetBits and nLinesPerSet from params would have produced for
+ *  all the addresses seen so far by stackDist.  Both must be within
+ *  the ranges stackDist was created with.
+ */
+void stack_dist_stats(const StackDist *stackDist, const CacheParams *params,
+                      unsigned long stats[CACHE_N_STATUS]);
+
+#endif //ifndef STACK_DIST_H_
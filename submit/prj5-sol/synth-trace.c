@@ -0,0 +1,263 @@
+#include "synth-trace.h"
+
+#include "rand-gen.h"
+
+#include "memalloc.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+  ELEM_BYTES = 8,         /** size of every access: a double */
+  ITEM_BYTES = 64,        /** size of a Zipf item or chase node */
+  MATRIX_ALIGN = 4096,    /** matrices start on page boundaries */
+  MAX_MATRIX_SIZE = 1 << 14,
+};
+
+static const char *PATTERN_NAMES[] = {
+  "seq", "stride", "uniform", "zipf", "chase", "matmul", "tmatmul",
+};
+
+static const double DEFAULT_ARGS[] = { 0, 256, 0, 0.99, 0, 128, 128 };
+
+/** Parse spec of the form PATTERN[:ARG] into *params, setting the
+ *  default arg if it is omitted and leaving footprint and seed
+ *  alone.  Returns false on error.
+ */
+bool
+get_synth_params(const char *spec, SynthParams *params)
+{
+  const char *colon = strchr(spec, ':');
+  size_t len = colon ? colon - spec : strlen(spec);
+  int pattern;
+  for (pattern = 0; pattern < N_SYNTH_PATTERNS; pattern++) {
+    const char *name = PATTERN_NAMES[pattern];
+    if (strlen(name) == len && strncmp(spec, name, len) == 0) break;
+  }
+  if (pattern == N_SYNTH_PATTERNS) return false;
+  double arg = DEFAULT_ARGS[pattern];
+  if (colon) {
+    char *p;
+    arg = strtod(colon + 1, &p);
+    if (p == colon + 1 || *p != '\0') return false;
+  }
+  switch (pattern) {
+  case STRIDE_SYNTH:
+    if (arg < 1 || arg != floor(arg)) return false;
+    break;
+  case ZIPF_SYNTH:
+    if (!(arg > 0 && arg < 1)) return false;
+    break;
+  case MATMUL_SYNTH: case TRANSPOSE_MATMUL_SYNTH:
+    if (arg < 1 || arg > MAX_MATRIX_SIZE || arg != floor(arg)) return false;
+    break;
+  default:
+    if (colon) return false;
+    break;
+  }
+  params->pattern = pattern;
+  params->arg = arg;
+  return true;
+}
+
+/** Parse spec, a decimal # of bytes with an optional K, M or G suffix
+ *  (powers of 1024), into *bytesP.  Returns false on error.
+ */
+bool
+get_synth_bytes(const char *spec, unsigned long *bytesP)
+{
+  char *p;
+  if (spec[0] < '0' || spec[0] > '9') return false;
+  unsigned long bytes = strtoul(spec, &p, 10);
+  unsigned shift = 0;
+  switch (*p) {
+  case 'K': shift = 10; p++; break;
+  case 'M': shift = 20; p++; break;
+  case 'G': shift = 30; p++; break;
+  }
+  if (*p != '\0' || bytes == 0 || bytes > (ULONG_MAX >> shift)) return false;
+  *bytesP = bytes << shift;
+  return true;
+}
+
+/** Where the accesses go */
+typedef struct {
+  MemAddr *addrs;
+  AccessOp *ops;
+  size_t n;
+  size_t i;               /** # of accesses emitted so far */
+} Emitter;
+
+/** Emit an access of kind to addr; return false once there are n */
+static inline bool
+emit(Emitter *e, MemAddr addr, AccessKind kind)
+{
+  AccessOp op = { kind, 0, ELEM_BYTES };
+  e->addrs[e->i] = addr;
+  e->ops[e->i] = op;
+  return ++e->i < e->n;
+}
+
+/** Return a uniformly distributed double in [0, 1) */
+static double
+rand_unit(RandGen *gen)
+{
+  uint64_t high = rand_gen_next(gen);
+  uint64_t bits = (high << 32) | rand_gen_next(gen);
+  return (bits >> 11) * 0x1.0p-53;
+}
+
+/** Return a random permutation of [0, n) as a new array.  If isCycle
+ *  it is a single cycle (Sattolo's algorithm), else any permutation
+ *  (Fisher-Yates).
+ */
+static uint32_t *
+random_permutation(RandGen *gen, uint32_t n, bool isCycle)
+{
+  uint32_t *perm = mallocChk(n * sizeof(uint32_t));
+  for (uint32_t i = 0; i < n; i++) perm[i] = i;
+  for (uint32_t i = n - 1; i > 0; i--) {
+    uint32_t j = rand_gen_below(gen, isCycle ? i : i + 1);
+    uint32_t t = perm[i]; perm[i] = perm[j]; perm[j] = t;
+  }
+  return perm;
+}
+
+static uint32_t
+n_units(unsigned long footprint, unsigned unitBytes)
+{
+  unsigned long n = footprint / unitBytes;
+  return (n == 0) ? 1 : (n > UINT32_MAX) ? UINT32_MAX : n;
+}
+
+/** Zipf-distributed ranks in [0, nItems) with exponent theta, by the
+ *  method of Gray et al., "Quickly Generating Billion-Record Synthetic
+ *  Databases" (as used by YCSB): O(nItems) setup, O(1) per rank.
+ */
+static void
+zipf_trace(Emitter *e, RandGen *gen, uint32_t nItems, double theta)
+{
+  double zetaN = 0;
+  for (uint32_t i = 1; i <= nItems; i++) zetaN += pow(i, -theta);
+  double zeta2 = 1 + pow(2, -theta);
+  double alpha = 1/(1 - theta);
+  double eta = (1 - pow(2.0/nItems, 1 - theta)) / (1 - zeta2/zetaN);
+  // scatter ranks so that the hottest items are not neighbours
+  uint32_t *items = random_permutation(gen, nItems, false);
+  for (;;) {
+    double u = rand_unit(gen);
+    double uz = u * zetaN;
+    uint32_t rank = (uz < 1) ? 0
+      : (uz < zeta2) ? 1
+      : (uint32_t)(nItems * pow(eta*u - eta + 1, alpha));
+    if (rank >= nItems) rank = nItems - 1;
+    MemAddr addr = SYNTH_BASE + (MemAddr)items[rank]*ITEM_BYTES;
+    if (!emit(e, addr, READ_ACCESS)) break;
+  }
+  free(items);
+}
+
+static void
+chase_trace(Emitter *e, RandGen *gen, uint32_t nNodes)
+{
+  uint32_t *next = random_permutation(gen, nNodes, true);
+  uint32_t node = 0;
+  while (emit(e, SYNTH_BASE + (MemAddr)node*ITEM_BYTES, READ_ACCESS)) {
+    node = next[node];
+  }
+  free(next);
+}
+
+/** The loops of lab11's matrix_multiply() in simple-matmul.c or, if
+ *  isTranspose, transpose-matmul.c, with a, b, c (and the transpose
+ *  tmp) allocated one after the other.
+ */
+static void
+matmul_trace(Emitter *e, unsigned n, bool isTranspose)
+{
+  MemAddr matrixBytes = (MemAddr)n*n*ELEM_BYTES;
+  matrixBytes = (matrixBytes + MATRIX_ALIGN - 1) / MATRIX_ALIGN * MATRIX_ALIGN;
+  MemAddr a = SYNTH_BASE, b = a + matrixBytes, c = b + matrixBytes;
+  MemAddr tmp = c + matrixBytes;
+#define ELEM(m, i, j) ((m) + ((MemAddr)(i)*n + (j))*ELEM_BYTES)
+  for (;;) {
+    if (isTranspose) {
+      for (unsigned i = 0; i < n; i++) {
+        for (unsigned j = 0; j < n; j++) {
+          if (!emit(e, ELEM(b, j, i), READ_ACCESS)) return;
+          if (!emit(e, ELEM(tmp, i, j), WRITE_ACCESS)) return;
+        }
+      }
+    }
+    for (unsigned i = 0; i < n; i++) {
+      for (unsigned j = 0; j < n; j++) {
+        if (!emit(e, ELEM(c, i, j), WRITE_ACCESS)) return;
+        for (unsigned k = 0; k < n; k++) {
+          MemAddr bElem = isTranspose ? ELEM(tmp, j, k) : ELEM(b, k, j);
+          if (!emit(e, ELEM(a, i, k), READ_ACCESS)) return;
+          if (!emit(e, bElem, READ_ACCESS)) return;
+          if (!emit(e, ELEM(c, i, j), READ_ACCESS)) return;
+          if (!emit(e, ELEM(c, i, j), WRITE_ACCESS)) return;
+        }
+      }
+    }
+  }
+#undef ELEM
+}
+
+/** Set addrs[n] and ops[n] to the first n accesses of the trace given
+ *  by params.
+ */
+void
+synth_trace(const SynthParams *params, MemAddr addrs[], AccessOp ops[],
+            size_t n)
+{
+  if (n == 0) return;
+  Emitter e = { addrs, ops, n, 0 };
+  RandGen gen;
+  rand_gen_seed(&gen, params->seed, RAND_GEN_STREAM);
+  unsigned long footprint = params->footprint;
+  switch (params->pattern) {
+  case SEQ_SYNTH: {
+    uint32_t nElems = n_units(footprint, ELEM_BYTES);
+    uint32_t i = 0;
+    while (emit(&e, SYNTH_BASE + (MemAddr)i*ELEM_BYTES, READ_ACCESS)) {
+      if (++i == nElems) i = 0;
+    }
+    break;
+  }
+  case STRIDE_SYNTH: {
+    unsigned long stride = params->arg;
+    unsigned long offset = 0;
+    while (emit(&e, SYNTH_BASE + offset, READ_ACCESS)) {
+      offset += stride;
+      if (offset >= footprint) offset = 0;
+    }
+    break;
+  }
+  case UNIFORM_SYNTH: {
+    uint32_t nElems = n_units(footprint, ELEM_BYTES);
+    MemAddr addr;
+    do {
+      addr = SYNTH_BASE + (MemAddr)rand_gen_below(&gen, nElems)*ELEM_BYTES;
+    } while (emit(&e, addr, READ_ACCESS));
+    break;
+  }
+  case ZIPF_SYNTH:
+    zipf_trace(&e, &gen, n_units(footprint, ITEM_BYTES), params->arg);
+    break;
+  case CHASE_SYNTH:
+    chase_trace(&e, &gen, n_units(footprint, ITEM_BYTES));
+    break;
+  case MATMUL_SYNTH: case TRANSPOSE_MATMUL_SYNTH:
+    matmul_trace(&e, params->arg, params->pattern == TRANSPOSE_MATMUL_SYNTH);
+    break;
+  default:
+    assert(0);
+    break;
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef SYNTH_TRACE_H_
+#define SYNTH_TRACE_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Synthetic traces of canonical access patterns, for benchmarking
+ *  and for checking cache behaviour against known results.  Every
+ *  access is of an 8-byte element; addresses start at SYNTH_BASE.
+ */
+
+/** Access pattern of a synthetic trace */
+typedef enum {
+  SEQ_SYNTH,              /** successive elements, wrapping at footprint */
+  STRIDE_SYNTH,           /** every arg'th byte, wrapping at footprint */
+  UNIFORM_SYNTH,          /** uniformly random elements of footprint */
+  ZIPF_SYNTH,             /** 64-byte items of footprint chosen with Zipf
+                           *  exponent arg, hottest items scattered */
+  CHASE_SYNTH,            /** pointer chase around a random cycle of the
+                           *  64-byte nodes of footprint */
+  MATMUL_SYNTH,           /** lab11 simple-matmul of arg x arg doubles */
+  TRANSPOSE_MATMUL_SYNTH, /** lab11 transpose-matmul of arg x arg doubles */
+  N_SYNTH_PATTERNS
+} SynthPattern;
+
+/** All pattern names separated by '|', for usage messages */
+#define SYNTH_PATTERN_NAMES "seq|stride|uniform|zipf|chase|matmul|tmatmul"
+
+enum { SYNTH_BASE = 0x10000000 };
+
+typedef struct {
+  SynthPattern pattern;
+  double arg;                 /** stride in bytes (default 256), Zipf
+                               *  exponent in (0, 1) (default 0.99) or
+                               *  matrix size (default 128) */
+  unsigned long footprint;    /** # of bytes the pattern ranges over;
+                               *  unused by the matmuls */
+  unsigned long seed;         /** for the randomized patterns */
+} SynthParams;
+
+/** Parse spec of the form PATTERN[:ARG] into *params, setting the
+ *  default arg if it is omitted and leaving footprint and seed
+ *  alone.  Returns false on error.
+ */
+bool get_synth_params(const char *spec, SynthParams *params);
+
+/** Parse spec, a decimal # of bytes with an optional K, M or G suffix
+ *  (powers of 1024), into *bytesP.  Returns false on error.
+ */
+bool get_synth_bytes(const char *spec, unsigned long *bytesP);
+
+/** Set addrs[n] and ops[n] to the first n accesses of the trace given
+ *  by params.  The matmul patterns repeat the multiplication as often
+ *  as needed, as lab11's N_TRIALS does; their accesses are those of
+ *  the C source, so c[i][j] is loaded and stored for every k.  Only
+ *  the matmuls write.
+ */
+void synth_trace(const SynthParams *params, MemAddr addrs[],
+                 AccessOp ops[], size_t n);
+
+#endif //ifndef SYNTH_TRACE_H_
@@ -0,0 +1,102 @@
+#include "tag-probe.h"
+
+#include <stddef.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_X86_PROBES 1
+#include <immintrin.h>
+#endif
+
+static unsigned
+scalar_probe(const MemAddr tags[], unsigned n, MemAddr tag)
+{
+  unsigned i;
+  for (i = 0; i < n && tags[i] != tag; i++) {}
+  return i;
+}
+
+#ifdef HAVE_X86_PROBES
+
+/** Compare 2 tags at a time; a leftover tag is done scalar so no load
+ *  crosses the end of the set's tags.
+ */
+__attribute__((target("sse4.1")))
+static unsigned
+sse4_probe(const MemAddr tags[], unsigned n, MemAddr tag)
+{
+  __m128i key = _mm_set1_epi64x(tag);
+  unsigned i;
+  for (i = 0; i + 2 <= n; i += 2) {
+    __m128i v = _mm_loadu_si128((const __m128i *)&tags[i]);
+    int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(v, key)));
+    if (mask) return i + __builtin_ctz(mask);
+  }
+  if (i < n && tags[i] != tag) i++;
+  return i;
+}
+
+/** As sse4_probe() but 4 tags at a time, then at most one 2-tag step */
+__attribute__((target("avx2")))
+static unsigned
+avx2_probe(const MemAddr tags[], unsigned n, MemAddr tag)
+{
+  __m256i key = _mm256_set1_epi64x(tag);
+  unsigned i;
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)&tags[i]);
+    int mask =
+      _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, key)));
+    if (mask) return i + __builtin_ctz(mask);
+  }
+  if (i + 2 <= n) {
+    __m128i v = _mm_loadu_si128((const __m128i *)&tags[i]);
+    __m128i key2 = _mm256_castsi256_si128(key);
+    int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(v, key2)));
+    if (mask) return i + __builtin_ctz(mask);
+    i += 2;
+  }
+  if (i < n && tags[i] != tag) i++;
+  return i;
+}
+
+#endif //ifdef HAVE_X86_PROBES
+
+/** Return the implementation of kind, or NULL if it is not supported
+ *  by this build or CPU.
+ */
+TagProbe *
+get_tag_probe(TagProbeKind kind)
+{
+  switch (kind) {
+  case SCALAR_PROBE:
+    return scalar_probe;
+#ifdef HAVE_X86_PROBES
+  case SSE4_PROBE:
+    return __builtin_cpu_supports("sse4.1") ? sse4_probe : NULL;
+  case AVX2_PROBE:
+    return __builtin_cpu_supports("avx2") ? avx2_probe : NULL;
+#endif
+  default:
+    return NULL;
+  }
+}
+
+/** Return the fastest implementation supported by this CPU */
+TagProbe *
+best_tag_probe(void)
+{
+  for (int kind = N_PROBES - 1; kind > SCALAR_PROBE; kind--) {
+    TagProbe *probe = get_tag_probe(kind);
+    if (probe) return probe;
+  }
+  return scalar_probe;
+}
+
+static const char *PROBE_NAMES[] = { "scalar", "sse4", "avx2" };
+
+/** Return name of kind */
+const char *
+tag_probe_name(TagProbeKind kind)
+{
+  return (0 <= kind && kind < N_PROBES) ? PROBE_NAMES[kind] : NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef TAG_PROBE_H_
+#define TAG_PROBE_H_
+
+#include "cache-sim.h"
+
+/** Searching the 64-bit tags of a set for a hit.  Besides the scalar
+ *  loop there are vector versions comparing 2 (SSE4.1) or 4 (AVX2) tags
+ *  per instruction; which of those the CPU supports is determined at run
+ *  time, so the program itself is built for the baseline instruction
+ *  set.
+ */
+
+/** Return the index of the first of tags[0, n) equal to tag, or n if
+ *  there is none.  Never reads beyond tags[n - 1].
+ */
+typedef unsigned TagProbe(const MemAddr tags[], unsigned n, MemAddr tag);
+
+typedef enum {
+  SCALAR_PROBE,
+  SSE4_PROBE,
+  AVX2_PROBE,
+  N_PROBES       /** dummy value: # of probe implementations */
+} TagProbeKind;
+
+/** Return the implementation of kind, or NULL if it is not supported
+ *  by this build or CPU.
+ */
+TagProbe *get_tag_probe(TagProbeKind kind);
+
+/** Return the fastest implementation supported by this CPU */
+TagProbe *best_tag_probe(void);
+
+/** Return name of kind */
+const char *tag_probe_name(TagProbeKind kind);
+
+#endif //ifndef TAG_PROBE_H_
@@ -0,0 +1,1469 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache-coher.h"
+#include "cache-sim.h"
+#include "cache-stats.h"
+#include "next-use.h"
+#include "rand-gen.h"
+#include "synth-trace.h"
+#include "tlb-sim.h"
+#include "trace.h"
+#include "trace-capture.h"
+
+#include <check.h>
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+/** Unit tests for 64-bit address handling and randomized differential
+ *  tests of cache-sim against the simple reference model below.
+ */
+
+/***************************** Test Helpers ****************************/
+
+/** xorshift64: fixed sequences so failures are reproducible */
+static unsigned long
+next_rand(unsigned long *state)
+{
+  unsigned long x = *state;
+  x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+  return *state = x;
+}
+
+static MemAddr
+addr_mask(unsigned nMemAddrBits)
+{
+  return (nMemAddrBits >= 64) ? ~0UL : (1UL << nMemAddrBits) - 1;
+}
+
+/** Return random params for a cache of at most 2**10 sets with
+ *  replacement, covering the full range of address widths.
+ */
+static CacheParams
+random_params(unsigned long *state, Replacement replacement)
+{
+  CacheParams params;
+  params.nSetBits = next_rand(state) % 11;
+  params.nLinesPerSet = 1 + next_rand(state) % 40;
+  params.nLineBits = 2 + next_rand(state) % 9;
+  unsigned minM = params.nSetBits + params.nLineBits + 1;
+  params.nMemAddrBits = minM + next_rand(state) % (64 - minM + 1);
+  params.replacement = replacement;
+  params.writePolicy = WRITE_BACK;
+  params.allocatePolicy = WRITE_ALLOCATE;
+  params.prefetch = NO_PREFETCH;
+  return params;
+}
+
+/** Fill addrs[n] with addresses drawn from a pool of about 3 cache
+ *  sizes worth of lines spread over the whole address space, so that
+ *  there are hits, misses and replacements, and lines differ in high
+ *  tag bits.  Byte offsets within a line and bits above
+ *  params->nMemAddrBits are random too.
+ */
+static void
+random_addrs(unsigned long *state, const CacheParams *params,
+             MemAddr addrs[], size_t n)
+{
+  size_t nPool = 3 * (params->nLinesPerSet << params->nSetBits);
+  if (nPool > 4096) nPool = 4096;
+  MemAddr pool[nPool];
+  for (size_t i = 0; i < nPool; i++) {
+    pool[i] = next_rand(state) & addr_mask(params->nMemAddrBits);
+  }
+  MemAddr offsetMask = (1UL << params->nLineBits) - 1;
+  for (size_t i = 0; i < n; i++) {
+    MemAddr line = pool[next_rand(state) % nPool] & ~offsetMask;
+    MemAddr junk = next_rand(state) & ~addr_mask(params->nMemAddrBits);
+    addrs[i] = junk | line | (next_rand(state) & offsetMask);
+  }
+}
+
+/*************************** Reference Model ***************************/
+
+/** Straightforward model of a cache with deterministic replacement:
+ *  per-line 64-bit line addresses and timestamps, kept in the same slot
+ *  order as cache-sim (fill in order, refill an invalidated slot from
+ *  the last valid one) so that ties break the same way.
+ */
+typedef struct {
+  MemAddr line;            /** addr >> b within the low m bits */
+  unsigned long lastUse;
+  unsigned long inserted;
+  unsigned long count;
+  unsigned long nextUse;
+  bool isDirty;
+} RefLine;
+
+typedef struct {
+  CacheParams params;
+  unsigned long now;
+  unsigned *nValid;        /** per set */
+  RefLine *lines;          /** E per set */
+} RefCache;
+
+static RefCache *
+new_ref_cache(const CacheParams *params)
+{
+  RefCache *ref = calloc(1, sizeof(RefCache));
+  size_t nSets = 1UL << params->nSetBits;
+  ref->params = *params;
+  ref->nValid = calloc(nSets, sizeof(unsigned));
+  ref->lines = calloc(nSets * params->nLinesPerSet, sizeof(RefLine));
+  return ref;
+}
+
+static void
+free_ref_cache(RefCache *ref)
+{
+  free(ref->nValid);
+  free(ref->lines);
+  free(ref);
+}
+
+static RefLine *
+ref_set(RefCache *ref, MemAddr line, unsigned **nValidP)
+{
+  size_t setNum = line & ((1UL << ref->params.nSetBits) - 1);
+  *nValidP = &ref->nValid[setNum];
+  return &ref->lines[setNum * ref->params.nLinesPerSet];
+}
+
+static unsigned
+ref_victim(const RefCache *ref, const RefLine set[])
+{
+  unsigned v = 0;
+  for (unsigned i = 1; i < ref->params.nLinesPerSet; i++) {
+    const RefLine *a = &set[i], *b = &set[v];
+    bool isBetter;
+    switch (ref->params.replacement) {
+    case LRU_R: isBetter = a->lastUse < b->lastUse; break;
+    case MRU_R: isBetter = a->lastUse > b->lastUse; break;
+    case FIFO_R: isBetter = a->inserted < b->inserted; break;
+    case LFU_R: isBetter = a->count < b->count; break;
+    case OPT_R: isBetter = a->nextUse > b->nextUse; break;
+    default: assert(0); isBetter = false;
+    }
+    if (isBetter) v = i;
+  }
+  return v;
+}
+
+/** Read or write addr, following the write and allocate policies */
+static CacheResult
+ref_access(RefCache *ref, MemAddr addr, bool isWrite, unsigned long nextUse)
+{
+  const CacheParams *p = &ref->params;
+  MemAddr line = (addr & addr_mask(p->nMemAddrBits)) >> p->nLineBits;
+  unsigned *nValidP;
+  RefLine *set = ref_set(ref, line, &nValidP);
+  unsigned long now = ++ref->now;
+  CacheResult result = { CACHE_HIT, 0, false };
+  bool isDirty = isWrite && p->writePolicy == WRITE_BACK;
+  for (unsigned i = 0; i < *nValidP; i++) {
+    if (set[i].line == line) {
+      set[i].lastUse = now;
+      set[i].count++;
+      set[i].nextUse = nextUse;
+      set[i].isDirty = set[i].isDirty || isDirty;
+      return result;
+    }
+  }
+  if (isWrite && p->allocatePolicy == NO_WRITE_ALLOCATE) {
+    result.status = CACHE_MISS_WITHOUT_REPLACE;
+    return result;
+  }
+  unsigned slot;
+  if (*nValidP < p->nLinesPerSet) {
+    result.status = CACHE_MISS_WITHOUT_REPLACE;
+    slot = (*nValidP)++;
+  }
+  else {
+    result.status = CACHE_MISS_WITH_REPLACE;
+    slot = ref_victim(ref, set);
+    result.replaceAddr = set[slot].line << p->nLineBits;
+    result.isWriteBack = set[slot].isDirty;
+  }
+  RefLine fill = { line, now, now, 1, nextUse, isDirty };
+  set[slot] = fill;
+  return result;
+}
+
+static CacheResult
+ref_result(RefCache *ref, MemAddr addr, unsigned long nextUse)
+{
+  return ref_access(ref, addr, false, nextUse);
+}
+
+static bool
+ref_invalidate(RefCache *ref, MemAddr addr)
+{
+  const CacheParams *p = &ref->params;
+  MemAddr line = (addr & addr_mask(p->nMemAddrBits)) >> p->nLineBits;
+  unsigned *nValidP;
+  RefLine *set = ref_set(ref, line, &nValidP);
+  for (unsigned i = 0; i < *nValidP; i++) {
+    if (set[i].line == line) {
+      set[i] = set[--*nValidP];
+      return true;
+    }
+  }
+  return false;
+}
+
+/*************************** Wide Tag Tests ****************************/
+
+/** Lines which differ only above bit 32 + s + b must not alias */
+START_TEST(highTagBitsDistinguishLines)
+{
+  CacheParams params = { 4, 2, 6, 48, LRU_R };
+  CacheSim *cache = new_cache_sim(&params);
+  MemAddr a = 0x123456789ac0UL, b = a ^ (1UL << 47);
+  ck_assert_int_eq(cache_sim_result(cache, a).status,
+                   CACHE_MISS_WITHOUT_REPLACE);
+  ck_assert_int_eq(cache_sim_result(cache, b).status,
+                   CACHE_MISS_WITHOUT_REPLACE);
+  ck_assert_int_eq(cache_sim_result(cache, a).status, CACHE_HIT);
+  ck_assert_int_eq(cache_sim_result(cache, b).status, CACHE_HIT);
+  free_cache_sim(cache);
+}
+END_TEST
+
+/** The replaced address includes every tag bit */
+START_TEST(replaceAddrKeepsHighBits)
+{
+  CacheParams params = { 0, 1, 2, 64, LRU_R };
+  CacheSim *cache = new_cache_sim(&params);
+  MemAddr a = 0xfedcba9876543210UL, b = 0x0123456789abcdefUL;
+  cache_sim_result(cache, a);
+  CacheResult result = cache_sim_result(cache, b);
+  ck_assert_int_eq(result.status, CACHE_MISS_WITH_REPLACE);
+  ck_assert_uint_eq(result.replaceAddr, a & ~3UL);
+  free_cache_sim(cache);
+}
+END_TEST
+
+/** Bits above m are ignored even when m + s + b spans 64 bits */
+START_TEST(bitsAboveMIgnored)
+{
+  CacheParams params = { 20, 1, 6, 48, LRU_R };
+  CacheSim *cache = new_cache_sim(&params);
+  MemAddr a = 0x0000abcdef012345UL;
+  cache_sim_result(cache, a);
+  ck_assert_int_eq(cache_sim_result(cache, a | 0xffff000000000000UL).status,
+                   CACHE_HIT);
+  free_cache_sim(cache);
+}
+END_TEST
+
+static Suite *
+wideTagsSuite(void)
+{
+  Suite *suite = suite_create("wideTags");
+  TCase *wideTagsTests = tcase_create("wideTags");
+  tcase_add_test(wideTagsTests, highTagBitsDistinguishLines);
+  tcase_add_test(wideTagsTests, replaceAddrKeepsHighBits);
+  tcase_add_test(wideTagsTests, bitsAboveMIgnored);
+  suite_add_tcase(suite, wideTagsTests);
+  return suite;
+}
+
+/************************ Differential Tests ***************************/
+
+enum { N_RANDOM_CACHES = 40, N_RANDOM_ADDRS = 20000 };
+
+static const Replacement DETERMINISTIC[] = { LRU_R, MRU_R, FIFO_R, LFU_R };
+
+/** Compare every result and invalidation against the reference for a
+ *  random cache; about 1 access in 16 is an invalidation instead.
+ */
+START_TEST(matchesReference)
+{
+  unsigned long state = 0x9E3779B97F4A7C15UL + _i;
+  size_t nPolicies = sizeof(DETERMINISTIC)/sizeof(DETERMINISTIC[0]);
+  CacheParams params =
+    random_params(&state, DETERMINISTIC[_i % nPolicies]);
+  MemAddr *addrs = malloc(N_RANDOM_ADDRS * sizeof(MemAddr));
+  random_addrs(&state, &params, addrs, N_RANDOM_ADDRS);
+  CacheSim *cache = new_cache_sim(&params);
+  RefCache *ref = new_ref_cache(&params);
+  for (size_t i = 0; i < N_RANDOM_ADDRS; i++) {
+    if (next_rand(&state) % 16 == 0) {
+      ck_assert_int_eq(cache_sim_invalidate(cache, addrs[i]),
+                       ref_invalidate(ref, addrs[i]));
+      continue;
+    }
+    CacheResult expected = ref_result(ref, addrs[i], 0);
+    CacheResult actual = cache_sim_result(cache, addrs[i]);
+    ck_assert_msg(actual.status == expected.status &&
+                  actual.replaceAddr == expected.replaceAddr,
+                  "%u-%u-%u-%u policy %d access %zu addr %lx: "
+                  "got %d %lx expected %d %lx",
+                  params.nSetBits, params.nLinesPerSet, params.nLineBits,
+                  params.nMemAddrBits, params.replacement, i, addrs[i],
+                  actual.status, actual.replaceAddr,
+                  expected.status, expected.replaceAddr);
+  }
+  free_ref_cache(ref);
+  free_cache_sim(cache);
+  free(addrs);
+}
+END_TEST
+
+/** As matchesReference, but about 1 access in 3 is a write under
+ *  random write and allocate policies: dirty lines must be written
+ *  back exactly when replaced, and the traffic of the batch entry
+ *  points must add up.
+ */
+START_TEST(writesMatchReference)
+{
+  unsigned long state = 0x165667B19E3779F9UL + _i;
+  size_t nPolicies = sizeof(DETERMINISTIC)/sizeof(DETERMINISTIC[0]);
+  CacheParams params =
+    random_params(&state, DETERMINISTIC[_i % nPolicies]);
+  params.writePolicy = _i % N_WRITE_POLICIES;
+  params.allocatePolicy = (_i / N_WRITE_POLICIES) % N_ALLOCATE_POLICIES;
+  MemAddr *addrs = malloc(N_RANDOM_ADDRS * sizeof(MemAddr));
+  AccessOp *ops = malloc(N_RANDOM_ADDRS * sizeof(AccessOp));
+  random_addrs(&state, &params, addrs, N_RANDOM_ADDRS);
+  for (size_t i = 0; i < N_RANDOM_ADDRS; i++) {
+    ops[i].kind = (next_rand(&state) % 3 == 0) ? WRITE_ACCESS : READ_ACCESS;
+    ops[i].size = 1 + next_rand(&state) % 8;
+  }
+  CacheSim *cache = new_cache_sim(&params);
+  CacheSim *batch = new_cache_sim(&params);
+  RefCache *ref = new_ref_cache(&params);
+  CacheTraffic traffic = { 0 }, expectedTraffic = { 0 };
+  for (size_t i = 0; i < N_RANDOM_ADDRS; i++) {
+    bool isWrite = ops[i].kind == WRITE_ACCESS;
+    CacheResult expected = ref_access(ref, addrs[i], isWrite, 0);
+    CacheResult actual;
+    cache_sim_op_results(cache, &addrs[i], &ops[i], 1, &actual, &traffic);
+    ck_assert_int_eq(actual.status, expected.status);
+    ck_assert_uint_eq(actual.replaceAddr, expected.replaceAddr);
+    ck_assert_int_eq(actual.isWriteBack, expected.isWriteBack);
+    bool isBypass = isWrite && expected.status != CACHE_HIT &&
+      params.allocatePolicy == NO_WRITE_ALLOCATE;
+    expectedTraffic.nWrites += isWrite;
+    expectedTraffic.nFills += expected.status != CACHE_HIT && !isBypass;
+    expectedTraffic.nWriteBacks += expected.isWriteBack;
+    if (isWrite && (params.writePolicy == WRITE_THROUGH || isBypass)) {
+      expectedTraffic.nWriteThroughs++;
+      expectedTraffic.nWriteThroughBytes += ops[i].size;
+    }
+  }
+  ck_assert(memcmp(&traffic, &expectedTraffic, sizeof(traffic)) == 0);
+  if (params.writePolicy == WRITE_THROUGH) {
+    ck_assert_uint_eq(traffic.nWriteBacks, 0);
+  }
+  unsigned long stats[CACHE_N_STATUS] = { 0 };
+  CacheTraffic batchTraffic = { 0 };
+  cache_sim_op_stats(batch, addrs, ops, N_RANDOM_ADDRS, stats, &batchTraffic);
+  ck_assert(memcmp(&batchTraffic, &traffic, sizeof(traffic)) == 0);
+  free_ref_cache(ref);
+  free_cache_sim(cache);
+  free_cache_sim(batch);
+  free(ops);
+  free(addrs);
+}
+END_TEST
+
+/** Write-back cache with one line: a store dirties it, a load of
+ *  another line writes it back, and a no-allocate store miss bypasses.
+ */
+START_TEST(dirtyLineWrittenBack)
+{
+  CacheParams params = { 0, 1, 4, 32, LRU_R };
+  CacheSim *cache = new_cache_sim(&params);
+  CacheResult result = cache_sim_write(cache, 0x100);
+  ck_assert_int_eq(result.status, CACHE_MISS_WITHOUT_REPLACE);
+  result = cache_sim_result(cache, 0x200);
+  ck_assert_int_eq(result.status, CACHE_MISS_WITH_REPLACE);
+  ck_assert_uint_eq(result.replaceAddr, 0x100);
+  ck_assert(result.isWriteBack);
+  result = cache_sim_result(cache, 0x100);
+  ck_assert(!result.isWriteBack);
+  free_cache_sim(cache);
+  params.allocatePolicy = NO_WRITE_ALLOCATE;
+  cache = new_cache_sim(&params);
+  ck_assert_int_eq(cache_sim_write(cache, 0x100).status,
+                   CACHE_MISS_WITHOUT_REPLACE);
+  ck_assert_int_eq(cache_sim_result(cache, 0x100).status,
+                   CACHE_MISS_WITHOUT_REPLACE);
+  free_cache_sim(cache);
+}
+END_TEST
+
+START_TEST(optMatchesReference)
+{
+  unsigned long state = 0xC2B2AE3D27D4EB4FUL + _i;
+  CacheParams params = random_params(&state, OPT_R);
+  MemAddr *addrs = malloc(N_RANDOM_ADDRS * sizeof(MemAddr));
+  random_addrs(&state, &params, addrs, N_RANDOM_ADDRS);
+  unsigned long *nextUses = next_uses(addrs, N_RANDOM_ADDRS, &params);
+  CacheSim *cache = new_cache_sim(&params);
+  RefCache *ref = new_ref_cache(&params);
+  for (size_t i = 0; i < N_RANDOM_ADDRS; i++) {
+    CacheResult expected = ref_result(ref, addrs[i], nextUses[i]);
+    cache_sim_next_use(cache, nextUses[i]);
+    CacheResult actual = cache_sim_result(cache, addrs[i]);
+    ck_assert_int_eq(actual.status, expected.status);
+    ck_assert_uint_eq(actual.replaceAddr, expected.replaceAddr);
+  }
+  free_ref_cache(ref);
+  free_cache_sim(cache);
+  free(nextUses);
+  free(addrs);
+}
+END_TEST
+
+/** Every policy, including the randomized ones, must hit exactly when
+ *  the line is resident given the lines filled and replaced so far,
+ *  only replace resident lines of the same set and only replace when
+ *  the set is full.
+ */
+START_TEST(residencyConsistent)
+{
+  unsigned long state = 0xD6E8FEB86659FD93UL + _i;
+  CacheParams params = random_params(&state, _i % N_REPLACEMENTS);
+  if (params.replacement == OPT_R) params.replacement = LRU_R;
+  MemAddr *addrs = malloc(N_RANDOM_ADDRS * sizeof(MemAddr));
+  random_addrs(&state, &params, addrs, N_RANDOM_ADDRS);
+  CacheSim *cache = new_cache_sim(&params);
+  cache_sim_seed(cache, _i);
+  //reuse the reference purely as a set of resident lines
+  RefCache *resident = new_ref_cache(&params);
+  MemAddr mask = addr_mask(params.nMemAddrBits);
+  MemAddr setMask = (1UL << params.nSetBits) - 1;
+  for (size_t i = 0; i < N_RANDOM_ADDRS; i++) {
+    MemAddr line = (addrs[i] & mask) >> params.nLineBits;
+    unsigned *nValidP;
+    RefLine *set = ref_set(resident, line, &nValidP);
+    bool isResident = false;
+    for (unsigned k = 0; k < *nValidP; k++) {
+      if (set[k].line == line) isResident = true;
+    }
+    CacheResult result = cache_sim_result(cache, addrs[i]);
+    ck_assert_int_eq(result.status == CACHE_HIT, isResident);
+    if (result.status == CACHE_MISS_WITHOUT_REPLACE) {
+      ck_assert_uint_lt(*nValidP, params.nLinesPerSet);
+    }
+    else if (result.status == CACHE_MISS_WITH_REPLACE) {
+      ck_assert_uint_eq(*nValidP, params.nLinesPerSet);
+      MemAddr replaced = result.replaceAddr >> params.nLineBits;
+      ck_assert_uint_eq(replaced & setMask, line & setMask);
+      ck_assert(ref_invalidate(resident, result.replaceAddr));
+    }
+    if (result.status != CACHE_HIT) ref_result(resident, addrs[i], 0);
+  }
+  free_ref_cache(resident);
+  free_cache_sim(cache);
+  free(addrs);
+}
+END_TEST
+
+/** Randomized policies depend only on their own cache's seed */
+START_TEST(randomSeedsReproducible)
+{
+  unsigned long state = 0x5851F42D4C957F2DUL + _i;
+  CacheParams params = random_params(&state, (_i % 2) ? RANDOM_R : BRRIP_R);
+  MemAddr *addrs = malloc(N_RANDOM_ADDRS * sizeof(MemAddr));
+  random_addrs(&state, &params, addrs, N_RANDOM_ADDRS);
+  CacheSim *caches[3];
+  for (int k = 0; k < 3; k++) {
+    caches[k] = new_cache_sim(&params);
+    cache_sim_seed(caches[k], (k < 2) ? _i : _i + 1);
+  }
+  bool isDifferent = false;
+  unsigned long nReplaces = 0;
+  for (size_t i = 0; i < N_RANDOM_ADDRS; i++) {
+    CacheResult results[3];
+    for (int k = 0; k < 3; k++) {
+      results[k] = cache_sim_result(caches[k], addrs[i]);
+    }
+    ck_assert_int_eq(results[0].status, results[1].status);
+    ck_assert_uint_eq(results[0].replaceAddr, results[1].replaceAddr);
+    nReplaces += results[0].status == CACHE_MISS_WITH_REPLACE;
+    isDifferent = isDifferent || results[0].status != results[2].status ||
+      results[0].replaceAddr != results[2].replaceAddr;
+  }
+  //a different seed makes different choices once there are victims
+  if (params.nLinesPerSet > 1 && params.replacement == RANDOM_R &&
+      nReplaces >= 100) {
+    ck_assert(isDifferent);
+  }
+  for (int k = 0; k < 3; k++) free_cache_sim(caches[k]);
+  free(addrs);
+}
+END_TEST
+
+/** rand_gen_below() stays in range and is close to uniform, even for
+ *  a bound for which % would be biased.
+ */
+START_TEST(boundedRandomUniform)
+{
+  enum { N_BINS = 3, N_DRAWS = 300000 };
+  //bias of % for this bound would be about 1 in 3
+  uint32_t bound = 0xC0000000u;
+  RandGen gen;
+  rand_gen_seed(&gen, 42, RAND_GEN_STREAM);
+  unsigned long counts[N_BINS] = { 0 };
+  for (int i = 0; i < N_DRAWS; i++) {
+    uint32_t r = rand_gen_below(&gen, bound);
+    ck_assert_uint_lt(r, bound);
+    counts[r / (bound / N_BINS)]++;
+  }
+  for (int k = 0; k < N_BINS; k++) {
+    ck_assert_uint_gt(counts[k], N_DRAWS/N_BINS * 98/100);
+    ck_assert_uint_lt(counts[k], N_DRAWS/N_BINS * 102/100);
+  }
+}
+END_TEST
+
+static Suite *
+differentialSuite(void)
+{
+  Suite *suite = suite_create("differential");
+  TCase *differentialTests = tcase_create("differential");
+  tcase_add_loop_test(differentialTests, matchesReference,
+                      0, N_RANDOM_CACHES);
+  tcase_add_loop_test(differentialTests, writesMatchReference,
+                      0, N_RANDOM_CACHES);
+  tcase_add_test(differentialTests, dirtyLineWrittenBack);
+  tcase_add_loop_test(differentialTests, optMatchesReference,
+                      0, N_RANDOM_CACHES / 4);
+  tcase_add_loop_test(differentialTests, residencyConsistent,
+                      0, N_RANDOM_CACHES);
+  tcase_add_loop_test(differentialTests, randomSeedsReproducible,
+                      0, N_RANDOM_CACHES);
+  tcase_add_test(differentialTests, boundedRandomUniform);
+  suite_add_tcase(suite, differentialTests);
+  return suite;
+}
+
+/************************** Batch API Tests ****************************/
+
+/** cache_sim_results() and cache_sim_stats() agree with repeated
+ *  cache_sim_result(), both for geometries with specialized loops
+ *  (even _i) and without.
+ */
+START_TEST(batchMatchesSingle)
+{
+  unsigned long state = 0x27D4EB2F165667C5UL + _i;
+  CacheParams params = random_params(&state, _i % OPT_R);
+  if (_i % 2 == 0) {
+    params.nSetBits = 6 + _i % 7;
+    params.nLineBits = 6;
+    if (params.nMemAddrBits <= params.nSetBits + 6) params.nMemAddrBits = 48;
+  }
+  MemAddr *addrs = malloc(N_RANDOM_ADDRS * sizeof(MemAddr));
+  CacheResult *results = malloc(N_RANDOM_ADDRS * sizeof(CacheResult));
+  random_addrs(&state, &params, addrs, N_RANDOM_ADDRS);
+  CacheSim *single = new_cache_sim(&params);
+  CacheSim *batch = new_cache_sim(&params);
+  CacheSim *stats = new_cache_sim(&params);
+  cache_sim_results(batch, addrs, N_RANDOM_ADDRS, results);
+  unsigned long expectedStats[CACHE_N_STATUS] = { 0 };
+  unsigned long actualStats[CACHE_N_STATUS] = { 0 };
+  cache_sim_stats(stats, addrs, N_RANDOM_ADDRS, actualStats);
+  for (size_t i = 0; i < N_RANDOM_ADDRS; i++) {
+    CacheResult expected = cache_sim_result(single, addrs[i]);
+    ck_assert_int_eq(results[i].status, expected.status);
+    ck_assert_uint_eq(results[i].replaceAddr, expected.replaceAddr);
+    expectedStats[expected.status]++;
+  }
+  for (int k = 0; k < CACHE_N_STATUS; k++) {
+    ck_assert_uint_eq(actualStats[k], expectedStats[k]);
+  }
+  free_cache_sim(single);
+  free_cache_sim(batch);
+  free_cache_sim(stats);
+  free(results);
+  free(addrs);
+}
+END_TEST
+
+/** Sets are independent, so cache_sim_sampled_stats() must give each
+ *  sampled set exactly the counts of a full simulation, and sample
+ *  exactly 1 in 2**sampleBits sets.  Randomized policies share one
+ *  generator between sets so they are left out.
+ */
+START_TEST(sampledMatchesFull)
+{
+  unsigned long state = 0x85EBCA77C2B2AE63UL + _i;
+  Replacement replacement = _i % OPT_R;
+  if (replacement == RANDOM_R || replacement == BRRIP_R) replacement = LRU_R;
+  CacheParams params = random_params(&state, replacement);
+  unsigned sampleBits = next_rand(&state) % (params.nSetBits + 1);
+  size_t nSets = (size_t)1 << params.nSetBits;
+  MemAddr *addrs = malloc(N_RANDOM_ADDRS * sizeof(MemAddr));
+  random_addrs(&state, &params, addrs, N_RANDOM_ADDRS);
+  CacheSim *full = new_cache_sim(&params);
+  CacheSim *sampled = new_cache_sim(&params);
+  cache_sim_sample_sets(sampled, sampleBits);
+  unsigned long *expected =
+    calloc(nSets * CACHE_N_STATUS, sizeof(unsigned long));
+  unsigned long *actual = calloc(nSets * CACHE_N_STATUS, sizeof(unsigned long));
+  size_t nExpected = 0;
+  for (size_t i = 0; i < N_RANDOM_ADDRS; i++) {
+    size_t setNum = (addrs[i] >> params.nLineBits) & (nSets - 1);
+    CacheResult result = cache_sim_result(full, addrs[i]);
+    if (cache_sim_is_sampled_set(sampled, setNum)) {
+      expected[setNum*CACHE_N_STATUS + result.status]++;
+      nExpected++;
+    }
+  }
+  size_t nSampled =
+    cache_sim_sampled_stats(sampled, addrs, N_RANDOM_ADDRS, actual);
+  ck_assert_uint_eq(nSampled, nExpected);
+  size_t nSampledSets = 0;
+  for (size_t set = 0; set < nSets; set++) {
+    if (cache_sim_is_sampled_set(sampled, set)) nSampledSets++;
+    for (int k = 0; k < CACHE_N_STATUS; k++) {
+      ck_assert_uint_eq(actual[set*CACHE_N_STATUS + k],
+                        expected[set*CACHE_N_STATUS + k]);
+    }
+  }
+  ck_assert_uint_eq(nSampledSets, nSets >> sampleBits);
+  free_cache_sim(full);
+  free_cache_sim(sampled);
+  free(expected);
+  free(actual);
+  free(addrs);
+}
+END_TEST
+
+static Suite *
+batchSuite(void)
+{
+  Suite *suite = suite_create("batch");
+  TCase *batchTests = tcase_create("batch");
+  tcase_add_loop_test(batchTests, batchMatchesSingle, 0, N_RANDOM_CACHES);
+  tcase_add_loop_test(batchTests, sampledMatchesFull, 0, N_RANDOM_CACHES);
+  suite_add_tcase(suite, batchTests);
+  return suite;
+}
+
+/************************** Miss Class Tests ***************************/
+
+/** Direct-mapped 2-set cache: lines 0 and 2 share set 0, so going
+ *  back to line 0 is a conflict miss at reuse distance 1.
+ */
+START_TEST(conflictMissClassified)
+{
+  CacheParams params = {
+    .nSetBits = 1, .nLinesPerSet = 1, .nLineBits = 2, .nMemAddrBits = 16,
+    .replacement = LRU_R,
+  };
+  MemAddr addrs[] = { 0x0, 0x8, 0x1, 0x4 };
+  enum { N = sizeof(addrs)/sizeof(addrs[0]) };
+  CacheSim *cache = new_cache_sim(&params);
+  CacheStats *cacheStats = new_cache_stats(&params);
+  CacheResult results[N];
+  cache_sim_results(cache, addrs, N, results);
+  cache_stats_add(cacheStats, addrs, results, N);
+  unsigned long counts[N_STATS];
+  cache_stats_set_counts(cacheStats, 0, counts);
+  ck_assert_uint_eq(counts[STAT_ACCESSES], 3);
+  ck_assert_uint_eq(counts[STAT_EVICTIONS], 2);
+  ck_assert_uint_eq(counts[STAT_COMPULSORY], 2);
+  ck_assert_uint_eq(counts[STAT_CONFLICT], 1);
+  cache_stats_set_counts(cacheStats, 1, counts);
+  ck_assert_uint_eq(counts[STAT_ACCESSES], 1);
+  ck_assert_uint_eq(counts[STAT_COMPULSORY], 1);
+  unsigned long hist[N_REUSE_BUCKETS];
+  ck_assert_uint_eq(cache_stats_reuse(cacheStats, hist), 3);
+  ck_assert_uint_eq(hist[1], 1);
+  free_cache_stats(cacheStats);
+  free_cache_sim(cache);
+}
+END_TEST
+
+/** Reuse distances agree with a naive LRU stack over enough accesses
+ *  to renumber times, a fully associative LRU cache has no conflict
+ *  misses, and the miss classes always add up.
+ */
+START_TEST(missClassesConsistent)
+{
+  unsigned long state = 0x165667B19E3779F9UL + _i;
+  CacheParams params = random_params(&state, LRU_R);
+  if (_i % 2 == 0) params.nSetBits = 0;
+  MemAddr *addrs = malloc(N_RANDOM_ADDRS * sizeof(MemAddr));
+  CacheResult *results = malloc(N_RANDOM_ADDRS * sizeof(CacheResult));
+  random_addrs(&state, &params, addrs, N_RANDOM_ADDRS);
+  CacheSim *cache = new_cache_sim(&params);
+  CacheStats *cacheStats = new_cache_stats(&params);
+  cache_sim_results(cache, addrs, N_RANDOM_ADDRS, results);
+  cache_stats_add(cacheStats, addrs, results, N_RANDOM_ADDRS);
+
+  MemAddr *stack = malloc(N_RANDOM_ADDRS * sizeof(MemAddr));  //MRU first
+  size_t depth = 0;
+  unsigned long expectedHist[N_REUSE_BUCKETS] = { 0 };
+  unsigned long nCold = 0;
+  for (size_t i = 0; i < N_RANDOM_ADDRS; i++) {
+    MemAddr line = (addrs[i] & addr_mask(params.nMemAddrBits))
+      >> params.nLineBits;
+    size_t d;
+    for (d = 0; d < depth && stack[d] != line; d++) {}
+    if (d == depth) {
+      nCold++;
+      depth++;
+    }
+    else {
+      expectedHist[(d == 0) ? 0 : 64 - __builtin_clzl(d)]++;
+    }
+    memmove(&stack[1], &stack[0], d * sizeof(MemAddr));
+    stack[0] = line;
+  }
+  unsigned long hist[N_REUSE_BUCKETS];
+  ck_assert_uint_eq(cache_stats_reuse(cacheStats, hist), nCold);
+  for (int k = 0; k < N_REUSE_BUCKETS; k++) {
+    ck_assert_uint_eq(hist[k], expectedHist[k]);
+  }
+
+  unsigned long counts[N_STATS];
+  cache_stats_totals(cacheStats, counts);
+  ck_assert_uint_eq(counts[STAT_ACCESSES], N_RANDOM_ADDRS);
+  ck_assert_uint_eq(counts[STAT_HITS] + counts[STAT_MISSES], N_RANDOM_ADDRS);
+  ck_assert_uint_eq(counts[STAT_COMPULSORY] + counts[STAT_CAPACITY] +
+                    counts[STAT_CONFLICT], counts[STAT_MISSES]);
+  ck_assert_uint_eq(counts[STAT_COMPULSORY], nCold);
+  if (params.nSetBits == 0) ck_assert_uint_eq(counts[STAT_CONFLICT], 0);
+  free(stack);
+  free_cache_stats(cacheStats);
+  free_cache_sim(cache);
+  free(results);
+  free(addrs);
+}
+END_TEST
+
+static Suite *
+missClassSuite(void)
+{
+  Suite *suite = suite_create("missClass");
+  TCase *missClassTests = tcase_create("missClass");
+  tcase_add_test(missClassTests, conflictMissClassified);
+  tcase_add_loop_test(missClassTests, missClassesConsistent,
+                      0, N_RANDOM_CACHES);
+  suite_add_tcase(suite, missClassTests);
+  return suite;
+}
+
+/*************************** Prefetch Tests ****************************/
+
+/** Access n lines of 16 bytes starting at line first, step lines apart,
+ *  in a 64-line 4-way cache with prefetch and check the # of misses
+ *  and, with a prefetcher, the prefetch stats.
+ */
+static void
+check_prefetch_run(Prefetch prefetch, MemAddr first, long step, unsigned n,
+                   unsigned long nMisses, unsigned long nUseful)
+{
+  CacheParams params = { 4, 4, 4, 32, LRU_R };
+  params.prefetch = prefetch;
+  CacheSim *cache = new_cache_sim(&params);
+  unsigned long stats[CACHE_N_STATUS] = { 0 };
+  for (unsigned i = 0; i < n; i++) {
+    stats[cache_sim_result(cache, (first + i * step) << 4).status]++;
+  }
+  PrefetchStats prefetchStats;
+  cache_sim_prefetch_stats(cache, &prefetchStats);
+  ck_assert_uint_eq(n - stats[CACHE_HIT], nMisses);
+  if (prefetch == NO_PREFETCH) nMisses = 0;
+  ck_assert_uint_eq(prefetchStats.nDemandMisses, nMisses);
+  ck_assert_uint_eq(prefetchStats.nUseful, nUseful);
+  ck_assert_uint_ge(prefetchStats.nIssued, prefetchStats.nUseful);
+  free_cache_sim(cache);
+}
+
+/** Only the first of a sequential run misses, and each later line is
+ *  the first use of a prefetched line.
+ */
+START_TEST(nextLineCoversSequential)
+{
+  check_prefetch_run(NEXT_LINE_PREFETCH, 0x100, 1, 200, 1, 199);
+}
+END_TEST
+
+/** A stride of 3 lines is confirmed after 4 accesses in one region */
+START_TEST(strideCoversStrided)
+{
+  check_prefetch_run(STRIDE_PREFETCH, 0x1000, 3, 20, 4, 16);
+}
+END_TEST
+
+/** A descending run of misses is confirmed by its second miss */
+START_TEST(streamCoversDescending)
+{
+  check_prefetch_run(STREAM_PREFETCH, 0x5000, -1, 100, 2, 98);
+  check_prefetch_run(NO_PREFETCH, 0x5000, -1, 100, 100, 0);
+}
+END_TEST
+
+/** Prefetches are invisible to results: batches still match single
+ *  accesses, demand misses match the results and no more prefetches
+ *  are useful than were issued.
+ */
+START_TEST(prefetchCountsConsistent)
+{
+  unsigned long state = 0xA24BAED4963EE407UL + _i;
+  CacheParams params = random_params(&state, _i % OPT_R);
+  params.prefetch = 1 + _i % (N_PREFETCHES - 1);
+  MemAddr *addrs = malloc(N_RANDOM_ADDRS * sizeof(MemAddr));
+  CacheResult *results = malloc(N_RANDOM_ADDRS * sizeof(CacheResult));
+  random_addrs(&state, &params, addrs, N_RANDOM_ADDRS);
+  //runs of neighbouring lines so that prefetches are useful
+  for (size_t i = 1; i < N_RANDOM_ADDRS; i++) {
+    if (next_rand(&state) % 2) {
+      addrs[i] = addrs[i - 1] + ((MemAddr)1 << params.nLineBits);
+    }
+  }
+  CacheSim *single = new_cache_sim(&params);
+  CacheSim *batch = new_cache_sim(&params);
+  cache_sim_seed(single, _i);
+  cache_sim_seed(batch, _i);
+  cache_sim_results(batch, addrs, N_RANDOM_ADDRS, results);
+  unsigned long nMisses = 0;
+  for (size_t i = 0; i < N_RANDOM_ADDRS; i++) {
+    CacheResult expected = cache_sim_result(single, addrs[i]);
+    ck_assert_int_eq(results[i].status, expected.status);
+    ck_assert_uint_eq(results[i].replaceAddr, expected.replaceAddr);
+    nMisses += expected.status != CACHE_HIT;
+  }
+  PrefetchStats singleStats, batchStats;
+  cache_sim_prefetch_stats(single, &singleStats);
+  cache_sim_prefetch_stats(batch, &batchStats);
+  ck_assert(memcmp(&singleStats, &batchStats, sizeof(singleStats)) == 0);
+  ck_assert_uint_eq(singleStats.nDemandMisses, nMisses);
+  ck_assert_uint_le(singleStats.nUseful, singleStats.nIssued);
+  ck_assert_uint_le(singleStats.nPolluting, nMisses);
+  ck_assert_uint_eq(singleStats.nWriteBacks, 0);
+  free_cache_sim(single);
+  free_cache_sim(batch);
+  free(results);
+  free(addrs);
+}
+END_TEST
+
+static Suite *
+prefetchSuite(void)
+{
+  Suite *suite = suite_create("prefetch");
+  TCase *prefetchTests = tcase_create("prefetch");
+  tcase_add_test(prefetchTests, nextLineCoversSequential);
+  tcase_add_test(prefetchTests, strideCoversStrided);
+  tcase_add_test(prefetchTests, streamCoversDescending);
+  tcase_add_loop_test(prefetchTests, prefetchCountsConsistent,
+                      0, N_RANDOM_CACHES);
+  suite_add_tcase(suite, prefetchTests);
+  return suite;
+}
+
+/*************************** Snapshot Tests ****************************/
+
+/** A cache saved part way through a trace and loaded again continues
+ *  exactly as the original would have, including its generator,
+ *  replacement state, dirty lines and prefetcher.
+ */
+START_TEST(snapshotResumesExactly)
+{
+  unsigned long state = 0x9FB21C651E98DF25UL + _i;
+  CacheParams params = random_params(&state, _i % OPT_R);
+  params.writePolicy = next_rand(&state) % N_WRITE_POLICIES;
+  params.allocatePolicy = next_rand(&state) % N_ALLOCATE_POLICIES;
+  params.prefetch = next_rand(&state) % N_PREFETCHES;
+  MemAddr *addrs = malloc(N_RANDOM_ADDRS * sizeof(MemAddr));
+  AccessOp *ops = malloc(N_RANDOM_ADDRS * sizeof(AccessOp));
+  CacheResult *expected = malloc(N_RANDOM_ADDRS * sizeof(CacheResult));
+  CacheResult *actual = malloc(N_RANDOM_ADDRS * sizeof(CacheResult));
+  random_addrs(&state, &params, addrs, N_RANDOM_ADDRS);
+  for (size_t i = 0; i < N_RANDOM_ADDRS; i++) {
+    ops[i].kind = (next_rand(&state) % 3 == 0) ? WRITE_ACCESS : READ_ACCESS;
+    ops[i].size = 8;
+  }
+  size_t nPrefix = next_rand(&state) % N_RANDOM_ADDRS;
+  size_t nRest = N_RANDOM_ADDRS - nPrefix;
+  CacheSim *cache = new_cache_sim(&params);
+  cache_sim_seed(cache, _i);
+  CacheTraffic traffic = { 0 };
+  cache_sim_op_results(cache, addrs, ops, nPrefix, expected, &traffic);
+  char path[] = "/tmp/cache-sim-snapXXXXXX";
+  int fd = mkstemp(path);
+  ck_assert_int_ge(fd, 0);
+  close(fd);
+  cache_sim_save(cache, nPrefix, path);
+  unsigned long position;
+  CacheSim *loaded = cache_sim_load(path, &position);
+  unlink(path);   //still mapped by loaded
+  ck_assert_uint_eq(position, nPrefix);
+  CacheParams loadedParams;
+  cache_sim_params(loaded, &loadedParams);
+  ck_assert(memcmp(&loadedParams, &params, sizeof(params)) == 0);
+  cache_sim_op_results(cache, addrs + nPrefix, ops + nPrefix, nRest,
+                       expected, &traffic);
+  CacheTraffic loadedTraffic = { 0 };
+  cache_sim_op_results(loaded, addrs + nPrefix, ops + nPrefix, nRest,
+                       actual, &loadedTraffic);
+  for (size_t i = 0; i < nRest; i++) {
+    ck_assert_int_eq(actual[i].status, expected[i].status);
+    ck_assert_uint_eq(actual[i].replaceAddr, expected[i].replaceAddr);
+    ck_assert_int_eq(actual[i].isWriteBack, expected[i].isWriteBack);
+  }
+  PrefetchStats expectedStats, actualStats;
+  cache_sim_prefetch_stats(cache, &expectedStats);
+  cache_sim_prefetch_stats(loaded, &actualStats);
+  ck_assert(memcmp(&expectedStats, &actualStats, sizeof(actualStats)) == 0);
+  free_cache_sim(cache);
+  free_cache_sim(loaded);
+  free(actual);
+  free(expected);
+  free(ops);
+  free(addrs);
+}
+END_TEST
+
+static Suite *
+snapshotSuite(void)
+{
+  Suite *suite = suite_create("snapshot");
+  TCase *snapshotTests = tcase_create("snapshot");
+  tcase_add_loop_test(snapshotTests, snapshotResumesExactly,
+                      0, N_RANDOM_CACHES);
+  suite_add_tcase(suite, snapshotTests);
+  return suite;
+}
+
+/**************************** Coherence Tests **************************/
+
+static CoherOutcome
+coher_access(CacheCoher *coher, unsigned core, AccessKind kind, MemAddr addr)
+{
+  AccessOp op = { kind, core, 4 };
+  return cache_coher_access(coher, addr, &op);
+}
+
+START_TEST(mesiTransitions)
+{
+  CacheParams coreParams = { 2, 2, 4, 32, LRU_R };
+  CacheParams llcParams = { 4, 4, 4, 32, LRU_R };
+  CacheCoher *coher = new_cache_coher(&coreParams, &llcParams, 0);
+  ck_assert_int_eq(coher_access(coher, 0, READ_ACCESS, 0x100), COHER_MISS);
+  ck_assert_int_eq(cache_coher_state(coher, 0, 0x100), MESI_E);
+  ck_assert_int_eq(coher_access(coher, 1, READ_ACCESS, 0x104), COHER_MISS);
+  ck_assert_int_eq(cache_coher_state(coher, 0, 0x100), MESI_S);
+  ck_assert_int_eq(cache_coher_state(coher, 1, 0x100), MESI_S);
+  ck_assert_int_eq(coher_access(coher, 1, WRITE_ACCESS, 0x108), COHER_UPGRADE);
+  ck_assert_int_eq(cache_coher_state(coher, 0, 0x100), MESI_I);
+  ck_assert_int_eq(cache_coher_state(coher, 1, 0x100), MESI_M);
+  //core 0 reads the byte core 1 wrote: true sharing
+  ck_assert_int_eq(coher_access(coher, 0, READ_ACCESS, 0x108),
+                   COHER_COHERENCE_MISS);
+  ck_assert_int_eq(cache_coher_state(coher, 1, 0x100), MESI_S);
+  ck_assert_int_eq(cache_coher_core_stats(coher, 0)->nFalseSharingMisses, 0);
+  const CoherStats *stats = cache_coher_stats(coher);
+  ck_assert_uint_eq(stats->nInvalidations, 1);
+  ck_assert_uint_eq(stats->nWriteBacks, 1);
+  ck_assert_uint_eq(stats->nTransfers, 2);
+  ck_assert_uint_eq(stats->nLlcAccesses, 1);
+  free_cache_coher(coher);
+}
+END_TEST
+
+START_TEST(falseSharingDetected)
+{
+  CacheParams coreParams = { 2, 2, 6, 48, LRU_R };
+  CacheParams llcParams = { 6, 8, 6, 48, LRU_R };
+  CacheCoher *coher = new_cache_coher(&coreParams, &llcParams, 0);
+  enum { N = 100 };
+  for (unsigned i = 0; i < N; i++) {
+    coher_access(coher, 0, WRITE_ACCESS, 0x1000);
+    coher_access(coher, 1, WRITE_ACCESS, 0x1020);
+  }
+  CoherLineStats *lines;
+  ck_assert_uint_eq(cache_coher_hot_lines(coher, &lines), 1);
+  ck_assert_uint_eq(lines[0].addr, 0x1000);
+  ck_assert_uint_eq(lines[0].nCoherenceMisses, 2*N - 2);
+  ck_assert_uint_eq(lines[0].nFalseSharingMisses, 2*N - 2);
+  ck_assert_uint_eq(lines[0].nInvalidations, 2*N - 1);
+  ck_assert_uint_eq(lines[0].writers, 0x3);
+  free(lines);
+  free_cache_coher(coher);
+}
+END_TEST
+
+/** Random multi-core accesses: every line is M or E in at most one
+ *  core and then in no other, and the counts add up.
+ */
+START_TEST(mesiInvariants)
+{
+  unsigned long state = 0x8CB92BA72F3D8DD7UL + _i;
+  CacheParams coreParams = random_params(&state, _i % OPT_R);
+  CacheParams llcParams = coreParams;
+  llcParams.nSetBits = coreParams.nSetBits / 2;
+  llcParams.nLinesPerSet = 2*coreParams.nLinesPerSet;
+  enum { N_TEST_CORES = 4, N_TEST_LINES = 64 };
+  CacheCoher *coher = new_cache_coher(&coreParams, &llcParams, _i);
+  MemAddr lineBytes = (MemAddr)1 << coreParams.nLineBits;
+  unsigned long nAccesses = 0;
+  for (size_t i = 0; i < N_RANDOM_ADDRS; i++) {
+    unsigned core = next_rand(&state) % N_TEST_CORES;
+    MemAddr addr = (next_rand(&state) % N_TEST_LINES) * lineBytes * 7;
+    AccessKind kind = (next_rand(&state) % 3 == 0) ? WRITE_ACCESS : READ_ACCESS;
+    CoherOutcome outcome = coher_access(coher, core, kind, addr);
+    nAccesses++;
+    MesiState mesi = cache_coher_state(coher, core, addr);
+    ck_assert_int_ne(mesi, MESI_I);
+    ck_assert(kind == READ_ACCESS || mesi == MESI_M);
+    ck_assert(outcome != COHER_UPGRADE || kind == WRITE_ACCESS);
+    unsigned nOwners = 0, nHolders = 0;
+    for (unsigned c = 0; c < N_TEST_CORES; c++) {
+      MesiState s = cache_coher_state(coher, c, addr);
+      nOwners += s == MESI_M || s == MESI_E;
+      nHolders += s != MESI_I;
+    }
+    ck_assert(nOwners == 0 || nHolders == 1);
+  }
+  unsigned long nTotal = 0;
+  for (unsigned c = 0; c < cache_coher_n_cores(coher); c++) {
+    const CoherCoreStats *stats = cache_coher_core_stats(coher, c);
+    ck_assert_uint_eq(stats->nHits + stats->nMisses, stats->nAccesses);
+    ck_assert_uint_le(stats->nFalseSharingMisses, stats->nCoherenceMisses);
+    nTotal += stats->nAccesses;
+  }
+  ck_assert_uint_eq(nTotal, nAccesses);
+  free_cache_coher(coher);
+}
+END_TEST
+
+static Suite *
+coherenceSuite(void)
+{
+  Suite *suite = suite_create("coherence");
+  TCase *coherenceTests = tcase_create("coherence");
+  tcase_add_test(coherenceTests, mesiTransitions);
+  tcase_add_test(coherenceTests, falseSharingDetected);
+  tcase_add_loop_test(coherenceTests, mesiInvariants, 0, N_RANDOM_CACHES);
+  suite_add_tcase(suite, coherenceTests);
+  return suite;
+}
+
+/************************** Synthetic Trace Tests **********************/
+
+/** A pointer chase visits every node once before repeating */
+START_TEST(chaseVisitsEveryNode)
+{
+  enum { N_NODES = 1000, NODE_BYTES = 64 };
+  SynthParams params = { .footprint = N_NODES*NODE_BYTES, .seed = _i };
+  ck_assert(get_synth_params("chase", &params));
+  MemAddr addrs[2*N_NODES];
+  AccessOp ops[2*N_NODES];
+  synth_trace(&params, addrs, ops, 2*N_NODES);
+  bool isVisited[N_NODES] = { false };
+  for (unsigned i = 0; i < N_NODES; i++) {
+    MemAddr offset = addrs[i] - SYNTH_BASE;
+    ck_assert_int_eq(offset % NODE_BYTES, 0);
+    ck_assert_int_lt(offset/NODE_BYTES, N_NODES);
+    ck_assert(!isVisited[offset/NODE_BYTES]);
+    isVisited[offset/NODE_BYTES] = true;
+    ck_assert_int_eq(addrs[i + N_NODES], addrs[i]);
+    ck_assert_int_eq(ops[i].kind, READ_ACCESS);
+  }
+}
+END_TEST
+
+/** The matmul trace makes the accesses of the C loops, then repeats */
+START_TEST(matmulAccessesLoops)
+{
+  enum { N = 5, N_ACCESSES = N*N*(1 + 4*N) };
+  SynthParams params;
+  ck_assert(get_synth_params("matmul:5", &params));
+  MemAddr addrs[N_ACCESSES + 1];
+  AccessOp ops[N_ACCESSES + 1];
+  synth_trace(&params, addrs, ops, N_ACCESSES + 1);
+  unsigned nWrites = 0;
+  for (unsigned i = 0; i < N_ACCESSES; i++) {
+    if (ops[i].kind == WRITE_ACCESS) nWrites++;
+  }
+  ck_assert_int_eq(nWrites, N*N*(1 + N));
+  ck_assert_int_eq(addrs[N_ACCESSES], addrs[0]);
+  ck_assert_int_eq(ops[N_ACCESSES].kind, WRITE_ACCESS);
+  //c[1][2] += a[1][3] * b[3][2], with b one page after a
+  const unsigned k = ((1*N + 2)*(1 + 4*N)) + 1 + 4*3;
+  ck_assert_int_eq(addrs[k], SYNTH_BASE + (1*N + 3)*8);
+  ck_assert_int_eq(addrs[k + 1], SYNTH_BASE + 4096 + (3*N + 2)*8);
+}
+END_TEST
+
+/** get_synth_params() rejects bad specs */
+START_TEST(synthSpecsChecked)
+{
+  SynthParams params;
+  ck_assert(get_synth_params("zipf", &params));
+  ck_assert(params.pattern == ZIPF_SYNTH && params.arg == 0.99);
+  ck_assert(get_synth_params("stride:64", &params));
+  ck_assert(params.pattern == STRIDE_SYNTH && params.arg == 64);
+  ck_assert(!get_synth_params("zipf:1.5", &params));
+  ck_assert(!get_synth_params("seq:2", &params));
+  ck_assert(!get_synth_params("matmul:", &params));
+  ck_assert(!get_synth_params("seqx", &params));
+  unsigned long bytes;
+  ck_assert(get_synth_bytes("3K", &bytes) && bytes == 3072);
+  ck_assert(!get_synth_bytes("3X", &bytes));
+}
+END_TEST
+
+static Suite *
+synthSuite(void)
+{
+  Suite *suite = suite_create("synth");
+  TCase *synthTests = tcase_create("synth");
+  tcase_add_loop_test(synthTests, chaseVisitsEveryNode, 0, 4);
+  tcase_add_test(synthTests, matmulAccessesLoops);
+  tcase_add_test(synthTests, synthSpecsChecked);
+  suite_add_tcase(suite, synthTests);
+  return suite;
+}
+
+/**************************** Translation Tests ************************/
+
+static int
+compare_addrs(const void *p1, const void *p2)
+{
+  MemAddr a1 = *(const MemAddr *)p1, a2 = *(const MemAddr *)p2;
+  return (a1 > a2) - (a1 < a2);
+}
+
+/** Translation keeps page offsets and maps distinct pages to distinct
+ *  frames of physical memory, in order of first touch for seq.
+ */
+START_TEST(translationIsOneToOne)
+{
+  enum { N_ADDRS = 20000, MAX_PAGES = 3000, N_PHYS_BITS = 36 };
+  static const char *pageSizes[] = { "4K", "2M", "1G" };
+  TlbParams params = {
+    .nPageBits = get_page_bits(pageSizes[_i % 3]),
+    .nPhysAddrBits = N_PHYS_BITS,
+    .pageMap = _i / 3,
+    .seed = _i,
+  };
+  ck_assert(get_tlb_levels("2-4,5-8", &params));
+  TlbSim *tlb = new_tlb_sim(&params);
+  unsigned nPageBits = params.nPageBits;
+  MemAddr pageMask = (1UL << nPageBits) - 1;
+  unsigned long nFrames = 1UL << (N_PHYS_BITS - nPageBits);
+  unsigned nPages = (nFrames < MAX_PAGES) ? nFrames : MAX_PAGES;
+  MemAddr vaddrs[N_ADDRS], paddrs[N_ADDRS];
+  unsigned pages[N_ADDRS];
+  unsigned long state = 0x5DEECE66DUL + _i;
+  for (unsigned i = 0; i < N_ADDRS; i++) {
+    //pages scattered over the virtual address space
+    pages[i] = next_rand(&state) % nPages;
+    MemAddr vpn = pages[i] * 0x3779B9UL;
+    vaddrs[i] = (vpn << nPageBits) | (next_rand(&state) & pageMask);
+  }
+  tlb_sim_translate(tlb, vaddrs, paddrs, N_ADDRS);
+  MemAddr frames[MAX_PAGES];
+  memset(frames, 0xff, sizeof(frames));
+  unsigned nTouched = 0;
+  for (unsigned i = 0; i < N_ADDRS; i++) {
+    ck_assert_int_eq(paddrs[i] & pageMask, vaddrs[i] & pageMask);
+    MemAddr frame = paddrs[i] >> nPageBits;
+    ck_assert_int_lt(frame, nFrames);
+    if (frames[pages[i]] == ~0UL) {
+      if (params.pageMap == SEQ_PAGE_MAP) ck_assert_int_eq(frame, nTouched);
+      frames[pages[i]] = frame;
+      nTouched++;
+    }
+    ck_assert_int_eq(frame, frames[pages[i]]);
+  }
+  ck_assert_int_eq(tlb_sim_n_pages(tlb), nTouched);
+  qsort(frames, nPages, sizeof(MemAddr), compare_addrs);
+  for (unsigned k = 1; k < nTouched; k++) {
+    ck_assert_int_ne(frames[k], frames[k - 1]);
+  }
+  free_tlb_sim(tlb);
+}
+END_TEST
+
+/** Cycling over 6 pages always misses a 4-entry LRU L1 TLB but fits in
+ *  an 8-entry L2, so there is a page walk only on first touch.
+ */
+START_TEST(tlbLevelsCycle)
+{
+  enum { N_CYCLE = 6, N_ROUNDS = 10, N_ADDRS = N_CYCLE*N_ROUNDS };
+  TlbParams params = {
+    .nPageBits = get_page_bits("4K"), .nPhysAddrBits = 40,
+    .pageMap = SEQ_PAGE_MAP,
+  };
+  ck_assert(get_tlb_levels("0-4,0-8", &params));
+  TlbSim *tlb = new_tlb_sim(&params);
+  MemAddr vaddrs[2*N_ADDRS], paddrs[2*N_ADDRS];
+  for (unsigned i = 0; i < N_ADDRS; i++) {
+    //two accesses to each page, the second always an L1 hit
+    vaddrs[2*i] = (MemAddr)(i % N_CYCLE) << 12;
+    vaddrs[2*i + 1] = vaddrs[2*i] + 8;
+  }
+  tlb_sim_translate(tlb, vaddrs, paddrs, 2*N_ADDRS);
+  CacheLevelStats l1 = tlb_sim_stats(tlb, 0), l2 = tlb_sim_stats(tlb, 1);
+  ck_assert_int_eq(l1.nAccesses, 2*N_ADDRS);
+  ck_assert_int_eq(l1.nHits, N_ADDRS);
+  ck_assert_int_eq(l2.nAccesses, N_ADDRS);
+  ck_assert_int_eq(l2.nHits, N_ADDRS - N_CYCLE);
+  ck_assert_int_eq(paddrs[2*N_CYCLE + 3], vaddrs[3]);
+  free_tlb_sim(tlb);
+}
+END_TEST
+
+/** get_tlb_levels() rejects bad specs */
+START_TEST(tlbSpecsChecked)
+{
+  TlbParams params;
+  ck_assert(get_tlb_levels("6-4", &params) && params.nLevels == 1);
+  ck_assert(get_tlb_levels("4-4,7-12,9-16", &params));
+  ck_assert(params.nLevels == 3 && params.nSetBits[2] == 9 &&
+            params.nEntriesPerSet[2] == 16);
+  ck_assert(!get_tlb_levels("4-4,", &params));
+  ck_assert(!get_tlb_levels("4", &params));
+  ck_assert(!get_tlb_levels("4-0", &params));
+  ck_assert(!get_tlb_levels("1-1,1-1,1-1,1-1,1-1", &params));
+  ck_assert_int_eq(get_page_bits("2M"), 21);
+  ck_assert_int_lt(get_page_bits("8K"), 0);
+  ck_assert_int_eq(get_page_map("hash"), HASH_PAGE_MAP);
+}
+END_TEST
+
+static Suite *
+translationSuite(void)
+{
+  Suite *suite = suite_create("translation");
+  TCase *translationTests = tcase_create("translation");
+  tcase_add_loop_test(translationTests, translationIsOneToOne,
+                      0, 3*N_PAGE_MAPS);
+  tcase_add_test(translationTests, tlbLevelsCycle);
+  tcase_add_test(translationTests, tlbSpecsChecked);
+  suite_add_tcase(suite, translationTests);
+  return suite;
+}
+
+/****************************** Trace Tests ****************************/
+
+enum { TRACE_CHUNK_SIZE = 1 << 20 };  //CHUNK_SIZE of trace.c
+
+/** Return the addresses of hex trace text, which may contain NULs */
+static const MemAddr *
+read_hex_trace(const char *text, size_t len, size_t *nP)
+{
+  FILE *in = tmpfile();
+  ck_assert(in != NULL);
+  ck_assert(fwrite(text, 1, len, in) == len);
+  rewind(in);
+  Trace *trace = new_trace(in, HEX_TRACE);
+  size_t n;
+  const MemAddr *addrs = load_trace(trace, &n);
+  MemAddr *copy = malloc((n + 1) * sizeof(MemAddr));
+  memcpy(copy, addrs, n * sizeof(MemAddr));
+  free_trace(trace);
+  fclose(in);
+  *nP = n;
+  return copy;
+}
+
+/** Tokens which cross a chunk boundary of the reader, at every split
+ *  point, convert as fscanf("%lx") would convert them whole.
+ */
+START_TEST(hexTokensCrossChunks)
+{
+  static const struct {
+    const char *token;
+    MemAddr addr;
+  } tokens[] = {
+    { "0x1f", 0x1f }, { "-0X5", -(MemAddr)5 }, { "+12", 0x12 },
+    { "0x", 0 }, { "ffffffffffffffffff", ULONG_MAX },
+  };
+  enum { LEN = TRACE_CHUNK_SIZE + 16 };
+  char *text = malloc(LEN);
+  for (int i = 0; i < sizeof(tokens)/sizeof(tokens[0]); i++) {
+    size_t tokenLen = strlen(tokens[i].token);
+    for (size_t split = 0; split <= tokenLen; split++) {
+      size_t start = TRACE_CHUNK_SIZE - split;
+      memset(text, ' ', start);
+      memcpy(text + start, tokens[i].token, tokenLen);
+      strcpy(text + start + tokenLen, " 7\n");
+      size_t n;
+      const MemAddr *addrs =
+        read_hex_trace(text, start + tokenLen + 3, &n);
+      ck_assert_int_eq(n, 2);
+      ck_assert(addrs[0] == tokens[i].addr && addrs[1] == 7);
+      free((void *)addrs);
+    }
+  }
+  free(text);
+}
+END_TEST
+
+/** A token longer than a chunk is still a single address */
+START_TEST(hexTokenLongerThanChunk)
+{
+  enum { N_ZEROS = 2*TRACE_CHUNK_SIZE + 3 };
+  char *text = malloc(N_ZEROS + 8);
+  memset(text, '0', N_ZEROS);
+  strcpy(text + N_ZEROS, "1\n2\n");
+  size_t n;
+  const MemAddr *addrs = read_hex_trace(text, strlen(text), &n);
+  ck_assert_int_eq(n, 2);
+  ck_assert(addrs[0] == 1 && addrs[1] == 2);
+  free((void *)addrs);
+  free(text);
+}
+END_TEST
+
+static Suite *
+traceSuite(void)
+{
+  Suite *suite = suite_create("trace");
+  TCase *traceTests = tcase_create("trace");
+  tcase_add_test(traceTests, hexTokensCrossChunks);
+  tcase_add_test(traceTests, hexTokenLongerThanChunk);
+  suite_add_tcase(suite, traceTests);
+  return suite;
+}
+
+/************************** Trace Capture Tests ************************/
+
+enum {
+  N_CAPTURE_THREADS = MAX_CORES + 6,
+  CAPTURE_SECS = 30,              /** longer means the capture hung */
+};
+
+static int captureData[N_CAPTURE_THREADS];
+static pthread_barrier_t captureBarrier;
+
+/** Record a store, then wait for all the other threads to record
+ *  theirs, so that they all hold capture blocks at once.
+ */
+static void *
+storeThenWait(void *arg)
+{
+  TRACE_STORE((int *)arg);
+  pthread_barrier_wait(&captureBarrier);
+  return NULL;
+}
+
+/** Capture a store by each of N_CAPTURE_THREADS threads running at
+ *  once to path as a RW_TRACE; the trace is written at exit.
+ */
+static void
+captureThreads(const char *path)
+{
+  setenv("TRACE_CAPTURE_FILE", path, 1);
+  setenv("TRACE_CAPTURE_FORMAT", "rw", 1);
+  if (!freopen("/dev/null", "w", stderr)) exit(1); //no warning of wrap
+  alarm(CAPTURE_SECS);
+  pthread_t threads[N_CAPTURE_THREADS];
+  pthread_barrier_init(&captureBarrier, NULL, N_CAPTURE_THREADS);
+  for (int i = 0; i < N_CAPTURE_THREADS; i++) {
+    if (pthread_create(&threads[i], NULL, storeThenWait,
+                       &captureData[i]) != 0) {
+      exit(1);
+    }
+  }
+  for (int i = 0; i < N_CAPTURE_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  exit(0);
+}
+
+/** More threads than MAX_CORES, or capture blocks, record at once
+ *  without hanging, and each is traced as a core cache-coher accepts.
+ */
+START_TEST(captureManyThreads)
+{
+  char path[] = "/tmp/capture-testXXXXXX";
+  int fd = mkstemp(path);
+  ck_assert_int_ge(fd, 0);
+  close(fd);
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  ck_assert_int_ge(pid, 0);
+  if (pid == 0) captureThreads(path);
+  int status;
+  ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+  ck_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  FILE *in = fopen(path, "r");
+  ck_assert(in != NULL);
+  Trace *trace = new_trace(in, RW_TRACE);
+  size_t n;
+  const AccessOp *ops;
+  const MemAddr *addrs = load_trace_ops(trace, &n, &ops);
+  ck_assert_int_eq(n, N_CAPTURE_THREADS);
+  ck_assert(ops != NULL);
+  int nStores[N_CAPTURE_THREADS] = { 0 };
+  for (size_t k = 0; k < n; k++) {
+    ck_assert_int_eq(ops[k].kind, WRITE_ACCESS);
+    ck_assert_int_lt(ops[k].core, MAX_CORES);
+    size_t i = (const int *)addrs[k] - captureData;
+    ck_assert_int_lt(i, N_CAPTURE_THREADS);
+    nStores[i]++;
+  }
+  for (int i = 0; i < N_CAPTURE_THREADS; i++) {
+    ck_assert_int_eq(nStores[i], 1);
+  }
+  free_trace(trace);
+  fclose(in);
+  unlink(path);
+}
+END_TEST
+
+static Suite *
+captureSuite(void)
+{
+  Suite *suite = suite_create("capture");
+  TCase *captureTests = tcase_create("capture");
+  tcase_add_test(captureTests, captureManyThreads);
+  suite_add_tcase(suite, captureTests);
+  return suite;
+}
+
+/*************************** Main Test Function ************************/
+
+
+typedef Suite *SuiteMaker(void);
+static SuiteMaker *makers[] = {
+  wideTagsSuite,
+  differentialSuite,
+  batchSuite,
+  missClassSuite,
+  prefetchSuite,
+  snapshotSuite,
+  coherenceSuite,
+  synthSuite,
+  translationSuite,
+  traceSuite,
+  captureSuite,
+};
+
+
+int
+main(void)
+{
+  Suite *dummy = suite_create("CacheSim Tests");
+  SRunner *runner = srunner_create(dummy);
+  for (int i = 0; i < sizeof(makers)/sizeof(makers[0]); i++) {
+    srunner_add_suite(runner, makers[i]());
+  }
+  srunner_set_fork_status(runner, CK_NOFORK);
+  srunner_run_all(runner, CK_NORMAL);
+  int nFail = srunner_ntests_failed(runner);
+  srunner_free(runner);
+  return nFail != 0;
+}
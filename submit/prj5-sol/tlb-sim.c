@@ -0,0 +1,286 @@
+#include "tlb-sim.h"
+
+#include "errors.h"
+#include "memalloc.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+  VIRT_ADDR_BITS = 64,
+  MIN_PAGE_SLOTS = 1024,       /** initial size of the page table */
+  N_RECENT_PAGES = 4096,       /** size of recentPages[] */
+  LOOKUP_CHUNK = 1024,         /** # of accesses looked up per batch */
+};
+
+/** Page table entry: vpn + 1 so that 0 marks an empty slot */
+typedef struct {
+  MemAddr vpnPlus1;
+  MemAddr frame;
+} PageEntry;
+
+struct TlbSimImpl {
+  TlbParams params;
+  CacheSim *levels[MAX_TLB_LEVELS];
+  CacheLevelStats stats[MAX_TLB_LEVELS];
+  MemAddr pageMask;          /** offset bits of an address */
+  MemAddr frameMask;         /** bits of a frame # */
+  unsigned long nFrames;     /** 2**(nPhysAddrBits - nPageBits) */
+  MemAddr lastVpn;           /** page of the previous access */
+  MemAddr lastFrame;         /** its frame */
+  unsigned long nRepeats;    /** # of accesses to the same page as the
+                              *  previous one, which are L1 hits not
+                              *  passed to levels[0] */
+  MemAddr lookups[LOOKUP_CHUNK];     /** pages to look up in a level */
+  CacheResult results[LOOKUP_CHUNK]; /** and their results */
+  PageEntry recentPages[N_RECENT_PAGES]; /** direct-mapped by vpn: a
+                              *  cache of pages[] small enough to stay
+                              *  in the host's cache */
+  PageEntry *pages;          /** open-addressed page table */
+  size_t nSlots;             /** power of 2 */
+  unsigned long nPages;      /** # of pages in pages[] */
+};
+
+static const struct {
+  const char *name;
+  unsigned nBits;
+} PAGE_SIZES[] = {
+  { "4K", 12 }, { "2M", 21 }, { "1G", 30 },
+};
+
+//must be in sync with PageMap enum
+static const char *PAGE_MAPS[] = { "seq", "hash" };
+
+/** Translate from page size name 4K|2M|1G to its # of bits.  Return
+ *  < 0 on error.
+ */
+int
+get_page_bits(const char *name)
+{
+  for (size_t i = 0; i < sizeof(PAGE_SIZES)/sizeof(PAGE_SIZES[0]); i++) {
+    if (strcmp(name, PAGE_SIZES[i].name) == 0) return PAGE_SIZES[i].nBits;
+  }
+  return -1;
+}
+
+/** Translate from name seq|hash to PageMap enum.  Return < 0 on error */
+int
+get_page_map(const char *name)
+{
+  for (int i = 0; i < N_PAGE_MAPS; i++) {
+    if (strcmp(name, PAGE_MAPS[i]) == 0) return i;
+  }
+  return -1;
+}
+
+/** Parse spec s-E[,s-E]... of the TLB levels from the processor out
+ *  into params->nLevels, nSetBits[] and nEntriesPerSet[].  Returns
+ *  false on error.
+ */
+bool
+get_tlb_levels(const char *spec, TlbParams *params)
+{
+  unsigned n = 0;
+  const char *p = spec;
+  do {
+    if (n == MAX_TLB_LEVELS) return false;
+    char *q;
+    long s = strtol(p, &q, 10);
+    if (q == p || s < 0 || s > 32 || *q != '-') return false;
+    p = q + 1;
+    long e = strtol(p, &q, 10);
+    if (q == p || e < 1 || e > 1024) return false;
+    params->nSetBits[n] = s;
+    params->nEntriesPerSet[n] = e;
+    n++;
+    p = q;
+  } while (*p++ == ',');
+  if (p[-1] != '\0') return false;
+  params->nLevels = n;
+  return true;
+}
+
+/** Create and return a new translation stage with params.  Must have
+ *  params->nPageBits < params->nPhysAddrBits <= 64.
+ */
+TlbSim *
+new_tlb_sim(const TlbParams *params)
+{
+  assert(0 < params->nPageBits && params->nPageBits < params->nPhysAddrBits);
+  assert(params->nPhysAddrBits <= 64);
+  assert(params->nLevels > 0 && params->nLevels <= MAX_TLB_LEVELS);
+  TlbSim *tlb = callocChk(1, sizeof(TlbSim));
+  tlb->params = *params;
+  for (unsigned i = 0; i < params->nLevels; i++) {
+    CacheParams level = {
+      .nSetBits = params->nSetBits[i],
+      .nLinesPerSet = params->nEntriesPerSet[i],
+      .nLineBits = params->nPageBits,
+      .nMemAddrBits = VIRT_ADDR_BITS,
+      .replacement = LRU_R,
+    };
+    tlb->levels[i] = new_cache_sim(&level);
+  }
+  unsigned nFrameBits = params->nPhysAddrBits - params->nPageBits;
+  tlb->pageMask = (1UL << params->nPageBits) - 1;
+  tlb->nFrames = 1UL << nFrameBits;
+  tlb->frameMask = tlb->nFrames - 1;
+  tlb->lastVpn = ~0UL;       // no page has this #
+  tlb->nSlots = MIN_PAGE_SLOTS;
+  tlb->pages = callocChk(tlb->nSlots, sizeof(PageEntry));
+  return tlb;
+}
+
+/** Free all resources used by tlb */
+void
+free_tlb_sim(TlbSim *tlb)
+{
+  for (unsigned i = 0; i < tlb->params.nLevels; i++) {
+    free_cache_sim(tlb->levels[i]);
+  }
+  free(tlb->pages);
+  free(tlb);
+}
+
+static size_t
+page_slot(MemAddr vpn, size_t nSlots)
+{
+  return (vpn * 0x9E3779B97F4A7C15UL) >> 32 & (nSlots - 1);
+}
+
+/** Return the frame for the nth page touched: n itself or, for
+ *  HASH_PAGE_MAP, n under a seeded bijection of [0, nFrames).  An odd
+ *  multiplier, an added key and an xor of the high half into the low
+ *  half are each invertible modulo a power of 2.
+ */
+static MemAddr
+page_frame(const TlbSim *tlb, MemAddr n)
+{
+  if (tlb->params.pageMap == SEQ_PAGE_MAP) return n;
+  unsigned nFrameBits = tlb->params.nPhysAddrBits - tlb->params.nPageBits;
+  MemAddr key = (MemAddr)tlb->params.seed * 2 + 1;
+  for (int round = 0; round < 2; round++) {
+    n = (n * 0xBF58476D1CE4E5B9UL + key) & tlb->frameMask;
+    n ^= n >> ((nFrameBits + 1) / 2);
+  }
+  return n;
+}
+
+static void
+grow_pages(TlbSim *tlb)
+{
+  size_t nSlots = tlb->nSlots * 2;
+  PageEntry *pages = callocChk(nSlots, sizeof(PageEntry));
+  for (size_t i = 0; i < tlb->nSlots; i++) {
+    PageEntry *entry = &tlb->pages[i];
+    if (entry->vpnPlus1 == 0) continue;
+    size_t slot = page_slot(entry->vpnPlus1 - 1, nSlots);
+    while (pages[slot].vpnPlus1 != 0) slot = (slot + 1) & (nSlots - 1);
+    pages[slot] = *entry;
+  }
+  free(tlb->pages);
+  tlb->pages = pages;
+  tlb->nSlots = nSlots;
+}
+
+/** Return the frame of virtual page vpn, mapping it if it is new */
+static MemAddr
+lookup_frame(TlbSim *tlb, MemAddr vpn)
+{
+  PageEntry *recent = &tlb->recentPages[vpn % N_RECENT_PAGES];
+  if (recent->vpnPlus1 == vpn + 1) return recent->frame;
+  size_t slot = page_slot(vpn, tlb->nSlots);
+  while (tlb->pages[slot].vpnPlus1 != 0) {
+    if (tlb->pages[slot].vpnPlus1 == vpn + 1) {
+      *recent = tlb->pages[slot];
+      return recent->frame;
+    }
+    slot = (slot + 1) & (tlb->nSlots - 1);
+  }
+  if (tlb->nPages == tlb->nFrames) {
+    fatal("more than %lu pages touched: out of physical memory",
+          tlb->nFrames);
+  }
+  MemAddr frame = page_frame(tlb, tlb->nPages++);
+  tlb->pages[slot] = *recent = (PageEntry) { vpn + 1, frame };
+  if (tlb->nPages * 2 > tlb->nSlots) grow_pages(tlb);
+  return frame;
+}
+
+/** Look up lookups[n] in each level of tlb in turn, passing only the
+ *  misses of a level on to the next.  The levels are non-inclusive, so
+ *  a level's contents do not depend on those below it and each can
+ *  take the whole batch at once.
+ */
+static void
+lookup_levels(TlbSim *tlb, size_t n)
+{
+  for (unsigned i = 0; i < tlb->params.nLevels && n > 0; i++) {
+    CacheLevelStats *stats = &tlb->stats[i];
+    cache_sim_results(tlb->levels[i], tlb->lookups, n, tlb->results);
+    stats->nAccesses += n;
+    size_t nMisses = 0;
+    for (size_t k = 0; k < n; k++) {
+      CacheStatus status = tlb->results[k].status;
+      if (status == CACHE_HIT) continue;
+      if (status == CACHE_MISS_WITH_REPLACE) stats->nEvictions++;
+      tlb->lookups[nMisses++] = tlb->lookups[k];
+    }
+    stats->nHits += n - nMisses;
+    n = nMisses;
+  }
+}
+
+/** Translate vaddrs[0, n) in order, setting paddrs[i] to the physical
+ *  address of vaddrs[i] and looking each up in the TLB.  Calls
+ *  fatal() if more pages are touched than physical memory has frames.
+ */
+void
+tlb_sim_translate(TlbSim *tlb, const MemAddr vaddrs[], MemAddr paddrs[],
+                  size_t n)
+{
+  unsigned nPageBits = tlb->params.nPageBits;
+  size_t nLookups = 0;
+  for (size_t i = 0; i < n; i++) {
+    MemAddr vaddr = vaddrs[i];
+    MemAddr vpn = vaddr >> nPageBits;
+    if (vpn == tlb->lastVpn) {
+      // an L1 hit on its most recently used entry, which would leave
+      // every level unchanged
+      tlb->nRepeats++;
+    }
+    else {
+      tlb->lookups[nLookups++] = vaddr;
+      if (nLookups == LOOKUP_CHUNK) {
+        lookup_levels(tlb, nLookups);
+        nLookups = 0;
+      }
+      tlb->lastVpn = vpn;
+      tlb->lastFrame = lookup_frame(tlb, vpn);
+    }
+    paddrs[i] = (tlb->lastFrame << nPageBits) | (vaddr & tlb->pageMask);
+  }
+  lookup_levels(tlb, nLookups);
+}
+
+/** Return statistics for TLB level of tlb */
+CacheLevelStats
+tlb_sim_stats(const TlbSim *tlb, unsigned level)
+{
+  assert(level < tlb->params.nLevels);
+  CacheLevelStats stats = tlb->stats[level];
+  if (level == 0) {
+    stats.nAccesses += tlb->nRepeats;
+    stats.nHits += tlb->nRepeats;
+  }
+  return stats;
+}
+
+/** Return the # of pages tlb has mapped */
+unsigned long
+tlb_sim_n_pages(const TlbSim *tlb)
+{
+  return tlb->nPages;
+}
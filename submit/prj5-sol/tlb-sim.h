@@ -0,0 +1,87 @@
+#ifndef TLB_SIM_H_
+#define TLB_SIM_H_
+
+#include "cache-hier.h"
+#include "cache-sim.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Virtual-to-physical address translation in front of a physically
+ *  addressed cache.  Each virtual page is given a physical page frame
+ *  when it is first touched; every access also looks up its page in a
+ *  multi-level TLB.  Each TLB level is an LRU CacheSim whose lines are
+ *  pages, so a level of 2**s sets of E entries is an s-E-p-64 cache
+ *  for 2**p byte pages.  The levels are non-inclusive: a miss in one
+ *  is looked up in the next and fills both.  A miss in the last level
+ *  is a page walk.
+ */
+
+/** Opaque implementation */
+typedef struct TlbSimImpl TlbSim;
+
+/** How frames are assigned to pages on first touch */
+typedef enum {
+  SEQ_PAGE_MAP,     /** successive frames from 0, so pages touched
+                     *  together are physically contiguous */
+  HASH_PAGE_MAP,    /** a seeded permutation of the frames, scattering
+                     *  pages over physical memory like a long-running
+                     *  allocator */
+  N_PAGE_MAPS
+} PageMap;
+
+/** All page sizes and page maps separated by '|', for usage messages */
+#define PAGE_SIZE_NAMES "4K|2M|1G"
+#define PAGE_MAP_NAMES "seq|hash"
+
+/** Default TLB: a 64-entry 4-way L1 and a 1536-entry 12-way L2 */
+#define DEFAULT_TLB_SPEC "4-4,7-12"
+
+enum { MAX_TLB_LEVELS = 4 };
+
+typedef struct {
+  unsigned nPageBits;       /** page size is 2**this: 12, 21 or 30 */
+  unsigned nPhysAddrBits;   /** physical memory is 2**this bytes */
+  PageMap pageMap;
+  unsigned nLevels;         /** # of TLB levels, from the processor out */
+  unsigned nSetBits[MAX_TLB_LEVELS];      /** s of each level */
+  unsigned nEntriesPerSet[MAX_TLB_LEVELS];/** E of each level */
+  unsigned seed;            /** for HASH_PAGE_MAP */
+} TlbParams;
+
+/** Translate from page size name 4K|2M|1G to its # of bits.  Return
+ *  < 0 on error.
+ */
+int get_page_bits(const char *name);
+
+/** Translate from name seq|hash to PageMap enum.  Return < 0 on error */
+int get_page_map(const char *name);
+
+/** Parse spec s-E[,s-E]... of the TLB levels from the processor out
+ *  into params->nLevels, nSetBits[] and nEntriesPerSet[].  Returns
+ *  false on error.
+ */
+bool get_tlb_levels(const char *spec, TlbParams *params);
+
+/** Create and return a new translation stage with params.  Must have
+ *  params->nPageBits < params->nPhysAddrBits <= 64.
+ */
+TlbSim *new_tlb_sim(const TlbParams *params);
+
+/** Free all resources used by tlb */
+void free_tlb_sim(TlbSim *tlb);
+
+/** Translate vaddrs[0, n) in order, setting paddrs[i] to the physical
+ *  address of vaddrs[i] and looking each up in the TLB.  Calls
+ *  fatal() if more pages are touched than physical memory has frames.
+ */
+void tlb_sim_translate(TlbSim *tlb, const MemAddr vaddrs[], MemAddr paddrs[],
+                       size_t n);
+
+/** Return statistics for TLB level of tlb */
+CacheLevelStats tlb_sim_stats(const TlbSim *tlb, unsigned level);
+
+/** Return the # of pages tlb has mapped */
+unsigned long tlb_sim_n_pages(const TlbSim *tlb);
+
+#endif //ifndef TLB_SIM_H_
@@ -0,0 +1,279 @@
+#define _POSIX_C_SOURCE 200809L
+#define TRACE_CAPTURE_IMPL
+
+#include "trace-capture.h"
+#include "cache-coher.h"
+#include "cache-sim.h"
+#include "trace.h"
+
+#include "errors.h"
+#include "memalloc.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Each thread fills a CaptureBlock of its own.  A full block goes on
+ *  a FIFO which the flusher thread writes out, returning each written
+ *  block to a free stack for reuse.  Besides the blocks held by
+ *  threads, at most MAX_BLOCKS exist, so that any # of threads can
+ *  record at once while threads which outrun the disk wait.  The lock
+ *  is taken only once per block, so recording an access is a few
+ *  stores to thread-local memory.
+ */
+enum {
+  CAPTURE_BLOCK_SIZE = 1 << 16,  /** # of accesses per block */
+  MAX_BLOCKS = 64,               /** at most 48 MiB of unheld blocks */
+};
+
+static const char *DEFAULT_PATH = "trace-capture.out";
+
+typedef struct {
+  size_t n;
+  MemAddr addrs[CAPTURE_BLOCK_SIZE];
+  AccessOp ops[CAPTURE_BLOCK_SIZE];
+} CaptureBlock;
+
+/** State of a recording thread */
+typedef struct {
+  CaptureBlock *block;           /** being filled, NULL before first use */
+  unsigned char core;            /** tags this thread's accesses */
+} CaptureThread;
+
+static struct {
+  pthread_once_t once;
+  pthread_key_t threadKey;       /** to submit a block at thread exit */
+  pthread_t flusher;
+  FILE *out;
+  TraceWriter *writer;
+  atomic_uint nThreads;          /** # of threads ever recording */
+  pthread_mutex_t lock;          /** protects the fields below */
+  pthread_cond_t isChanged;      /** signalled on any change below */
+  CaptureBlock *full[MAX_BLOCKS];/** FIFO ring of blocks to write */
+  unsigned head, nFull;          /** next to write, # in FIFO */
+  CaptureBlock *free[MAX_BLOCKS];/** written blocks for reuse */
+  unsigned nFree;
+  unsigned nAllocated;           /** # of blocks in existence */
+  unsigned nHeld;                /** # of those held by threads */
+  bool isFinishing;              /** flusher exits once FIFO is empty */
+} capture = {
+  .once = PTHREAD_ONCE_INIT,
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .isChanged = PTHREAD_COND_INITIALIZER,
+};
+
+static atomic_bool isStopped;
+
+//initial-exec TLS is a plain offset from the thread pointer, and is
+//available to a library loaded by LD_PRELOAD
+static _Thread_local CaptureThread thisThread
+  __attribute__((tls_model("initial-exec")));
+
+static void *
+flush_blocks(void *arg)
+{
+  pthread_mutex_lock(&capture.lock);
+  for (;;) {
+    while (capture.nFull == 0 && !capture.isFinishing) {
+      pthread_cond_wait(&capture.isChanged, &capture.lock);
+    }
+    if (capture.nFull == 0) break;
+    CaptureBlock *block = capture.full[capture.head];
+    capture.head = (capture.head + 1) % MAX_BLOCKS;
+    capture.nFull--;
+    pthread_mutex_unlock(&capture.lock);
+    write_trace_ops(capture.writer, block->addrs, block->ops, block->n);
+    block->n = 0;
+    pthread_mutex_lock(&capture.lock);
+    capture.free[capture.nFree++] = block;
+    pthread_cond_broadcast(&capture.isChanged);
+  }
+  pthread_mutex_unlock(&capture.lock);
+  return NULL;
+}
+
+/** Wait, with the lock held, until an unheld block may be added: the
+ *  free stack is not empty or there are fewer than MAX_BLOCKS unheld
+ *  blocks.  The flusher always makes progress, since every unheld
+ *  block not on the free stack is queued for it or being written.
+ */
+static void
+wait_for_unheld_room(void)
+{
+  while (capture.nFree == 0 &&
+         capture.nAllocated - capture.nHeld >= MAX_BLOCKS) {
+    pthread_cond_wait(&capture.isChanged, &capture.lock);
+  }
+}
+
+/** Queue block (if any) for the flusher, the lock being held; there
+ *  is room as every unheld block is in at most one of full[] and
+ *  free[], and there are at most MAX_BLOCKS of them.
+ */
+static void
+submit_block(CaptureBlock *block)
+{
+  if (block->n > 0) {
+    capture.full[(capture.head + capture.nFull++) % MAX_BLOCKS] = block;
+  }
+  else {
+    capture.free[capture.nFree++] = block;
+  }
+  capture.nHeld--;
+  pthread_cond_broadcast(&capture.isChanged);
+}
+
+/** Hand block (if any) to the flusher and return an empty block */
+static CaptureBlock *
+exchange_block(CaptureBlock *block)
+{
+  CaptureBlock *empty = NULL;
+  pthread_mutex_lock(&capture.lock);
+  //take the empty block first, which makes room to submit block
+  wait_for_unheld_room();
+  if (capture.nFree > 0) {
+    empty = capture.free[--capture.nFree];
+  }
+  else {
+    capture.nAllocated++;
+  }
+  capture.nHeld++;
+  if (block) submit_block(block);
+  pthread_mutex_unlock(&capture.lock);
+  if (!empty) {
+    empty = mallocChk(sizeof(CaptureBlock));
+    empty->n = 0;
+  }
+  return empty;
+}
+
+/** Submit the partial block of an exiting thread */
+static void
+end_thread(void *arg)
+{
+  CaptureThread *thread = arg;
+  CaptureBlock *block = thread->block;
+  if (!block) return;
+  CaptureBlock *surplus = NULL;
+  pthread_mutex_lock(&capture.lock);
+  wait_for_unheld_room();
+  if (capture.nAllocated - capture.nHeld >= MAX_BLOCKS) {
+    //no room for one more unheld block, so drop a free one
+    surplus = capture.free[--capture.nFree];
+    capture.nAllocated--;
+  }
+  submit_block(block);
+  pthread_mutex_unlock(&capture.lock);
+  free(surplus);
+  thread->block = NULL;
+}
+
+static void
+start_capture(void)
+{
+  const char *path = getenv("TRACE_CAPTURE_FILE");
+  const char *formatName = getenv("TRACE_CAPTURE_FORMAT");
+  if (!path) path = DEFAULT_PATH;
+  int format = formatName ? get_trace_format(formatName) : BIN_TRACE;
+  if (format < 0) {
+    fatal("TRACE_CAPTURE_FORMAT must be " TRACE_FORMAT_NAMES);
+  }
+  if (!(capture.out = fopen(path, "w"))) {
+    fatal("cannot open %s: %s", path, strerror(errno));
+  }
+  capture.writer = new_trace_writer(capture.out, format);
+  if (pthread_key_create(&capture.threadKey, end_thread) != 0 ||
+      pthread_create(&capture.flusher, NULL, flush_blocks, NULL) != 0) {
+    fatal("cannot create trace capture thread");
+  }
+}
+
+/** Set up the calling thread (and the library) on its first access */
+static void
+start_thread(CaptureThread *thread)
+{
+  pthread_once(&capture.once, start_capture);
+  unsigned nThreads = atomic_fetch_add(&capture.nThreads, 1);
+  //wrap at MAX_CORES, not MAX_TRACE_CORE, so cache-coher accepts the trace
+  _Static_assert(MAX_CORES <= MAX_TRACE_CORE + 1, "cores not traceable");
+  if (nThreads == MAX_CORES) {
+    //not error(), which is glibc's error(3) in an LD_PRELOAD library
+    fprintf(stderr, "trace-capture: more than %d threads, so threads # %d "
+            "on share the cores of earlier threads\n", MAX_CORES, MAX_CORES);
+  }
+  thread->core = nThreads % MAX_CORES;
+  thread->block = exchange_block(NULL);
+  pthread_setspecific(capture.threadKey, thread);
+}
+
+static inline void
+record(const volatile void *addr, AccessKind kind, size_t size)
+{
+  if (atomic_load_explicit(&isStopped, memory_order_relaxed)) return;
+  CaptureThread *thread = &thisThread;
+  if (!thread->block) start_thread(thread);
+  CaptureBlock *block = thread->block;
+  size_t n = block->n;
+  block->addrs[n] = (MemAddr)addr;
+  block->ops[n] = (AccessOp) {
+    kind, thread->core, (size > USHRT_MAX) ? USHRT_MAX : size
+  };
+  if ((block->n = n + 1) == CAPTURE_BLOCK_SIZE) {
+    thread->block = exchange_block(block);
+  }
+}
+
+/** Record a read of size bytes at addr */
+void
+trace_capture_load(const volatile void *addr, size_t size)
+{
+  record(addr, READ_ACCESS, size);
+}
+
+/** Record a write of size bytes at addr */
+void
+trace_capture_store(const volatile void *addr, size_t size)
+{
+  record(addr, WRITE_ACCESS, size);
+}
+
+/** Pause recording in all threads, e.g. around a warm-up */
+void
+trace_capture_stop(void)
+{
+  atomic_store(&isStopped, true);
+}
+
+/** Resume recording; it starts out on */
+void
+trace_capture_start(void)
+{
+  atomic_store(&isStopped, false);
+}
+
+/** At exit, write out everything recorded by the exiting thread and
+ *  every thread which has already exited.
+ */
+__attribute__((destructor))
+static void
+finish_capture(void)
+{
+  if (!capture.writer) return;
+  atomic_store(&isStopped, true);
+  end_thread(&thisThread);
+  pthread_mutex_lock(&capture.lock);
+  capture.isFinishing = true;
+  pthread_cond_broadcast(&capture.isChanged);
+  pthread_mutex_unlock(&capture.lock);
+  pthread_join(capture.flusher, NULL);
+  free_trace_writer(capture.writer);
+  if (fclose(capture.out) != 0) {
+    fatal("cannot write trace: %s", strerror(errno));
+  }
+  for (unsigned i = 0; i < capture.nFree; i++) free(capture.free[i]);
+}
@@ -0,0 +1,59 @@
+#ifndef TRACE_CAPTURE_H_
+#define TRACE_CAPTURE_H_
+
+#include <stddef.h>
+
+/** Capture of memory traces from live programs for cache-sim.  The
+ *  hot regions of a program are instrumented with TRACE_LOAD() and
+ *  TRACE_STORE(); running it with libtrace-capture.so in LD_PRELOAD
+ *  (or linked with trace-capture.o and trace.o) writes the accesses
+ *  to the trace file named by environment variable TRACE_CAPTURE_FILE
+ *  (default trace-capture.out) in format TRACE_CAPTURE_FORMAT (any
+ *  trace format name, default bin).  Without the library the macros
+ *  cost only a test of a null pointer.
+ *
+ *  Each thread appends to a buffer of its own without locking; full
+ *  buffers are written by a background thread, so the program only
+ *  waits if it outruns the disk.  The trace is exact for a single
+ *  thread.  The blocks of several threads are interleaved in the
+ *  order they fill, and in a RW_TRACE each access is tagged with the
+ *  # of its thread (in order of first access, modulo MAX_CORES of
+ *  cache-coher.h, with a warning on stderr once threads share cores)
+ *  as its core.  Buffers are written when their
+ *  thread exits and, for the thread calling exit(), at exit;
+ *  accesses of threads still running at exit are lost.
+ */
+
+#ifndef TRACE_CAPTURE_IMPL
+#define TRACE_CAPTURE_WEAK __attribute__((weak))
+#else
+#define TRACE_CAPTURE_WEAK
+#endif
+
+/** Record a read of size bytes at addr */
+TRACE_CAPTURE_WEAK
+void trace_capture_load(const volatile void *addr, size_t size);
+
+/** Record a write of size bytes at addr */
+TRACE_CAPTURE_WEAK
+void trace_capture_store(const volatile void *addr, size_t size);
+
+/** Pause recording in all threads, e.g. around a warm-up */
+TRACE_CAPTURE_WEAK void trace_capture_stop(void);
+
+/** Resume recording; it starts out on */
+TRACE_CAPTURE_WEAK void trace_capture_start(void);
+
+/** Record a read or write of the object p points to, if the
+ *  capture library is present.
+ */
+#define TRACE_LOAD(p) \
+  (trace_capture_load ? trace_capture_load((p), sizeof(*(p))) : (void)0)
+#define TRACE_STORE(p) \
+  (trace_capture_store ? trace_capture_store((p), sizeof(*(p))) : (void)0)
+
+/** Pause or resume recording, if the capture library is present */
+#define TRACE_STOP() (trace_capture_stop ? trace_capture_stop() : (void)0)
+#define TRACE_START() (trace_capture_start ? trace_capture_start() : (void)0)
+
+#endif //ifndef TRACE_CAPTURE_H_
@@ -0,0 +1,57 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void
+usage(const char *program, const char *msg)
+{
+  fprintf(stderr, "%susage: %s [-i " TRACE_FORMAT_NAMES "] "
+          "-o " TRACE_FORMAT_NAMES "\n"
+          "copies the trace of addresses on stdin to stdout, converting\n"
+          "it from the -i format (default hex) to the -o format; loads and\n"
+          "stores are only kept from rw to rw\n",
+          msg, program);
+  exit(1);
+}
+
+static int
+get_format_arg(const char *program, int argc, const char *argv[], int i)
+{
+  if (i >= argc - 1) usage(program, "format option requires an argument\n");
+  int format = get_trace_format(argv[i + 1]);
+  if (format < 0) usage(program, "format must be " TRACE_FORMAT_NAMES "\n");
+  return format;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const char *program = argv[0];
+  int inFormat = HEX_TRACE;
+  int outFormat = -1;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-i") == 0) {
+      inFormat = get_format_arg(program, argc, argv, i++);
+    }
+    else if (strcmp(argv[i], "-o") == 0) {
+      outFormat = get_format_arg(program, argc, argv, i++);
+    }
+    else {
+      usage(program, "invalid option\n");
+    }
+  }
+  if (outFormat < 0) usage(program, "-o format required\n");
+  Trace *trace = new_threaded_trace(stdin, inFormat);
+  TraceWriter *writer = new_trace_writer(stdout, outFormat);
+  const MemAddr *addrs;
+  const AccessOp *ops;
+  size_t n;
+  while ((addrs = next_trace_ops_block(trace, &n, &ops)) != NULL) {
+    write_trace_ops(writer, addrs, ops, n);
+  }
+  free_trace_writer(writer);
+  free_trace(trace);
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include "synth-trace.h"
+#include "trace.h"
+
+#include "memalloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+  DEFAULT_N_ACCESSES = 1000000,
+  DEFAULT_FOOTPRINT = 16 << 20,
+};
+
+static void
+usage(const char *program, const char *msg)
+{
+  fprintf(stderr, "%susage: %s [-o " TRACE_FORMAT_NAMES "] [-n N_ACCESSES] "
+          "[-f FOOTPRINT] [-s SEED]\n"
+          "          " SYNTH_PATTERN_NAMES "[:ARG]\n"
+          "writes a synthetic trace of N_ACCESSES (default %d) 8-byte\n"
+          "accesses to stdout in the -o format (default bin):\n"
+          "  seq:          successive elements\n"
+          "  stride:BYTES  every BYTES'th byte (default 256)\n"
+          "  uniform:      uniformly random elements\n"
+          "  zipf:THETA    64-byte items with Zipf exponent 0 < THETA < 1\n"
+          "                (default 0.99)\n"
+          "  chase:        pointer chase around a random cycle of 64-byte\n"
+          "                nodes\n"
+          "  matmul:N      lab11 simple-matmul of N x N doubles (default 128)\n"
+          "  tmatmul:N     lab11 transpose-matmul of N x N doubles\n"
+          "the first five range over FOOTPRINT bytes (default 16M; K, M and\n"
+          "G suffixes allowed) and the matmuls repeat as needed; only the\n"
+          "matmuls write, so use -o rw to keep their stores\n",
+          msg, program, DEFAULT_N_ACCESSES);
+  exit(1);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const char *program = argv[0];
+  int format = BIN_TRACE;
+  unsigned long nAccesses = DEFAULT_N_ACCESSES;
+  SynthParams params = { .footprint = DEFAULT_FOOTPRINT, .seed = 0 };
+  int i;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    const char *opt = argv[i];
+    if (i >= argc - 1) usage(program, "option requires an argument\n");
+    const char *arg = argv[++i];
+    char *p;
+    if (strcmp(opt, "-o") == 0) {
+      if ((format = get_trace_format(arg)) < 0) {
+        usage(program, "trace format must be " TRACE_FORMAT_NAMES "\n");
+      }
+    }
+    else if (strcmp(opt, "-n") == 0) {
+      nAccesses = strtoul(arg, &p, 10);
+      if (arg[0] == '-' || *p != '\0') {
+        usage(program, "N_ACCESSES must be a non-negative integer\n");
+      }
+    }
+    else if (strcmp(opt, "-f") == 0) {
+      if (!get_synth_bytes(arg, &params.footprint)) {
+        usage(program, "invalid FOOTPRINT\n");
+      }
+    }
+    else if (strcmp(opt, "-s") == 0) {
+      params.seed = strtoul(arg, &p, 10);
+      if (arg[0] == '-' || *p != '\0') {
+        usage(program, "seed must be a non-negative integer\n");
+      }
+    }
+    else {
+      usage(program, "invalid option\n");
+    }
+  }
+  if (i != argc - 1) usage(program, "pattern required\n");
+  if (!get_synth_params(argv[i], &params)) {
+    usage(program, "invalid pattern\n");
+  }
+  MemAddr *addrs = mallocChk((nAccesses + 1) * sizeof(MemAddr));
+  AccessOp *ops = mallocChk((nAccesses + 1) * sizeof(AccessOp));
+  synth_trace(&params, addrs, ops, nAccesses);
+  TraceWriter *writer = new_trace_writer(stdout, format);
+  write_trace_ops(writer, addrs, ops, nAccesses);
+  free_trace_writer(writer);
+  free(ops);
+  free(addrs);
+  return 0;
+}
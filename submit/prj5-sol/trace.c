@@ -0,0 +1,970 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+
+#include "errors.h"
+#include "memalloc.h"
+
+#include <zlib.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+enum {
+  BLOCK_SIZE = 4096,            /** max # of addresses in a block */
+  CHUNK_SIZE = 1 << 20,         /** # of bytes read at a time when
+                                 *  input cannot be mapped */
+  MAX_VARINT_BYTES = 10,        /** LEB128 bytes for a 64-bit value */
+  ADDR_BYTES = 8,
+};
+
+static const char *FORMAT_NAMES[] = { "hex", "bin", "delta", "rw" };
+
+/** Translate from format name "hex", "bin", "delta" or "rw" to a
+ *  TraceFormat.  Return < 0 on error.
+ */
+int
+get_trace_format(const char *name)
+{
+  for (int i = 0; i < N_TRACE_FORMATS; i++) {
+    if (strcmp(name, FORMAT_NAMES[i]) == 0) return i;
+  }
+  return -1;
+}
+
+/** Text formats are decoded from a NUL-terminated buffer */
+static inline bool
+is_text_format(TraceFormat format)
+{
+  return format == HEX_TRACE || format == RW_TRACE;
+}
+
+static inline bool
+is_little_endian(void)
+{
+  return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+}
+
+/*************************** Reader ************************************/
+
+/** Compression detected from the first bytes of the input */
+typedef enum {
+  NO_COMPRESSION,
+  GZIP_COMPRESSION,        /** inflated in-process by zlib */
+  ZSTD_COMPRESSION,        /** decompressed by a zstd -d child process */
+} Compression;
+
+typedef struct TraceRingImpl TraceRing;
+
+static const MemAddr *next_ring_block(TraceRing *ring, size_t *nP,
+                                      const AccessOp **opsP);
+static void free_trace_ring(TraceRing *ring);
+
+struct TraceImpl {
+  TraceFormat format;
+  int fd;                      /** fd of uncompressed (or zstd'd) input */
+  Compression compression;
+  void *map;                   /** mapping of entire input, NULL if none */
+  size_t mapSize;
+  unsigned char *buf;          /** chunk buffer when input is not mapped;
+                                *  NUL-terminated for text formats */
+  const unsigned char *bytes;  /** current window of undecoded input */
+  size_t nBytes;               /** # of bytes in bytes[] */
+  size_t pos;                  /** index of next undecoded byte */
+  bool isEof;                  /** no more input beyond bytes[nBytes] */
+  bool isHexDone;              /** hex input had a token which is not an
+                                *  address, so nothing more is read */
+  MemAddr last;                /** last address decoded by DELTA_TRACE */
+  unsigned long nRecords;      /** # of lines decoded by RW_TRACE or
+                                *  records by DELTA_TRACE */
+  z_stream *zs;                /** GZIP_COMPRESSION inflate state */
+  unsigned char *zBuf;         /** GZIP_COMPRESSION compressed input */
+  bool isZEof;                 /** no more compressed input */
+  pid_t zstdPid;               /** ZSTD_COMPRESSION child until reaped */
+  TraceRing *ring;             /** non-NULL for new_threaded_trace() */
+  MemAddr *all;                /** addresses accumulated by load_trace() */
+  AccessOp *allOps;            /** their ops if the format has them */
+  MemAddr block[BLOCK_SIZE];
+  AccessOp ops[BLOCK_SIZE];    /** ops of block[] for RW_TRACE */
+};
+
+/** Return the compression used by input starting with bytes[n] */
+static Compression
+get_compression(const unsigned char *bytes, size_t n)
+{
+  static const unsigned char GZIP_MAGIC[] = { 0x1f, 0x8b };
+  static const unsigned char ZSTD_MAGIC[] = { 0x28, 0xb5, 0x2f, 0xfd };
+  if (n >= sizeof(GZIP_MAGIC) &&
+      memcmp(bytes, GZIP_MAGIC, sizeof(GZIP_MAGIC)) == 0) {
+    return GZIP_COMPRESSION;
+  }
+  if (n >= sizeof(ZSTD_MAGIC) &&
+      memcmp(bytes, ZSTD_MAGIC, sizeof(ZSTD_MAGIC)) == 0) {
+    return ZSTD_COMPRESSION;
+  }
+  return NO_COMPRESSION;
+}
+
+/** Try to map trace's fd.  Returns false if it is not a non-empty
+ *  regular file, cannot be mapped or is compressed.
+ */
+static bool
+map_trace(Trace *trace)
+{
+  struct stat st;
+  if (fstat(trace->fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    return false;
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, trace->fd, 0);
+  if (map == MAP_FAILED) return false;
+  if (get_compression(map, st.st_size) != NO_COMPRESSION) {
+    munmap(map, st.st_size);
+    return false;
+  }
+  posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+  trace->map = map;
+  trace->mapSize = st.st_size;
+  trace->bytes = map;
+  trace->nBytes = st.st_size;
+  trace->isEof = true;
+  return true;
+}
+
+/** read(2) up to n bytes from fd into buf, retrying on EINTR.  Returns
+ *  the # of bytes read, 0 at end of input.
+ */
+static size_t
+read_fd(int fd, unsigned char *buf, size_t n)
+{
+  for (;;) {
+    ssize_t nRead = read(fd, buf, n);
+    if (nRead >= 0) return nRead;
+    if (errno != EINTR) fatal("cannot read trace: %s", strerror(errno));
+  }
+}
+
+/** Inflate up to n bytes of gzip input into buf.  Concatenated gzip
+ *  members are decompressed one after the other, as by gzip -d.
+ *  Returns 0 at end of input.
+ */
+static size_t
+read_gzip(Trace *trace, unsigned char *buf, size_t n)
+{
+  z_stream *zs = trace->zs;
+  zs->next_out = buf;
+  zs->avail_out = n;
+  while (zs->avail_out > 0) {
+    if (zs->avail_in == 0) {
+      if (trace->isZEof) break;
+      zs->next_in = trace->zBuf;
+      zs->avail_in = read_fd(trace->fd, trace->zBuf, CHUNK_SIZE);
+      if (zs->avail_in == 0) {
+        trace->isZEof = true;
+        break;
+      }
+    }
+    int rc = inflate(zs, Z_NO_FLUSH);
+    if (rc == Z_STREAM_END) {
+      inflateReset(zs);
+    }
+    else if (rc != Z_OK && rc != Z_BUF_ERROR) {
+      fatal("cannot inflate gzip trace: %s", zs->msg ? zs->msg : "error");
+    }
+  }
+  return n - zs->avail_out;
+}
+
+/** Read up to n bytes of uncompressed input into buf.  Returns 0 at
+ *  end of input.
+ */
+static size_t
+read_input(Trace *trace, unsigned char *buf, size_t n)
+{
+  if (trace->compression == GZIP_COMPRESSION) return read_gzip(trace, buf, n);
+  size_t nRead = read_fd(trace->fd, buf, n);
+  if (nRead == 0 && trace->zstdPid > 0) {
+    // all of zstd's output has been read, so it must have succeeded
+    int status;
+    waitpid(trace->zstdPid, &status, 0);
+    trace->zstdPid = 0;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fatal("zstd failed to decompress trace");
+    }
+  }
+  return nRead;
+}
+
+/** Move undecoded bytes to the start of the chunk buffer and read
+ *  more input after them until the buffer is full or input is
+ *  exhausted.  A no-op for mapped input.
+ */
+static void
+refill_trace(Trace *trace)
+{
+  if (trace->isEof) return;
+  size_t n = trace->nBytes - trace->pos;
+  memmove(trace->buf, trace->buf + trace->pos, n);
+  trace->pos = 0;
+  while (n < CHUNK_SIZE) {
+    size_t nRead = read_input(trace, trace->buf + n, CHUNK_SIZE - n);
+    if (nRead == 0) {
+      trace->isEof = true;
+      break;
+    }
+    n += nRead;
+  }
+  trace->nBytes = n;
+  trace->buf[n] = '\0';
+}
+
+/** Start decompressing trace's gzip input, of which the first n bytes
+ *  have already been read into trace->buf.
+ */
+static void
+start_gzip(Trace *trace, size_t n)
+{
+  trace->zs = callocChk(1, sizeof(z_stream));
+  trace->zBuf = mallocChk(CHUNK_SIZE);
+  memcpy(trace->zBuf, trace->buf, n);
+  trace->zs->next_in = trace->zBuf;
+  trace->zs->avail_in = n;
+  if (inflateInit2(trace->zs, 15 + 16) != Z_OK) {
+    fatal("cannot initialize zlib");
+  }
+}
+
+/** Start a child process which feeds the already read bytes[n] and
+ *  then the rest of trace's zstd input through zstd -d, and switch
+ *  trace to reading zstd's output.  The child first forks zstd itself
+ *  with popen(); it is the only process writing to zstd's input.
+ */
+static void
+start_zstd(Trace *trace, const unsigned char *bytes, size_t n)
+{
+  int fds[2];
+  if (pipe(fds) < 0) fatal("cannot create pipe: %s", strerror(errno));
+  fflush(NULL);
+  pid_t pid = fork();
+  if (pid < 0) fatal("cannot fork: %s", strerror(errno));
+  if (pid == 0) {
+    if (dup2(fds[1], STDOUT_FILENO) < 0) _exit(1);
+    close(fds[0]);
+    close(fds[1]);
+    FILE *zstd = popen("zstd -d -q -c", "w");
+    if (!zstd) _exit(1);
+    unsigned char *buf = malloc(CHUNK_SIZE);
+    bool isOk = (buf != NULL) && fwrite(bytes, 1, n, zstd) == n;
+    while (isOk) {
+      ssize_t nRead = read(trace->fd, buf, CHUNK_SIZE);
+      if (nRead < 0 && errno == EINTR) continue;
+      if (nRead <= 0) {
+        isOk = nRead == 0;
+        break;
+      }
+      isOk = fwrite(buf, 1, nRead, zstd) == (size_t)nRead;
+    }
+    int status = pclose(zstd);
+    _exit((isOk && status == 0) ? 0 : 1);
+  }
+  close(fds[1]);
+  trace->fd = fds[0];
+  trace->zstdPid = pid;
+}
+
+/** Detect whether trace's unmapped input is compressed and, if so,
+ *  arrange for refill_trace() to decompress it.
+ */
+static void
+start_input(Trace *trace)
+{
+  refill_trace(trace);
+  trace->compression = get_compression(trace->buf, trace->nBytes);
+  if (trace->compression == NO_COMPRESSION) return;
+  size_t n = trace->nBytes;
+  if (trace->compression == GZIP_COMPRESSION) {
+    start_gzip(trace, n);
+  }
+  else {
+    start_zstd(trace, trace->buf, n);
+  }
+  trace->nBytes = trace->pos = 0;
+  trace->isEof = false;
+  refill_trace(trace);
+}
+
+/** Return a new reader for addresses encoded as format in in.  Input
+ *  compressed by gzip or zstd is detected and decompressed.  The
+ *  underlying file descriptor is read directly: an uncompressed
+ *  regular file in a binary format is memory-mapped, anything else
+ *  (e.g. a pipe) is read in large chunks.  Must be called before
+ *  anything is read from in.
+ */
+Trace *
+new_trace(FILE *in, TraceFormat format)
+{
+  Trace *trace = callocChk(1, sizeof(Trace));
+  trace->format = format;
+  trace->fd = fileno(in);
+  if (is_text_format(format) || !map_trace(trace)) {
+    trace->buf = mallocChk(CHUNK_SIZE + 1);
+    trace->bytes = trace->buf;
+    start_input(trace);
+  }
+  return trace;
+}
+
+/** Free all resources used by trace.  Does not close the FILE it
+ *  was created with.
+ */
+void
+free_trace(Trace *trace)
+{
+  if (trace->ring) free_trace_ring(trace->ring);
+  if (trace->map) munmap(trace->map, trace->mapSize);
+  if (trace->zs) {
+    inflateEnd(trace->zs);
+    free(trace->zs);
+    free(trace->zBuf);
+  }
+  if (trace->compression == ZSTD_COMPRESSION) {
+    // closing the pipe first makes an unfinished child die of SIGPIPE
+    close(trace->fd);
+    if (trace->zstdPid > 0) waitpid(trace->zstdPid, NULL, 0);
+  }
+  free(trace->buf);
+  free(trace->all);
+  free(trace->allOps);
+  free(trace);
+}
+
+/** HEX_DIGITS[c] is 1 + the value of hex digit c, 0 if c is not one */
+static const unsigned char HEX_DIGITS[UCHAR_MAX + 1] = {
+  ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+  ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+  ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+  ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+/** The characters isspace() accepts in the C locale */
+static const bool IS_SPACE[UCHAR_MAX + 1] = {
+  [' '] = true, ['\t'] = true, ['\n'] = true,
+  ['\v'] = true, ['\f'] = true, ['\r'] = true,
+};
+
+/** Where a fscanf("%lx") conversion has got to, so that it can be
+ *  continued in the next chunk of input
+ */
+typedef struct {
+  enum {
+    HEX_AT_START,           /** nothing consumed yet */
+    HEX_AFTER_SIGN,         /** after an optional sign */
+    HEX_AFTER_ZERO,         /** after a leading 0, which may begin 0x */
+    HEX_IN_DIGITS,          /** among the digits */
+  } phase;
+  bool isNeg;
+  bool hasDigits;
+  bool isOverflow;
+  MemAddr value;
+} HexScan;
+
+/** Continue *scan, a conversion of the text at p as fscanf("%lx")
+ *  does after skipping whitespace: an optional sign, an optional 0x
+ *  or 0X after a leading 0 and then hex digits.  Returns a pointer
+ *  past the consumed text.  If that is end, the conversion may be
+ *  continued in the text which follows end.  end must point to a
+ *  non-hex character such as NUL.
+ */
+static inline const unsigned char *
+scan_hex(const unsigned char *p, const unsigned char *end, HexScan *scan)
+{
+  switch (scan->phase) {
+  case HEX_AT_START:
+    if (p == end) return p;
+    if (*p == '+' || *p == '-') scan->isNeg = (*p++ == '-');
+    scan->phase = HEX_AFTER_SIGN;
+    // fall through
+  case HEX_AFTER_SIGN:
+    if (p == end) return p;
+    if (*p == '0') {
+      scan->hasDigits = true;
+      p++;
+      scan->phase = HEX_AFTER_ZERO;
+    }
+    else {
+      scan->phase = HEX_IN_DIGITS;
+      break;
+    }
+    // fall through
+  case HEX_AFTER_ZERO:
+    if (p == end) return p;
+    if (*p == 'x' || *p == 'X') p++;
+    scan->phase = HEX_IN_DIGITS;
+    break;
+  case HEX_IN_DIGITS:
+    break;
+  }
+  MemAddr value = scan->value;
+  bool isOverflow = scan->isOverflow;
+  const unsigned char *p0 = p;
+  for (unsigned d; (d = HEX_DIGITS[*p]) != 0; p++) {
+    isOverflow |= (value >> (64 - 4)) != 0;
+    value = (value << 4) | (d - 1);
+  }
+  scan->hasDigits |= p != p0;
+  scan->value = value;
+  scan->isOverflow = isOverflow;
+  return p;
+}
+
+/** Return the result of the finished conversion scan.  Like glibc, a
+ *  0x prefix is consumed even if no digits follow it (giving 0), a
+ *  value which overflows gives ULONG_MAX and a negative one is
+ *  negated modulo 2**64.
+ */
+static inline MemAddr
+hex_value(const HexScan *scan)
+{
+  return scan->isOverflow ? ULONG_MAX
+    : scan->isNeg ? -scan->value : scan->value;
+}
+
+/** Decode hex addresses exactly as successive fscanf("%lx") calls
+ *  would, stopping for good at the first text which is not one.  A
+ *  conversion which runs into the end of the chunk buffer is
+ *  continued after a refill, so tokens may be of any length.
+ */
+static const MemAddr *
+next_hex_block(Trace *trace, size_t *nP)
+{
+  size_t n = 0;
+  HexScan scan = { .phase = HEX_AT_START };
+  while (!trace->isHexDone && n < BLOCK_SIZE) {
+    const unsigned char *p = trace->bytes + trace->pos;
+    const unsigned char *end = trace->bytes + trace->nBytes;
+    if (scan.phase == HEX_AT_START) {
+      while (IS_SPACE[*p]) p++;   // stops at the NUL after bytes[nBytes]
+    }
+    const unsigned char *q = scan_hex(p, end, &scan);
+    trace->pos = q - trace->bytes;
+    if (q == end && !trace->isEof) {
+      refill_trace(trace);
+      continue;
+    }
+    if (!scan.hasDigits) {
+      trace->isHexDone = true;
+      break;
+    }
+    trace->block[n++] = hex_value(&scan);
+    scan = (HexScan) { .phase = HEX_AT_START };
+  }
+  *nP = n;
+  return (n == 0) ? NULL : trace->block;
+}
+
+static const MemAddr *
+next_bin_block(Trace *trace, size_t *nP)
+{
+  if (trace->nBytes - trace->pos < ADDR_BYTES) refill_trace(trace);
+  size_t nAvail = trace->nBytes - trace->pos;
+  if (nAvail < ADDR_BYTES) {
+    if (nAvail > 0) fatal("binary trace truncated: %zu trailing bytes", nAvail);
+    return NULL;
+  }
+  size_t n = nAvail / ADDR_BYTES;
+  if (n > BLOCK_SIZE) n = BLOCK_SIZE;
+  const unsigned char *p = trace->bytes + trace->pos;
+  trace->pos += n * ADDR_BYTES;
+  *nP = n;
+  // mapping and chunk buffer are page/malloc aligned and we always
+  // advance by whole records, so p is suitably aligned for MemAddr
+  if (is_little_endian()) return (const MemAddr *)p;
+  for (size_t i = 0; i < n; i++, p += ADDR_BYTES) {
+    MemAddr a = 0;
+    for (int j = ADDR_BYTES - 1; j >= 0; j--) a = (a << 8) | p[j];
+    trace->block[i] = a;
+  }
+  return trace->block;
+}
+
+static const MemAddr *
+next_delta_block(Trace *trace, size_t *nP)
+{
+  size_t n = 0;
+  MemAddr last = trace->last;
+  while (n < BLOCK_SIZE) {
+    if (trace->nBytes - trace->pos < MAX_VARINT_BYTES) {
+      refill_trace(trace);
+      if (trace->pos == trace->nBytes) break;
+    }
+    const unsigned char *p = trace->bytes + trace->pos;
+    const unsigned char *end = trace->bytes + trace->nBytes;
+    uint64_t zz = 0;
+    unsigned shift = 0;
+    unsigned char c;
+    do {
+      if (p == end || shift >= 7*MAX_VARINT_BYTES) {
+        fatal("delta trace truncated or corrupt at record %lu",
+              trace->nRecords + n + 1);
+      }
+      c = *p++;
+      zz |= (uint64_t)(c & 0x7f) << shift;
+      shift += 7;
+    } while (c & 0x80);
+    trace->pos = p - trace->bytes;
+    last += (zz >> 1) ^ -(zz & 1);
+    trace->block[n++] = last;
+  }
+  trace->last = last;
+  trace->nRecords += n;
+  *nP = n;
+  return (n == 0) ? NULL : trace->block;
+}
+
+/** Return the AccessOp for lackey kind character c, setting *nOpsP
+ *  to the # of records it stands for: 2 for M, 0 for I and for an
+ *  invalid kind, in which case *isOkP is set false.
+ */
+static inline AccessOp
+rw_op(unsigned char c, unsigned *nOpsP, bool *isOkP)
+{
+  AccessOp op = { READ_ACCESS, 0, 0 };
+  *isOkP = true;
+  switch (c) {
+  case 'L':
+    *nOpsP = 1;
+    break;
+  case 'S':
+    op.kind = WRITE_ACCESS;
+    *nOpsP = 1;
+    break;
+  case 'M':
+    *nOpsP = 2;
+    break;
+  case 'I':
+    *nOpsP = 0;
+    break;
+  default:
+    *nOpsP = 0;
+    *isOkP = false;
+    break;
+  }
+  return op;
+}
+
+/** Decode the RW_TRACE record in line[0, eol) into *addrP and *opP,
+ *  setting *nOpsP as for rw_op().  Returns false if it is malformed.
+ */
+static bool
+scan_rw(const unsigned char *line, const unsigned char *eol,
+        MemAddr *addrP, AccessOp *opP, unsigned *nOpsP)
+{
+  unsigned core = 0;
+  if (*line >= '0' && *line <= '9') {
+    for (; *line >= '0' && *line <= '9'; line++) {
+      core = core*10 + (*line - '0');
+      if (core > MAX_TRACE_CORE) return false;
+    }
+    if (*line != ' ' && *line != '\t') return false;
+    while (*line == ' ' || *line == '\t') line++;
+  }
+  bool isOk;
+  *opP = rw_op(*line, nOpsP, &isOk);
+  opP->core = core;
+  const unsigned char *p = line + 1;
+  if (!isOk || (*p != ' ' && *p != '\t')) return false;
+  while (*p == ' ' || *p == '\t') p++;
+  if (*p == '+' || *p == '-') return false;
+  HexScan scan = { .phase = HEX_AT_START };
+  p = scan_hex(p, eol, &scan);   // the record ends at the non-hex *eol
+  if (!scan.hasDigits || *p++ != ',') return false;
+  *addrP = hex_value(&scan);
+  if (*p < '0' || *p > '9') return false;
+  unsigned long size = 0;
+  for (; *p >= '0' && *p <= '9'; p++) {
+    size = size*10 + (*p - '0');
+    if (size > USHRT_MAX) return false;
+  }
+  opP->size = size;
+  while (p < eol && IS_SPACE[*p]) p++;
+  return p == eol;
+}
+
+/** Decode RW_TRACE lines into trace->block[] and trace->ops[].  Each
+ *  line is only decoded once it is entirely in the chunk buffer.
+ */
+static const MemAddr *
+next_rw_block(Trace *trace, size_t *nP)
+{
+  size_t n = 0;
+  while (n + 2 <= BLOCK_SIZE) {   // room for both records of an M
+    const unsigned char *p = trace->bytes + trace->pos;
+    const unsigned char *end = trace->bytes + trace->nBytes;
+    while (IS_SPACE[*p]) p++;   // stops at the NUL after bytes[nBytes]
+    const unsigned char *eol = memchr(p, '\n', end - p);
+    if (!eol && !trace->isEof) {
+      trace->pos = p - trace->bytes;
+      if (trace->pos == 0 && trace->nBytes == CHUNK_SIZE) {
+        fatal("rw trace line longer than %d bytes", CHUNK_SIZE);
+      }
+      refill_trace(trace);
+      continue;
+    }
+    if (p == end) {
+      trace->pos = p - trace->bytes;
+      break;
+    }
+    if (!eol) eol = end;
+    trace->pos = eol - trace->bytes;
+    trace->nRecords++;
+    MemAddr addr = 0;
+    AccessOp op;
+    unsigned nOps = 0;
+    if (!scan_rw(p, eol, &addr, &op, &nOps)) {
+      fatal("rw trace line %lu is not \"[CORE] K ADDR,SIZE\"",
+            trace->nRecords);
+    }
+    for (unsigned k = 0; k < nOps; k++) {
+      // the second record of an M is its store
+      if (k == 1) op.kind = WRITE_ACCESS;
+      trace->block[n] = addr;
+      trace->ops[n++] = op;
+    }
+  }
+  *nP = n;
+  return (n == 0) ? NULL : trace->block;
+}
+
+/** As next_trace_block(), but also set *opsP to the AccessOp's of the
+ *  addresses in the block, or NULL if trace's format does not carry
+ *  them (in which case every access is a read).
+ */
+const MemAddr *
+next_trace_ops_block(Trace *trace, size_t *nP, const AccessOp **opsP)
+{
+  if (trace->ring) return next_ring_block(trace->ring, nP, opsP);
+  *opsP = NULL;
+  switch (trace->format) {
+  case BIN_TRACE:
+    return next_bin_block(trace, nP);
+  case DELTA_TRACE:
+    return next_delta_block(trace, nP);
+  case RW_TRACE:
+    *opsP = trace->ops;
+    return next_rw_block(trace, nP);
+  default:
+    return next_hex_block(trace, nP);
+  }
+}
+
+/** Return a pointer to the next block of addresses from trace and set
+ *  *nP to the # of addresses in it.  Returns NULL at end of trace.
+ *  The block remains valid only until the next call on trace.  For a
+ *  memory-mapped BIN_TRACE the block points directly into the mapping.
+ */
+const MemAddr *
+next_trace_block(Trace *trace, size_t *nP)
+{
+  const AccessOp *ops;
+  return next_trace_ops_block(trace, nP, &ops);
+}
+
+/** Return all remaining addresses from trace as a single array and
+ *  set *nP to their #.  The array remains valid until trace is freed
+ *  and may be shared by several threads.  For a memory-mapped
+ *  BIN_TRACE it is the mapping itself, so nothing is copied.
+ */
+const MemAddr *
+load_trace(Trace *trace, size_t *nP)
+{
+  const AccessOp *ops;
+  return load_trace_ops(trace, nP, &ops);
+}
+
+/** As load_trace(), but also set *opsP to the AccessOp's of all the
+ *  addresses, or NULL as for next_trace_ops_block().
+ */
+const MemAddr *
+load_trace_ops(Trace *trace, size_t *nP, const AccessOp **opsP)
+{
+  *opsP = NULL;
+  if (trace->format == BIN_TRACE && trace->map && is_little_endian() &&
+      !trace->ring) {
+    size_t nAvail = trace->nBytes - trace->pos;
+    if (nAvail % ADDR_BYTES != 0) {
+      fatal("binary trace truncated: %zu trailing bytes",
+            nAvail % ADDR_BYTES);
+    }
+    const MemAddr *addrs = (const MemAddr *)(trace->bytes + trace->pos);
+    trace->pos = trace->nBytes;
+    *nP = nAvail / ADDR_BYTES;
+    return addrs;
+  }
+  size_t n = 0;
+  size_t nAlloc = 0;
+  const MemAddr *block;
+  const AccessOp *blockOps;
+  size_t nBlock;
+  while ((block = next_trace_ops_block(trace, &nBlock, &blockOps)) != NULL) {
+    if (n + nBlock > nAlloc) {
+      nAlloc = (nAlloc == 0) ? 4 * BLOCK_SIZE : 2 * nAlloc;
+      trace->all = reallocChk(trace->all, nAlloc * sizeof(MemAddr));
+      if (blockOps) {
+        trace->allOps = reallocChk(trace->allOps, nAlloc * sizeof(AccessOp));
+      }
+    }
+    memcpy(&trace->all[n], block, nBlock * sizeof(MemAddr));
+    if (blockOps) {
+      memcpy(&trace->allOps[n], blockOps, nBlock * sizeof(AccessOp));
+    }
+    n += nBlock;
+  }
+  *nP = n;
+  *opsP = trace->allOps;
+  return trace->all;
+}
+
+/*************************** Threaded Reader ***************************/
+
+/** Blocks are handed from the reader thread to next_trace_block()
+ *  through a ring of N_RING_BLOCKS slots.  With one producer and one
+ *  consumer no locks are needed: only the reader advances head and
+ *  only the consumer advances tail, and each publishes its slot
+ *  updates with a release store which the other side acquires.  A
+ *  side which finds the ring full (or empty) spins briefly and then
+ *  yields the CPU.
+ */
+enum {
+  N_RING_BLOCKS = 16,
+  N_SPINS = 64,                 /** polls before sched_yield() */
+};
+
+typedef struct {
+  size_t n;
+  bool hasOps;
+  MemAddr addrs[BLOCK_SIZE];
+  AccessOp ops[BLOCK_SIZE];
+} RingBlock;
+
+struct TraceRingImpl {
+  Trace *source;                /** synchronous reader run by thread */
+  pthread_t thread;
+  atomic_size_t head;           /** # of blocks ever produced */
+  atomic_size_t tail;           /** # of blocks ever consumed */
+  atomic_bool isDone;           /** source exhausted, set after last head */
+  atomic_bool isStopped;        /** consumer is going away */
+  bool isHolding;               /** consumer holds block tail % N */
+  RingBlock blocks[N_RING_BLOCKS];
+};
+
+static void
+ring_wait(unsigned *nPollsP)
+{
+  if (++*nPollsP >= N_SPINS) {
+    sched_yield();
+    *nPollsP = 0;
+  }
+}
+
+static void *
+ring_reader(void *arg)
+{
+  TraceRing *ring = arg;
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  const MemAddr *addrs;
+  const AccessOp *ops;
+  size_t n;
+  while ((addrs = next_trace_ops_block(ring->source, &n, &ops)) != NULL) {
+    unsigned nPolls = 0;
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire)
+           == N_RING_BLOCKS) {
+      if (atomic_load_explicit(&ring->isStopped, memory_order_relaxed)) {
+        return NULL;
+      }
+      ring_wait(&nPolls);
+    }
+    RingBlock *block = &ring->blocks[head % N_RING_BLOCKS];
+    memcpy(block->addrs, addrs, n * sizeof(MemAddr));
+    if (ops) memcpy(block->ops, ops, n * sizeof(AccessOp));
+    block->hasOps = ops != NULL;
+    block->n = n;
+    atomic_store_explicit(&ring->head, ++head, memory_order_release);
+  }
+  atomic_store_explicit(&ring->isDone, true, memory_order_release);
+  return NULL;
+}
+
+static const MemAddr *
+next_ring_block(TraceRing *ring, size_t *nP, const AccessOp **opsP)
+{
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  if (ring->isHolding) {
+    // done with the block returned by the previous call
+    atomic_store_explicit(&ring->tail, ++tail, memory_order_release);
+    ring->isHolding = false;
+  }
+  unsigned nPolls = 0;
+  while (atomic_load_explicit(&ring->head, memory_order_acquire) == tail) {
+    if (atomic_load_explicit(&ring->isDone, memory_order_acquire)) {
+      // head cannot have moved after isDone was set
+      if (atomic_load_explicit(&ring->head, memory_order_acquire) == tail) {
+        return NULL;
+      }
+      break;
+    }
+    ring_wait(&nPolls);
+  }
+  RingBlock *block = &ring->blocks[tail % N_RING_BLOCKS];
+  ring->isHolding = true;
+  *nP = block->n;
+  *opsP = block->hasOps ? block->ops : NULL;
+  return block->addrs;
+}
+
+static void
+free_trace_ring(TraceRing *ring)
+{
+  atomic_store(&ring->isStopped, true);
+  pthread_join(ring->thread, NULL);
+  free_trace(ring->source);
+  free(ring);
+}
+
+/** Like new_trace(), but input is read, decompressed and decoded on a
+ *  separate reader thread which hands fixed-size blocks of addresses
+ *  to next_trace_block() through a lock-free ring, so that decoding
+ *  overlaps with whatever the caller does with the blocks.  A
+ *  memory-mapped uncompressed little-endian BIN_TRACE needs no
+ *  decoding and is read directly.
+ */
+Trace *
+new_threaded_trace(FILE *in, TraceFormat format)
+{
+  Trace *source = new_trace(in, format);
+  if (source->map && format == BIN_TRACE && is_little_endian()) {
+    return source;
+  }
+  TraceRing *ring = callocChk(1, sizeof(TraceRing));
+  ring->source = source;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->isDone, false);
+  atomic_init(&ring->isStopped, false);
+  Trace *trace = callocChk(1, sizeof(Trace));
+  trace->format = format;
+  trace->ring = ring;
+  if (pthread_create(&ring->thread, NULL, ring_reader, ring) != 0) {
+    fatal("cannot create trace reader thread");
+  }
+  return trace;
+}
+
+/*************************** Writer ************************************/
+
+struct TraceWriterImpl {
+  TraceFormat format;
+  FILE *out;
+  MemAddr last;              /** last address written by DELTA_TRACE */
+  unsigned char buf[BLOCK_SIZE * MAX_VARINT_BYTES];
+};
+
+/** Return a new writer which writes addresses encoded as format to out */
+TraceWriter *
+new_trace_writer(FILE *out, TraceFormat format)
+{
+  TraceWriter *writer = callocChk(1, sizeof(TraceWriter));
+  writer->format = format;
+  writer->out = out;
+  return writer;
+}
+
+static void
+write_bytes(TraceWriter *writer, size_t n)
+{
+  if (fwrite(writer->buf, 1, n, writer->out) != n) {
+    fatal("cannot write trace: %s", strerror(errno));
+  }
+}
+
+/** Append addrs[n] to the trace being written by writer.  A RW_TRACE
+ *  gets loads of unknown size 0.
+ */
+void
+write_trace(TraceWriter *writer, const MemAddr addrs[], size_t n)
+{
+  write_trace_ops(writer, addrs, NULL, n);
+}
+
+/** As write_trace(), but a RW_TRACE gets each addrs[i] as accessed by
+ *  ops[i]; other formats drop ops.
+ */
+void
+write_trace_ops(TraceWriter *writer, const MemAddr addrs[],
+                const AccessOp ops[], size_t n)
+{
+  for (size_t i0 = 0; i0 < n; i0 += BLOCK_SIZE) {
+    size_t i1 = (n - i0 < BLOCK_SIZE) ? n : i0 + BLOCK_SIZE;
+    unsigned char *p = writer->buf;
+    switch (writer->format) {
+    case BIN_TRACE:
+      if (is_little_endian()) {
+        // already in trace byte order
+        if (fwrite(&addrs[i0], ADDR_BYTES, i1 - i0, writer->out) != i1 - i0) {
+          fatal("cannot write trace: %s", strerror(errno));
+        }
+        break;
+      }
+      for (size_t i = i0; i < i1; i++) {
+        for (int j = 0; j < ADDR_BYTES; j++) *p++ = addrs[i] >> (8*j);
+      }
+      write_bytes(writer, p - writer->buf);
+      break;
+    case DELTA_TRACE:
+      for (size_t i = i0; i < i1; i++) {
+        int64_t delta = (int64_t)(addrs[i] - writer->last);
+        uint64_t zz = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+        writer->last = addrs[i];
+        do {
+          unsigned char c = zz & 0x7f;
+          zz >>= 7;
+          *p++ = c | ((zz != 0) ? 0x80 : 0);
+        } while (zz != 0);
+      }
+      write_bytes(writer, p - writer->buf);
+      break;
+    case RW_TRACE:
+      for (size_t i = i0; i < i1; i++) {
+        bool isWrite = ops && ops[i].kind == WRITE_ACCESS;
+        if (ops && ops[i].core != 0) fprintf(writer->out, "%u", ops[i].core);
+        fprintf(writer->out, " %c %lx,%u\n", isWrite ? 'S' : 'L', addrs[i],
+                ops ? ops[i].size : 0);
+      }
+      break;
+    default:
+      for (size_t i = i0; i < i1; i++) {
+        fprintf(writer->out, "%lx\n", addrs[i]);
+      }
+      break;
+    }
+  }
+}
+
+/** Flush and free writer.  Does not close the FILE it was created with. */
+void
+free_trace_writer(TraceWriter *writer)
+{
+  if (fflush(writer->out) != 0) {
+    fatal("cannot write trace: %s", strerror(errno));
+  }
+  free(writer);
+}
@@ -0,0 +1,111 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "cache-sim.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+/** Encoding used for a file of memory addresses */
+typedef enum {
+  HEX_TRACE,     /** whitespace-separated hex addresses as read by "%lx" */
+  BIN_TRACE,     /** raw little-endian 64-bit addresses */
+  DELTA_TRACE,   /** zigzag LEB128 varints of successive differences */
+  RW_TRACE,      /** valgrind lackey lines "K ADDR,SIZE" (see below) */
+  N_TRACE_FORMATS
+} TraceFormat;
+
+/** All format names separated by '|', for usage messages */
+#define TRACE_FORMAT_NAMES "hex|bin|delta|rw"
+
+/** A RW_TRACE has one access per line as produced by valgrind
+ *  --tool=lackey --trace-mem=yes and used by CS:APP cachelab: optional
+ *  leading spaces, a kind K, spaces, a hex ADDR, a comma and a decimal
+ *  SIZE in bytes.  K is L (load), S (store), M (modify: a load followed
+ *  by a store, so two records) or I (instruction fetch, skipped).  A
+ *  line of a multi-core trace starts with the decimal CORE (at most
+ *  MAX_TRACE_CORE) which made the access followed by spaces; other
+ *  lines are from core 0.  It is the only format which carries
+ *  AccessOp's.
+ */
+enum { MAX_TRACE_CORE = 255 };
+
+/** Translate from format name "hex", "bin", "delta" or "rw" to a
+ *  TraceFormat.  Return < 0 on error.
+ */
+int get_trace_format(const char *name);
+
+/** Opaque trace reader */
+typedef struct TraceImpl Trace;
+
+/** Return a new reader for addresses encoded as format in in.  Input
+ *  compressed by gzip or zstd is detected and decompressed.  The
+ *  underlying file descriptor is read directly: an uncompressed
+ *  regular file in a binary format is memory-mapped, anything else
+ *  (e.g. a pipe) is read in large chunks.  Must be called before
+ *  anything is read from in.
+ */
+Trace *new_trace(FILE *in, TraceFormat format);
+
+/** Like new_trace(), but input is read, decompressed and decoded on a
+ *  separate reader thread which hands fixed-size blocks of addresses
+ *  to next_trace_block() through a lock-free ring, so that decoding
+ *  overlaps with whatever the caller does with the blocks.  A
+ *  memory-mapped uncompressed little-endian BIN_TRACE needs no
+ *  decoding and is read directly.
+ */
+Trace *new_threaded_trace(FILE *in, TraceFormat format);
+
+/** Return a pointer to the next block of addresses from trace and set
+ *  *nP to the # of addresses in it.  Returns NULL at end of trace.
+ *  The block remains valid only until the next call on trace.  For a
+ *  memory-mapped BIN_TRACE the block points directly into the mapping.
+ */
+const MemAddr *next_trace_block(Trace *trace, size_t *nP);
+
+/** As next_trace_block(), but also set *opsP to the AccessOp's of the
+ *  addresses in the block, or NULL if trace's format does not carry
+ *  them (in which case every access is a read).
+ */
+const MemAddr *next_trace_ops_block(Trace *trace, size_t *nP,
+                                    const AccessOp **opsP);
+
+/** Return all remaining addresses from trace as a single array and
+ *  set *nP to their #.  The array remains valid until trace is freed
+ *  and may be shared by several threads.  For a memory-mapped
+ *  BIN_TRACE it is the mapping itself, so nothing is copied.
+ */
+const MemAddr *load_trace(Trace *trace, size_t *nP);
+
+/** As load_trace(), but also set *opsP to the AccessOp's of all the
+ *  addresses, or NULL as for next_trace_ops_block().
+ */
+const MemAddr *load_trace_ops(Trace *trace, size_t *nP,
+                              const AccessOp **opsP);
+
+/** Free all resources used by trace.  Does not close the FILE it
+ *  was created with.
+ */
+void free_trace(Trace *trace);
+
+/** Opaque trace writer */
+typedef struct TraceWriterImpl TraceWriter;
+
+/** Return a new writer which writes addresses encoded as format to out */
+TraceWriter *new_trace_writer(FILE *out, TraceFormat format);
+
+/** Append addrs[n] to the trace being written by writer.  A RW_TRACE
+ *  gets loads of unknown size 0.
+ */
+void write_trace(TraceWriter *writer, const MemAddr addrs[], size_t n);
+
+/** As write_trace(), but a RW_TRACE gets each addrs[i] as accessed by
+ *  ops[i]; other formats drop ops.
+ */
+void write_trace_ops(TraceWriter *writer, const MemAddr addrs[],
+                     const AccessOp ops[], size_t n);
+
+/** Flush and free writer.  Does not close the FILE it was created with. */
+void free_trace_writer(TraceWriter *writer);
+
+#endif //ifndef TRACE_H_